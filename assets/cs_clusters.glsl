@@ -0,0 +1,114 @@
+#version 430
+
+// Light assignment for clustered shading (see ClusteredLighting.h). One work
+// group per depth slice and one invocation per cluster of the slice. Lights
+// are read a batch at a time: each invocation transforms one light to view
+// space and keeps it in shared memory if it touches the slice at all; then
+// every cluster tests the kept lights against its own bounds and writes the
+// ones that touch it to its list. Most lights are thus rejected once per
+// slice rather than once per cluster.
+
+layout (local_size_x = 16, local_size_y = 9) in;
+
+// Matches PointLight in ClusteredLighting.h
+struct PointLight {
+    vec4 positionRadius;
+    vec4 colorIntensity;
+};
+
+layout (std430, binding = 5) readonly buffer Lights {
+    PointLight lights[];
+};
+layout (std430, binding = 6) writeonly buffer ClusterCounts {
+    uint clusterCounts[];
+};
+layout (std430, binding = 7) writeonly buffer ClusterLights {
+    uint clusterLights[];
+};
+// light references, max lights in a cluster, overflowed clusters
+layout (std430, binding = 2) buffer Counters {
+    uint counters[3];
+};
+
+// Match the constants in ClusteredLighting.h
+const uvec3 kGrid = uvec3(16, 9, 24);
+const uint kMaxClusterLights = 512;
+
+uniform mat4 view;
+uniform vec2 tanHalfFov;    // extent of the view volume at unit depth
+uniform vec3 depthRange;    // near plane, first slice boundary, far plane
+uniform uint lightCount;
+
+const uint kBatch = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+shared vec4 batch[kBatch];          // view-space position, radius
+shared uint batchLights[kBatch];    // index of each light in lights[]
+shared uint batchSize;
+
+// Distance of the slice boundary from the camera
+float slice_depth(uint slice)
+{
+    if (0u == slice)
+        return depthRange.x;
+    return depthRange.y * pow(depthRange.z / depthRange.y, float(slice) / float(kGrid.z));
+}
+
+bool touches(vec4 light, vec3 boundsMin, vec3 boundsMax)
+{
+    vec3 d = light.xyz - clamp(light.xyz, boundsMin, boundsMax);
+    return dot(d, d) <= light.w * light.w;
+}
+
+void main()
+{
+    uvec3 cell = gl_GlobalInvocationID; // work group sizes match kGrid.xy
+    uint cluster = (cell.z * kGrid.y + cell.y) * kGrid.x + cell.x;
+
+    // The tile is a rectangle in NDC; scaled by depth, it spans the cluster
+    // at the near and far boundary of its slice. The bounds contain both.
+    float near = slice_depth(cell.z);
+    float far = slice_depth(cell.z + 1u);
+    vec2 ndcMin = vec2(cell.xy) / vec2(kGrid.xy) * 2.0 - 1.0;
+    vec2 ndcMax = vec2(cell.xy + 1u) / vec2(kGrid.xy) * 2.0 - 1.0;
+    vec2 a = ndcMin * tanHalfFov;
+    vec2 b = ndcMax * tanHalfFov;
+    vec3 boundsMin = vec3(min(a * near, a * far), -far);
+    vec3 boundsMax = vec3(max(b * near, b * far), -near);
+
+    // Bounds of the whole slice
+    vec3 sliceMin = vec3(-tanHalfFov * far, -far);
+    vec3 sliceMax = vec3(tanHalfFov * far, -near);
+
+    uint count = 0u;
+    for (uint first = 0u; first < lightCount; first += kBatch) {
+        if (0u == gl_LocalInvocationIndex)
+            batchSize = 0u;
+        barrier();
+
+        uint index = first + gl_LocalInvocationIndex;
+        if (index < lightCount) {
+            vec4 light = lights[index].positionRadius;
+            light.xyz = (view * vec4(light.xyz, 1.0)).xyz;
+            if (touches(light, sliceMin, sliceMax)) {
+                uint slot = atomicAdd(batchSize, 1u);
+                batch[slot] = light;
+                batchLights[slot] = index;
+            }
+        }
+        barrier();
+
+        for (uint i = 0u; i < batchSize; ++i) {
+            if (touches(batch[i], boundsMin, boundsMax)) {
+                if (count < kMaxClusterLights)
+                    clusterLights[cluster * kMaxClusterLights + count] = batchLights[i];
+                ++count;
+            }
+        }
+        barrier();
+    }
+
+    clusterCounts[cluster] = min(count, kMaxClusterLights);
+    atomicAdd(counters[0], min(count, kMaxClusterLights));
+    atomicMax(counters[1], count);
+    if (count > kMaxClusterLights)
+        atomicAdd(counters[2], 1u);
+}
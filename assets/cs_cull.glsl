@@ -0,0 +1,164 @@
+#version 430
+
+// GPU frustum culling. One invocation per object: objects whose world-space
+// bounds intersect the view frustum are appended to the instance range of
+// their mesh's indirect draw command, so the following multi-draw only sees
+// visible instances.
+//
+// With occlusion culling, this runs in two phases around the draws:
+//  1. objects that were visible last frame are frustum tested and drawn,
+//  2. the Hi-Z pyramid is built from that depth, and all objects are tested
+//     against it. Visible ones that were not drawn in phase 1 are drawn now,
+//     and the visibility of every object is stored for the next frame.
+// Objects that become visible are thus drawn in the same frame (no popping).
+
+layout (local_size_x = 64) in;
+
+// Matches InstanceData in Render.h
+struct Instance {
+    mat4 model;
+    uint material;
+    uint layer;
+};
+
+// Matches CullObject in GpuCulling.h
+struct Object {
+    mat4 model;
+    uint material;
+    uint layer;
+    uint command;
+    uint pad;
+    vec4 boundsMin;
+    vec4 boundsMax;
+};
+
+// Matches DrawElementsIndirectCommand in IndirectRenderer.h
+struct Command {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding = 0, row_major) writeonly buffer Instances {
+    Instance instances[];
+};
+layout (std430, binding = 2, row_major) readonly buffer Objects {
+    Object objects[];
+};
+layout (std430, binding = 3) buffer Commands {
+    Command commands[];
+};
+
+layout (std430, binding = 4) buffer Visibility {
+    uint visibility[];
+};
+
+layout (binding = 0, offset = 0) uniform atomic_uint visibleCount;
+layout (binding = 0, offset = 4) uniform atomic_uint lateCount;
+layout (binding = 0, offset = 8) uniform atomic_uint occludedCount;
+
+uniform vec4 frustumPlanes[6];
+uniform uint objectCount;
+
+// 0: frustum culling only, 1 and 2: phases of occlusion culling (see above)
+uniform uint phase;
+
+uniform mat4 viewProjection;
+uniform sampler2D hiz;
+uniform int hizLevels;
+
+// True if the box is certainly hidden behind the depth in the Hi-Z pyramid.
+bool occluded(vec3 boxMin, vec3 boxMax)
+{
+    vec3 ndcMin = vec3(1.0);
+    vec3 ndcMax = vec3(-1.0);
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = mix(boxMin, boxMax, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        if (clip.w <= 0.0)
+            return false; // crosses the camera plane
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+
+    ivec2 size0 = textureSize(hiz, 0);
+    vec2 pixelMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0) * vec2(size0);
+    vec2 pixelMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0) * vec2(size0);
+    float nearest = ndcMin.z * 0.5 + 0.5;
+
+    // Pick the level at which the rectangle covers at most 2x2 texels
+    float extent = max(pixelMax.x - pixelMin.x, pixelMax.y - pixelMin.y);
+    int level = clamp(int(ceil(log2(max(extent, 1.0)))), 0, hizLevels - 1);
+
+    ivec2 size = max(size0 >> level, ivec2(1)); // see HiZ.h
+    ivec2 a = clamp(ivec2(pixelMin) >> level, ivec2(0), size - 1);
+    ivec2 b = clamp(ivec2(pixelMax) >> level, ivec2(0), size - 1);
+
+    float farthest = max(
+        max(texelFetch(hiz, a, level).r, texelFetch(hiz, ivec2(b.x, a.y), level).r),
+        max(texelFetch(hiz, ivec2(a.x, b.y), level).r, texelFetch(hiz, b, level).r)
+    );
+
+    return nearest > farthest;
+}
+
+void append(Object object)
+{
+    uint slot = atomicAdd(commands[object.command].instanceCount, 1u);
+    uint target = commands[object.command].baseInstance + slot;
+    instances[target].model = object.model;
+    instances[target].material = object.material;
+    instances[target].layer = object.layer;
+}
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= objectCount)
+        return;
+
+    Object object = objects[index];
+
+    // World-space box around the transformed local box
+    vec3 center = 0.5 * (object.boundsMin.xyz + object.boundsMax.xyz);
+    vec3 extents = 0.5 * (object.boundsMax.xyz - object.boundsMin.xyz);
+
+    vec3 worldCenter = (object.model * vec4(center, 1.0)).xyz;
+    mat3 m = mat3(object.model);
+    vec3 worldExtents = abs(m[0]) * extents.x + abs(m[1]) * extents.y + abs(m[2]) * extents.z;
+
+    bool inFrustum = true;
+    for (int i = 0; i < 6; ++i) {
+        vec4 plane = frustumPlanes[i];
+        float d = dot(plane.xyz, worldCenter) + plane.w;
+        float r = dot(abs(plane.xyz), worldExtents);
+        if (d < -r)
+            inFrustum = false;
+    }
+
+    if (phase == 0u || phase == 1u) {
+        if (!inFrustum || (phase == 1u && visibility[index] == 0u))
+            return;
+
+        append(object);
+        atomicCounterIncrement(visibleCount);
+        return;
+    }
+
+    // Phase 2
+    bool visible = inFrustum;
+    if (visible && occluded(worldCenter - worldExtents, worldCenter + worldExtents)) {
+        visible = false;
+        atomicCounterIncrement(occludedCount);
+    }
+
+    if (visible && visibility[index] == 0u) {
+        append(object);
+        atomicCounterIncrement(lateCount);
+    }
+
+    visibility[index] = visible ? 1u : 0u;
+}
@@ -0,0 +1,44 @@
+#version 430
+
+// Builds one level of the Hi-Z pyramid (see HiZ.h). With fromDepth set, copies
+// the depth texture into level 0; otherwise each texel takes the farthest
+// depth of the 2x2 texels below it (3 wide/tall at the last column/row of an
+// odd-sized source).
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D depthTexture;
+layout (r32f, binding = 0) uniform readonly image2D source;
+layout (r32f, binding = 1) uniform writeonly image2D destination;
+
+uniform int fromDepth;
+uniform ivec2 sourceSize;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(destination);
+    if (any(greaterThanEqual(texel, size)))
+        return;
+
+    if (fromDepth != 0) {
+        imageStore(destination, texel, vec4(texelFetch(depthTexture, texel, 0).r));
+        return;
+    }
+
+    ivec2 base = texel * 2;
+    ivec2 last = ivec2(
+        (texel.x == size.x - 1 && (sourceSize.x & 1) == 1) ? 2 : 1,
+        (texel.y == size.y - 1 && (sourceSize.y & 1) == 1) ? 2 : 1
+    );
+
+    float depth = 0.0;
+    for (int y = 0; y <= last.y; ++y) {
+        for (int x = 0; x <= last.x; ++x) {
+            ivec2 p = min(base + ivec2(x, y), sourceSize - 1);
+            depth = max(depth, imageLoad(source, p).r);
+        }
+    }
+
+    imageStore(destination, texel, vec4(depth));
+}
@@ -0,0 +1,7 @@
+#version 430
+
+// Occlusion query proxies only need to pass the depth test; color writes
+// are masked off.
+void main()
+{
+}
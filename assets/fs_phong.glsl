@@ -1,13 +1,21 @@
-
 #version 430
 
-out vec4 FragColor;
+// Phong shading of the scene, in three variants:
+//  - forward (default): shades the fragment,
+//  - GBUFFER: writes the fragment's surface to the G-buffer instead (see
+//    DeferredShading.h),
+//  - DEFERRED_LIGHTING: fullscreen pass (with vs_fullscreen.glsl) that reads
+//    the surface back from the G-buffer and shades it.
+// The lighting code is shared, so both paths compute the same terms.
 
-in VS_OUT {
-    vec3 WorldPos;
-    vec3 Normal;
-    vec2 TexCoords;
-} fs_in;
+#ifdef GBUFFER
+layout (location = 0) out vec4 GBufferDiffuse;    // diffuse color
+layout (location = 1) out vec4 GBufferSpecular;   // specular color, shininess / 255
+layout (location = 2) out vec2 GBufferNormal;     // octahedral encoded
+layout (location = 3) out vec3 GBufferUnlit;      // emission + ambient
+#else
+out vec4 FragColor;
+#endif
 
 struct Light {
     vec3 position;
@@ -23,32 +31,234 @@ struct Material {
     vec3 emission;
 };
 
+// Everything the lighting needs to know about a point of a surface
+struct Surface {
+    vec3 position;
+    vec3 normal;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+    vec3 unlit;
+};
+
 uniform Light light;
-uniform Material material;
 
+#ifdef DEFERRED_LIGHTING
+uniform sampler2D gbufferDiffuse;
+uniform sampler2D gbufferSpecular;
+uniform sampler2D gbufferNormal;
+uniform sampler2D gbufferUnlit;
+uniform sampler2D gbufferDepth;
+#else
+in VS_OUT {
+    vec3 WorldPos;
+    vec3 Normal;
+    vec2 TexCoords;
+    flat uint Material;
+    flat uint Layer;
+} fs_in;
+
+#ifdef INDIRECT_MATERIALS
+// Indirect draw path: materials and textures are looked up per instance.
+// Matches GpuMaterial in IndirectRenderer.h.
+layout (std430, binding = 1) readonly buffer Materials {
+    Material materials[];
+};
+uniform sampler2DArray texture_layers;
+#else
+uniform Material material;
 uniform sampler2D texture_diffuse;
-uniform vec3 viewPos;
+#endif
+#endif
 
-void main()
-{           
-    vec3 color = texture(texture_diffuse, fs_in.TexCoords).rgb;
-    // ambient
-    vec3 ambient = 0.5 * color * material.ambient;
+// Matches FrameUniforms in Render.h
+layout (std140, binding = 0, row_major) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+    vec4 clusterDepth;
+    vec4 clusterTile;
+    uvec4 clusterGrid;
+    mat4 shadowMatrices[4];
+    vec4 shadowSplits;
+    vec4 shadowTexel;
+    uvec4 shadowCascades;
+};
 
+// Clustered point lights (see ClusteredLighting.h), listed per cluster by
+// cs_clusters.glsl. Matches PointLight in ClusteredLighting.h.
+struct PointLight {
+    vec4 positionRadius;
+    vec4 colorIntensity;
+};
+
+layout (std430, binding = 5) readonly buffer Lights {
+    PointLight lights[];
+};
+layout (std430, binding = 6) readonly buffer ClusterCounts {
+    uint clusterCounts[];
+};
+layout (std430, binding = 7) readonly buffer ClusterLights {
+    uint clusterLights[];
+};
+
+const uint kMaxClusterLights = 512;
+
+// Shadow maps of the main light (see CascadedShadows.h)
+layout (binding = 7) uniform sampler2DArrayShadow shadowMap;
+
+// Sum of the lights of the fragment's cluster.
+vec3 clustered_lights(Surface surface, vec3 viewDir)
+{
+    // Cluster from the window position and the view depth (slices are
+    // exponential; the first one also covers everything closer)
+    float depth = -(view * vec4(surface.position, 1.0)).z;
+    uint slice = uint(max(log(depth / clusterDepth.x) * clusterDepth.z, 0.0));
+    uvec3 cell = min(uvec3(uvec2(gl_FragCoord.xy / clusterTile.xy), slice), clusterGrid.xyz - 1u);
+    uint cluster = (cell.z * clusterGrid.y + cell.y) * clusterGrid.x + cell.x;
+
+    vec3 result = vec3(0.0);
+    uint count = clusterCounts[cluster];
+    for (uint i = 0u; i < count; ++i) {
+        PointLight light = lights[clusterLights[cluster * kMaxClusterLights + i]];
+
+        vec3 toLight = light.positionRadius.xyz - surface.position;
+        float distance2 = dot(toLight, toLight);
+        float radius2 = light.positionRadius.w * light.positionRadius.w;
+        if (distance2 >= radius2)
+            continue;
+
+        // Inverse square falloff, windowed to reach zero at the radius
+        float window = 1.0 - (distance2 / radius2) * (distance2 / radius2);
+        float attenuation = window * window / (distance2 + 1.0);
+
+        vec3 lightDir = toLight * inversesqrt(distance2);
+        float diff = max(dot(lightDir, surface.normal), 0.0);
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        float spec = pow(max(dot(surface.normal, halfwayDir), 0.0001), surface.shininess);
+
+        vec3 radiance = light.colorIntensity.rgb * light.colorIntensity.a * attenuation;
+        result += radiance * (diff * surface.diffuse + spec * surface.specular);
+    }
+    return result;
+}
+
+// Fraction of the main light that reaches the surface
+float main_light_visibility(Surface surface)
+{
+    if (0u == shadowCascades.x)
+        return 1.0;
+
+    // Cascade by view depth; beyond the last one, everything is lit
+    float depth = -(view * vec4(surface.position, 1.0)).z;
+    uint cascade = 0u;
+    while (cascade < shadowCascades.x && depth > shadowSplits[cascade])
+        ++cascade;
+    if (cascade == shadowCascades.x)
+        return 1.0;
+
+    // Looked up a little off the surface, against self-shadowing
+    vec3 position = surface.position + surface.normal * (1.5 * shadowTexel[cascade]);
+    vec3 coords = (shadowMatrices[cascade] * vec4(position, 1.0)).xyz;
+
+    // 3x3 filtered lookups, each of them 2x2 PCF
+    float texel = 1.0 / float(shadowCascades.y);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+    }
+    return lit / 9.0;
+}
+
+vec3 shade(Surface surface)
+{
     // diffuse
-    vec3 lightDir = normalize(light.position - fs_in.WorldPos);
-    vec3 normal = normalize(fs_in.Normal);
-    float diff = max(dot(lightDir, normal), 0.0001);
-    vec3 diffuse = light.color * diff * material.diffuse * color;
+    vec3 lightDir = normalize(light.position - surface.position);
+    float diff = max(dot(lightDir, surface.normal), 0.0001);
+    vec3 diffuse = light.color * diff * surface.diffuse;
 
     // specular
-    vec3 viewDir = normalize(viewPos - fs_in.WorldPos);
+    vec3 viewDir = normalize(viewPos.xyz - surface.position);
     float spec = 0.0;
 
     vec3 halfwayDir = normalize(lightDir + viewDir);
-    spec = pow(max(dot(normal, halfwayDir), 0.0001), material.shininess);
-    vec3 specular = spec * material.specular;
+    spec = pow(max(dot(surface.normal, halfwayDir), 0.0001), surface.shininess);
+    vec3 specular = spec * surface.specular;
+
+    vec3 result = surface.unlit + (diffuse + specular) * light.intensity * main_light_visibility(surface);
+    if (0u != clusterGrid.w)
+        result += clustered_lights(surface, viewDir);
+    return result;
+}
+
+// Octahedral normal encoding: the unit sphere is projected onto the
+// octahedron |x| + |y| + |z| = 1, whose lower half is folded over the upper
+// one, giving a square in [-1, 1]^2.
+vec2 sign_not_zero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 encode_normal(vec3 n)
+{
+    vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+    return n.z >= 0.0 ? p : (1.0 - abs(p.yx)) * sign_not_zero(p);
+}
+
+vec3 decode_normal(vec2 p)
+{
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * sign_not_zero(n.xy);
+    return normalize(n);
+}
+
+void main()
+{
+    Surface surface;
+#ifdef DEFERRED_LIGHTING
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gbufferDepth, texel, 0).r;
+    if (depth >= 1.0)
+        discard; // background
+
+    // View-space position from the depth, with the terms of the perspective
+    // projection; the view matrix is rigid, so it is inverted by transposing
+    // its rotation.
+    vec2 ndc = gl_FragCoord.xy / vec2(textureSize(gbufferDepth, 0)) * 2.0 - 1.0;
+    float z = -projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+    vec3 viewSpace = vec3(-z * ndc.x / projection[0][0], -z * ndc.y / projection[1][1], z);
+    surface.position = transpose(mat3(view)) * (viewSpace - view[3].xyz);
+
+    vec4 specular = texelFetch(gbufferSpecular, texel, 0);
+    surface.normal = decode_normal(texelFetch(gbufferNormal, texel, 0).rg);
+    surface.diffuse = texelFetch(gbufferDiffuse, texel, 0).rgb;
+    surface.specular = specular.rgb;
+    surface.shininess = specular.a * 255.0;
+    surface.unlit = texelFetch(gbufferUnlit, texel, 0).rgb;
+#else
+#ifdef INDIRECT_MATERIALS
+    Material material = materials[fs_in.Material];
+    vec3 color = texture(texture_layers, vec3(fs_in.TexCoords, float(fs_in.Layer))).rgb;
+#else
+    vec3 color = texture(texture_diffuse, fs_in.TexCoords).rgb;
+#endif
+    surface.position = fs_in.WorldPos;
+    surface.normal = normalize(fs_in.Normal);
+    surface.diffuse = material.diffuse * color;
+    surface.specular = material.specular;
+    surface.shininess = material.shininess;
+    // ambient
+    surface.unlit = material.emission + 0.5 * color * material.ambient;
+#endif
 
-    vec3 result = material.emission + ambient + (diffuse + specular) * light.intensity;
-    FragColor = vec4(result, 1.0);
-} 
+#ifdef GBUFFER
+    GBufferDiffuse = vec4(surface.diffuse, 1.0);
+    GBufferSpecular = vec4(surface.specular, surface.shininess / 255.0);
+    GBufferNormal = encode_normal(surface.normal);
+    GBufferUnlit = surface.unlit;
+#else
+    FragColor = vec4(shade(surface), 1.0);
+#endif
+}
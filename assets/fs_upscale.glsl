@@ -0,0 +1,32 @@
+#version 430
+
+// Upscale of the scene for dynamic resolution (see DynamicResolution.h),
+// drawn with vs_fullscreen.glsl: a bilinear lookup, sharpened with the
+// difference to its four neighbours. The sharpening is contrast adaptive:
+// it is reduced where the neighbourhood already spans a large part of the
+// range, so that edges don't ring or clip.
+
+out vec4 FragColor;
+
+layout (binding = 0) uniform sampler2D source;
+uniform vec2 sourceTexel;   // size of a source texel in texture coordinates
+uniform vec2 outputTexel;   // size of an output pixel, likewise
+uniform float sharpness;    // 0 to 1
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy * outputTexel;
+
+    vec3 c = texture(source, uv).rgb;
+    vec3 n = texture(source, uv + vec2(0.0, sourceTexel.y)).rgb;
+    vec3 s = texture(source, uv - vec2(0.0, sourceTexel.y)).rgb;
+    vec3 e = texture(source, uv + vec2(sourceTexel.x, 0.0)).rgb;
+    vec3 w = texture(source, uv - vec2(sourceTexel.x, 0.0)).rgb;
+
+    vec3 low = min(c, min(min(n, s), min(e, w)));
+    vec3 high = max(c, max(max(n, s), max(e, w)));
+    vec3 amount = sharpness * sqrt(clamp(min(low, 1.0 - high) / max(high, 1e-4), 0.0, 1.0));
+
+    vec3 result = c + (4.0 * c - (n + s + e + w)) * 0.25 * amount;
+    FragColor = vec4(clamp(result, 0.0, 1.0), 1.0);
+}
@@ -0,0 +1,15 @@
+#version 430
+
+// Bounding box proxy for occlusion queries: aPos is a corner of the unit
+// cube, stretched to the box.
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 viewProjection;
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+void main()
+{
+    gl_Position = viewProjection * vec4(mix(boxMin, boxMax, aPos), 1.0);
+    gl_Position.z -= 1e-4 * gl_Position.w;
+}
@@ -0,0 +1,42 @@
+#version 430
+
+// Depth-only passes (see DepthPrepass.h): positions from the geometry
+// arena's position stream, no fragment shader.
+
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in uint aInstance;
+
+// Must match vs_phong.glsl exactly, so that the shading pass finds the same
+// depths with GL_EQUAL.
+invariant gl_Position;
+
+// Matches InstanceData in Render.h
+struct Instance {
+    mat4 model;
+    uint material;
+    uint layer;
+};
+
+layout (std430, binding = 0, row_major) readonly buffer Instances {
+    Instance instances[];
+};
+
+// Matches FrameUniforms in Render.h
+layout (std140, binding = 0, row_major) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+    vec4 clusterDepth;
+    vec4 clusterTile;
+    uvec4 clusterGrid;
+    mat4 shadowMatrices[4];
+    vec4 shadowSplits;
+    vec4 shadowTexel;
+    uvec4 shadowCascades;
+};
+
+void main()
+{
+    mat4 model = instances[aInstance].model;
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
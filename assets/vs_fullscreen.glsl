@@ -0,0 +1,10 @@
+#version 430
+
+// A single triangle that covers the viewport, for fullscreen passes. Draw
+// three vertices with no attributes bound.
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
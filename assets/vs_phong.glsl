@@ -3,23 +3,56 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// index of this instance's record in the instance buffer (base instance +
+// instance id; see kInstanceIndexAttrib in Render.h)
+layout (location = 3) in uint aInstance;
 
 // declare an interface block; see 'Advanced GLSL' for what these are.
 out VS_OUT {
     vec3 WorldPos;
     vec3 Normal;
     vec2 TexCoords;
+    flat uint Material;
+    flat uint Layer;
 } vs_out;
 
-uniform mat4 model;
-uniform mat4 projection;
-uniform mat4 view;
+// The depth prepass (vs_depth.glsl) must compute the same depths
+invariant gl_Position;
+
+// Matches InstanceData in Render.h. Mat44f is row-major, so the matrices are
+// uploaded as they are.
+struct Instance {
+    mat4 model;
+    uint material;
+    uint layer;
+};
+
+layout (std430, binding = 0, row_major) readonly buffer Instances {
+    Instance instances[];
+};
+
+// Matches FrameUniforms in Render.h
+layout (std140, binding = 0, row_major) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+    vec4 clusterDepth;
+    vec4 clusterTile;
+    uvec4 clusterGrid;
+    mat4 shadowMatrices[4];
+    vec4 shadowSplits;
+    vec4 shadowTexel;
+    uvec4 shadowCascades;
+};
 
 void main()
 {
+    mat4 model = instances[aInstance].model;
     mat3 normalMatrix = transpose(inverse(mat3(model)));
     vs_out.WorldPos = (model * vec4(aPos, 1.0)).xyz;
     vs_out.Normal = normalMatrix * aNormal;
     vs_out.TexCoords = aTexCoords;
+    vs_out.Material = instances[aInstance].material;
+    vs_out.Layer = instances[aInstance].layer;
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
@@ -0,0 +1,275 @@
+#include "Benchmark.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../support/error.hpp"
+
+namespace {
+	enum Query { kBeginQuery, kEndQuery, kPrimitivesQuery, kQueryCount };
+
+	struct Percentiles {
+		double mean = 0.0, p50 = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+	};
+
+	// Nearest rank
+	Percentiles percentiles(std::vector<double> values) {
+		Percentiles result;
+		if (values.empty())
+			return result;
+
+		std::sort(values.begin(), values.end());
+		auto const rank = [&values](double p) {
+			std::size_t const index = std::size_t(std::ceil(p * double(values.size())));
+			return values[std::max<std::size_t>(index, 1) - 1];
+		};
+		double sum = 0.0;
+		for (double value : values)
+			sum += value;
+
+		result.mean = sum / double(values.size());
+		result.p50 = rank(0.50);
+		result.p95 = rank(0.95);
+		result.p99 = rank(0.99);
+		result.max = values.back();
+		return result;
+	}
+
+	void write_string(std::FILE* file, const char* text) {
+		std::fputc('"', file);
+		for (; *text; ++text) {
+			if ('"' == *text || '\\' == *text)
+				std::fputc('\\', file);
+			if (std::uint8_t(*text) >= 0x20)
+				std::fputc(*text, file);
+		}
+		std::fputc('"', file);
+	}
+
+	template< typename tField >
+	void write_measure(std::FILE* file, const char* name, std::vector<BenchmarkSample> const& samples, tField const& field) {
+		std::vector<double> values;
+		values.reserve(samples.size());
+		for (auto const& sample : samples)
+			values.push_back(double(field(sample)));
+
+		Percentiles const result = percentiles(std::move(values));
+		std::fprintf(file, "\t\"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+			name, result.mean, result.p50, result.p95, result.p99, result.max);
+	}
+
+	// Compared by compare_benchmarks(); max is shown, but too noisy to gate on
+	const char* const kMeasures[] = { "frameMs", "cpuMs", "gpuMs", "drawCalls", "triangles" };
+	const char* const kStats[] = { "p50", "p95", "p99", "max" };
+	constexpr int kGatedStats = 3;
+
+	std::string read_file(const char* path) {
+		std::FILE* file = std::fopen(path, "rb");
+		if (!file)
+			throw Error("Benchmark: unable to open '%s'", path);
+
+		std::string text;
+		char buffer[4096];
+		std::size_t read;
+		while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+			text.append(buffer, read);
+		std::fclose(file);
+		return text;
+	}
+
+	// Finds "measure": { ... "stat": value ... } in a file written by
+	// Benchmark::write_(). Measures are top-level members, one per line
+	// (write_measure()), so the key is only matched at the start of a line
+	// with one tab: neither the label, which is a string that may well hold
+	// the key, nor the GPU zones, one level deeper, can be mistaken for it.
+	double find_stat(std::string const& text, const char* path, const char* measure, const char* stat) {
+		std::string const key = std::string("\t\"") + measure + "\":";
+		std::size_t begin = 0;
+		while (begin < text.size() && 0 != text.compare(begin, key.size(), key)) {
+			std::size_t const next = text.find('\n', begin);
+			begin = std::string::npos == next ? text.size() : next + 1;
+		}
+		if (begin >= text.size())
+			throw Error("Benchmark: '%s' has no \"%s\"", path, measure);
+		std::size_t const end = std::min(text.find('\n', begin), text.size());
+
+		std::string const statKey = std::string("\"") + stat + "\":";
+		std::size_t const at = text.find(statKey, begin + key.size());
+		if (std::string::npos == at || at > end)
+			throw Error("Benchmark: '%s' has no \"%s\" for \"%s\"", path, stat, measure);
+		return std::strtod(text.c_str() + at + statKey.size(), nullptr);
+	}
+}
+
+void Benchmark::Configure(const BenchmarkSettings& settings_) {
+	if (!settings_.enabled) {
+		settings = settings_;
+		return;
+	}
+	if (0 == settings_.frames)
+		throw Error("Benchmark: at least one frame must be measured");
+
+	path = settings_.cameraPath.empty() ? CameraPath::Scripted() : CameraPath::Load(settings_.cameraPath.c_str());
+	settings = settings_;
+	samples.reserve(settings.frames);
+}
+
+double Benchmark::Time() const {
+	unsigned int const frame = frameIndex < settings.warmupFrames ? frameIndex : frameIndex - settings.warmupFrames;
+	double const time = double(frame) * kFrameStep;
+	double const duration = path.Duration();
+	return duration > 0.0 ? std::fmod(time, duration) : 0.0;
+}
+
+void Benchmark::BeginFrame() {
+	double const now = glfwGetTime();
+	if (pendingSample >= 0) {
+		samples[pendingSample].frameMs = float(1000. * (now - frameStart));
+		pendingSample = -1;
+	}
+	frameStart = now;
+
+	Frame& frame = frames[frameIndex % kLatency];
+	if (0 == frame.queries[0]) {
+		for (auto& f : frames)
+			glGenQueries(kQueryCount, f.queries);
+	}
+	read_results_(frame);
+
+	glQueryCounter(frame.queries[kBeginQuery], GL_TIMESTAMP);
+	glBeginQuery(GL_PRIMITIVES_GENERATED, frame.queries[kPrimitivesQuery]);
+}
+
+void Benchmark::EndFrame(unsigned int drawCalls) {
+	Frame& frame = frames[frameIndex % kLatency];
+	glEndQuery(GL_PRIMITIVES_GENERATED);
+	glQueryCounter(frame.queries[kEndQuery], GL_TIMESTAMP);
+
+	if (frameIndex >= settings.warmupFrames) {
+		BenchmarkSample sample;
+		sample.cpuMs = float(1000. * (glfwGetTime() - frameStart));
+		sample.drawCalls = drawCalls;
+		frame.sample = pendingSample = int(samples.size());
+		samples.push_back(sample);
+	}
+	++frameIndex;
+}
+
+void Benchmark::AddGpuZones(const GpuProfileFrame& frame) {
+	if (frame.frame < settings.warmupFrames || frame.frame >= settings.warmupFrames + settings.frames)
+		return;
+
+	for (int i = 0; i < int(frame.zones.size()); ++i) {
+		std::string const path = frame.Path(i);
+		auto zone = std::find_if(zoneMs.begin(), zoneMs.end(), [&path](auto const& entry) { return entry.first == path; });
+		if (zoneMs.end() == zone) {
+			zoneMs.emplace_back(path, std::vector<double>{});
+			zone = zoneMs.end() - 1;
+		}
+		zone->second.push_back(double(frame.zones[i].ms));
+	}
+}
+
+void Benchmark::Finish(const char* renderer) {
+	if (pendingSample >= 0) {
+		samples[pendingSample].frameMs = float(1000. * (glfwGetTime() - frameStart));
+		pendingSample = -1;
+	}
+	for (auto& frame : frames)
+		read_results_(frame);
+
+	write_(renderer);
+}
+
+void Benchmark::Release() {
+	for (auto& frame : frames) {
+		if (0 != frame.queries[0])
+			glDeleteQueries(kQueryCount, frame.queries);
+		frame = Frame{};
+	}
+}
+
+void Benchmark::read_results_(Frame& frame) {
+	if (frame.sample < 0)
+		return;
+
+	// Waits, if the GPU is over kLatency frames behind
+	GLuint64 begin = 0, end = 0, primitives = 0;
+	glGetQueryObjectui64v(frame.queries[kBeginQuery], GL_QUERY_RESULT, &begin);
+	glGetQueryObjectui64v(frame.queries[kEndQuery], GL_QUERY_RESULT, &end);
+	glGetQueryObjectui64v(frame.queries[kPrimitivesQuery], GL_QUERY_RESULT, &primitives);
+
+	BenchmarkSample& sample = samples[frame.sample];
+	sample.gpuMs = float(double(end - begin) * 1e-6);
+	sample.triangles = primitives;
+	frame.sample = -1;
+}
+
+void Benchmark::write_(const char* renderer) const {
+	std::FILE* file = std::fopen(settings.output.c_str(), "w");
+	if (!file)
+		throw Error("Benchmark: unable to create '%s'", settings.output.c_str());
+
+	std::fprintf(file, "{\n\t\"label\": ");
+	write_string(file, settings.label.c_str());
+	std::fprintf(file, ",\n\t\"renderer\": ");
+	write_string(file, renderer ? renderer : "");
+	std::fprintf(file, ",\n\t\"cameraPath\": ");
+	write_string(file, settings.cameraPath.empty() ? "scripted" : settings.cameraPath.c_str());
+	std::fprintf(file, ",\n\t\"warmupFrames\": %u,\n\t\"frames\": %zu,\n\t\"frameStepMs\": %.4f,\n",
+		settings.warmupFrames, samples.size(), 1000. * kFrameStep);
+
+	write_measure(file, "frameMs", samples, [](BenchmarkSample const& s) { return s.frameMs; });
+	write_measure(file, "cpuMs", samples, [](BenchmarkSample const& s) { return s.cpuMs; });
+	write_measure(file, "gpuMs", samples, [](BenchmarkSample const& s) { return s.gpuMs; });
+	write_measure(file, "drawCalls", samples, [](BenchmarkSample const& s) { return s.drawCalls; });
+	write_measure(file, "triangles", samples, [](BenchmarkSample const& s) { return s.triangles; });
+
+	// Zones that only ran in some frames have fewer samples
+	std::fprintf(file, "\t\"gpuZones\": {\n");
+	for (std::size_t i = 0; i < zoneMs.size(); ++i) {
+		Percentiles const result = percentiles(zoneMs[i].second);
+		std::fprintf(file, "\t\t");
+		write_string(file, zoneMs[i].first.c_str());
+		std::fprintf(file, ": { \"frames\": %zu, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+			zoneMs[i].second.size(), result.mean, result.p50, result.p95, result.p99, result.max, i + 1 < zoneMs.size() ? "," : "");
+	}
+	std::fprintf(file, "\t}\n}\n");
+
+	bool const failed = 0 != std::ferror(file);
+	std::fclose(file);
+	if (failed)
+		throw Error("Benchmark: unable to write '%s'", settings.output.c_str());
+}
+
+int compare_benchmarks(const char* basePath, const char* newPath, float tolerancePercent) {
+	std::string const base = read_file(basePath);
+	std::string const current = read_file(newPath);
+
+	std::printf("%-10s %-4s %14s %14s %9s\n", "measure", "", "base", "new", "change");
+
+	int regressions = 0;
+	for (const char* measure : kMeasures) {
+		for (int i = 0; i < int(sizeof(kStats) / sizeof(kStats[0])); ++i) {
+			double const before = find_stat(base, basePath, measure, kStats[i]);
+			double const after = find_stat(current, newPath, measure, kStats[i]);
+			double const change = before > 0.0 ? 100. * (after - before) / before : (after > 0.0 ? 100. : 0.);
+
+			// Lower is better, for all measures
+			bool const regressed = i < kGatedStats && change > double(tolerancePercent);
+			regressions += regressed ? 1 : 0;
+
+			std::printf("%-10s %-4s %14.3f %14.3f %+8.1f%%%s\n", measure, kStats[i], before, after, change,
+				regressed ? "  REGRESSION" : "");
+		}
+	}
+
+	std::printf("%d regressions over %.1f%%\n", regressions, tolerancePercent);
+	return regressions;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glad.h>
+
+#include "CameraPath.h"
+#include "GpuProfiler.h"
+
+struct BenchmarkSettings {
+    bool enabled = false;
+    std::string cameraPath;         // file; empty for CameraPath::Scripted()
+    unsigned int warmupFrames = 120;
+    unsigned int frames = 1000;     // measured, after the warm-up
+    std::string output = "benchmark.json";
+    std::string label;              // stored in the output, e.g. the options used
+};
+
+struct BenchmarkSample {
+    float frameMs = 0.f;            // wall clock, from this frame's start to the next
+    float cpuMs = 0.f;              // GL thread, from the frame's start to its swap
+    float gpuMs = 0.f;              // all of the frame's commands
+    unsigned int drawCalls = 0;     // scene draws, as counted by the draw path
+    GLuint64 triangles = 0;         // GL_PRIMITIVES_GENERATED, all passes
+};
+
+
+// Benchmark mode: replays a camera path at a fixed step of kFrameStep per
+// frame (whatever the frame rate, so that every run draws the same frames),
+// warms up for a number of frames, then measures each frame, and writes
+// the p50/p95/p99/max of each measure to a JSON file when done.
+//
+// GPU times come from timestamp queries (see GpuTimer) and triangle counts
+// from GL_PRIMITIVES_GENERATED queries around the whole frame. Each
+// frame's results are read back kLatency frames later, waiting only if the
+// GPU is further behind than that, so that every measured frame has them.
+// The zones of a GpuProfiler, passed to AddGpuZones(), get the same
+// percentiles, per zone path.
+//
+// compare_benchmarks() compares two such files, for gating changes on them.
+//
+// Usage:
+//    benchmark.BeginFrame();
+//    Camera camera = benchmark.FrameCamera();  // at Time()
+//    ... draw ...
+//    benchmark.EndFrame( drawCalls );          // before the swap
+//    ... swap ...
+//    if( benchmark.Done() ) benchmark.Finish( renderer );
+class Benchmark {
+public:
+    static constexpr double kFrameStep = 1.0 / 60.0;
+    static constexpr int kLatency = 4;
+
+    // Loads the camera path.
+    void Configure(const BenchmarkSettings& settings_);
+
+    void BeginFrame();
+    void EndFrame(unsigned int drawCalls);
+    // Profiled frames outside the measured ones are ignored.
+    void AddGpuZones(const GpuProfileFrame& frame);
+    // After the last frame's swap: waits for the frames still in flight,
+    // and writes the results.
+    void Finish(const char* renderer);
+    void Release();
+
+    bool Enabled() const { return settings.enabled; }
+    bool Done() const { return frameIndex >= settings.warmupFrames + settings.frames; }
+    // Time along the path of the frame. Restarts from 0 after the warm-up,
+    // and wraps around the path.
+    double Time() const;
+    Camera FrameCamera() const { return CameraPath::ToCamera(path.Sample(Time())); }
+
+    const BenchmarkSettings& Settings() const { return settings; }
+    const std::vector<BenchmarkSample>& Samples() const { return samples; }
+
+private:
+    struct Frame {
+        GLuint queries[3] = {};     // begin, end timestamps; primitives
+        int sample = -1;            // results go there, if measured
+    };
+
+    void read_results_(Frame& frame);
+    void write_(const char* renderer) const;
+
+    BenchmarkSettings settings;
+    CameraPath path;
+
+    Frame frames[kLatency];
+    unsigned int frameIndex = 0;
+    double frameStart = -1.0;
+    int pendingSample = -1;         // frameMs completed by the next BeginFrame()
+
+    std::vector<BenchmarkSample> samples;
+    // Per zone path, in the order first seen
+    std::vector<std::pair<std::string, std::vector<double>>> zoneMs;
+};
+
+// Compares two benchmark results (as written by Benchmark): prints each
+// measure's percentiles side by side, and flags those of the new run that
+// are worse than the base's by more than tolerancePercent. Returns the
+// number of regressions. Needs no GL context.
+int compare_benchmarks(const char* basePath, const char* newPath, float tolerancePercent);
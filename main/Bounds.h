@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/vec4.hpp"
+#include "../vmlib/mat44.hpp"
+
+// Axis-aligned bounding box. An empty box has min > max.
+struct AABB {
+    Vec3f min{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    Vec3f max{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+
+    bool Empty() const { return min.x > max.x; }
+    Vec3f Center() const { return (min + max) * 0.5f; }
+    Vec3f Extents() const { return (max - min) * 0.5f; }
+
+    void Expand(Vec3f p) {
+        min = Vec3f{ std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z) };
+        max = Vec3f{ std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z) };
+    }
+    void Expand(const AABB& box) {
+        if (box.Empty())
+            return;
+        Expand(box.min);
+        Expand(box.max);
+    }
+
+    float SurfaceArea() const {
+        if (Empty())
+            return 0.f;
+        Vec3f const d = max - min;
+        return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+};
+
+// Bounds of box after transforming it by m (which must be affine).
+// Uses the "absolute matrix" trick, so the result tightly encloses the
+// transformed box.
+inline AABB transform_aabb(const Mat44f& m, const AABB& box) {
+    if (box.Empty())
+        return box;
+
+    Vec3f const c = box.Center();
+    Vec3f const e = box.Extents();
+
+    Vec3f wc, we;
+    for (int i = 0; i < 3; ++i) {
+        (&wc.x)[i] = m(i, 0) * c.x + m(i, 1) * c.y + m(i, 2) * c.z + m(i, 3);
+        (&we.x)[i] = std::abs(m(i, 0)) * e.x + std::abs(m(i, 1)) * e.y + std::abs(m(i, 2)) * e.z;
+    }
+
+    AABB result;
+    result.min = wc - we;
+    result.max = wc + we;
+    return result;
+}
+
+
+// View frustum as six planes (a,b,c,d), with dot(n, p) + d >= 0 for points
+// inside. The planes are not normalized.
+struct Frustum {
+    Vec4f planes[6];
+};
+
+// Extracts the frustum planes from a (row-major) projection * view matrix
+// (Gribb & Hartmann).
+inline Frustum make_frustum(const Mat44f& viewProjection) {
+    auto row = [&](int i) {
+        return Vec4f{ viewProjection(i, 0), viewProjection(i, 1), viewProjection(i, 2), viewProjection(i, 3) };
+    };
+
+    Vec4f const r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+
+    Frustum f;
+    f.planes[0] = r3 + r0; // left
+    f.planes[1] = r3 - r0; // right
+    f.planes[2] = r3 + r1; // bottom
+    f.planes[3] = r3 - r1; // top
+    f.planes[4] = r3 + r2; // near
+    f.planes[5] = r3 - r2; // far
+    return f;
+}
+
+// Conservative test: false only if the box is fully outside one of the planes.
+inline bool intersects(const Frustum& f, const AABB& box) {
+    Vec3f const c = box.Center();
+    Vec3f const e = box.Extents();
+    for (auto const& p : f.planes) {
+        float const d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+        float const r = std::abs(p.x) * e.x + std::abs(p.y) * e.y + std::abs(p.z) * e.z;
+        if (d < -r)
+            return false;
+    }
+    return true;
+}
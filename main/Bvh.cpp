@@ -0,0 +1,399 @@
+#include "Bvh.h"
+
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	float elapsed_ms(Clock::time_point since) {
+		return std::chrono::duration<float, std::milli>(Clock::now() - since).count();
+	}
+
+	bool same_box(const AABB& a, const AABB& b) {
+		return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z
+			&& a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+	}
+
+	bool overlaps(const AABB& a, const AABB& b) {
+		return a.min.x <= b.max.x && a.max.x >= b.min.x
+			&& a.min.y <= b.max.y && a.max.y >= b.min.y
+			&& a.min.z <= b.max.z && a.max.z >= b.min.z;
+	}
+
+	// Distance along the ray at which it enters the box, or +inf if it misses.
+	float ray_box(Vec3f origin, Vec3f invDirection, float maxDistance, const AABB& box) {
+		float tmin = 0.f, tmax = maxDistance;
+		for (int i = 0; i < 3; ++i) {
+			float t0 = (box.min[i] - origin[i]) * invDirection[i];
+			float t1 = (box.max[i] - origin[i]) * invDirection[i];
+			if (t0 > t1)
+				std::swap(t0, t1);
+			// max/min ordered so that NaNs (0 * inf) are ignored
+			tmin = t0 > tmin ? t0 : tmin;
+			tmax = t1 < tmax ? t1 : tmax;
+		}
+		return tmin <= tmax ? tmin : std::numeric_limits<float>::infinity();
+	}
+
+	constexpr std::uint32_t kAllPlanes = 0x3f;
+}
+
+void SceneBvh::Build(const std::vector<AABB>& boxes) {
+	auto const start = Clock::now();
+
+	std::uint32_t const count = static_cast<std::uint32_t>(boxes.size());
+	objectBoxes = boxes;
+	objectIndices.resize(count);
+	std::iota(objectIndices.begin(), objectIndices.end(), 0u);
+	objectLeaves.assign(count, 0);
+	dirtyLeaves.clear();
+
+	centroids.resize(count);
+	for (std::uint32_t i = 0; i < count; ++i)
+		centroids[i] = boxes[i].Empty() ? Vec3f{ 0.f, 0.f, 0.f } : boxes[i].Center();
+
+	nodes.clear();
+	parents.clear();
+	nodes.reserve(std::max<std::size_t>(1, 2 * std::size_t(count) / kMaxLeafObjects + 1));
+	parents.reserve(nodes.capacity());
+
+	BvhNode root;
+	root.objectCount = count;
+	nodes.push_back(root);
+	parents.push_back(0);
+
+	stats = BvhStats{};
+
+	struct Entry { std::uint32_t node, depth; };
+	std::vector<Entry> stack{ { 0, 1 } };
+	while (!stack.empty()) {
+		Entry const entry = stack.back();
+		stack.pop_back();
+		stats.depth = std::max(stats.depth, entry.depth);
+
+		BvhNode& node = nodes[entry.node];
+		for (std::uint32_t i = 0; i < node.objectCount; ++i)
+			node.bounds.Expand(objectBoxes[objectIndices[node.objectFirst + i]]);
+
+		std::uint32_t const leftCount = node.objectCount > kMaxLeafObjects ? split_(entry.node) : 0;
+		if (0 == leftCount) {
+			for (std::uint32_t i = 0; i < node.objectCount; ++i)
+				objectLeaves[objectIndices[node.objectFirst + i]] = entry.node;
+			++stats.leaves;
+			continue;
+		}
+
+		BvhNode left, right;
+		left.objectFirst = node.objectFirst;
+		left.objectCount = leftCount;
+		right.objectFirst = node.objectFirst + leftCount;
+		right.objectCount = node.objectCount - leftCount;
+
+		std::uint32_t const first = static_cast<std::uint32_t>(nodes.size());
+		node.left = first; // before push_back() invalidates node
+		nodes.push_back(left);
+		nodes.push_back(right);
+		parents.push_back(entry.node);
+		parents.push_back(entry.node);
+
+		stack.push_back({ first + 1, entry.depth + 1 });
+		stack.push_back({ first, entry.depth + 1 });
+	}
+
+	leafDirty.assign(nodes.size(), false);
+	centroids.clear();
+
+	stats.objects = count;
+	stats.nodes = static_cast<unsigned int>(nodes.size());
+	stats.buildMs = elapsed_ms(start);
+}
+
+std::uint32_t SceneBvh::split_(std::uint32_t index) {
+	BvhNode const& node = nodes[index];
+	std::uint32_t* const objects = objectIndices.data() + node.objectFirst;
+	std::uint32_t const count = node.objectCount;
+
+	AABB centroidBounds;
+	for (std::uint32_t i = 0; i < count; ++i)
+		centroidBounds.Expand(centroids[objects[i]]);
+
+	// Binned SAH: the cost of a split is SA(left) * N(left) + SA(right) * N(right),
+	// evaluated at the kBins - 1 bin boundaries along each axis.
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1, bestBin = 0;
+
+	for (int axis = 0; axis < 3; ++axis) {
+		float const lo = centroidBounds.min[axis];
+		float const hi = centroidBounds.max[axis];
+		if (!(hi > lo))
+			continue;
+
+		AABB binBounds[kBins];
+		std::uint32_t binCounts[kBins] = {};
+		float const scale = kBins / (hi - lo);
+		for (std::uint32_t i = 0; i < count; ++i) {
+			int const bin = std::min(kBins - 1, int((centroids[objects[i]][axis] - lo) * scale));
+			binBounds[bin].Expand(objectBoxes[objects[i]]);
+			++binCounts[bin];
+		}
+
+		// Sweep from the right to get the right-hand costs, then from the left.
+		float rightArea[kBins];
+		std::uint32_t rightCount[kBins];
+		AABB accum;
+		std::uint32_t accumCount = 0;
+		for (int bin = kBins - 1; bin > 0; --bin) {
+			accum.Expand(binBounds[bin]);
+			accumCount += binCounts[bin];
+			rightArea[bin] = accum.SurfaceArea();
+			rightCount[bin] = accumCount;
+		}
+
+		accum = AABB{};
+		accumCount = 0;
+		for (int bin = 0; bin < kBins - 1; ++bin) {
+			accum.Expand(binBounds[bin]);
+			accumCount += binCounts[bin];
+			if (0 == accumCount || 0 == rightCount[bin + 1])
+				continue;
+
+			float const cost = accum.SurfaceArea() * accumCount + rightArea[bin + 1] * rightCount[bin + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = bin;
+			}
+		}
+	}
+
+	if (bestAxis < 0) {
+		// All centroids coincide: split the range in half.
+		return count / 2;
+	}
+
+	// Splitting must be cheaper than testing all objects of a leaf (assuming
+	// traversal costs about as much as a box test). Leaves are kept small
+	// regardless, so only small nodes may stop early.
+	float const leafCost = node.bounds.SurfaceArea() * count;
+	if (count <= 2 * kMaxLeafObjects && bestCost + node.bounds.SurfaceArea() >= leafCost)
+		return 0;
+
+	float const lo = centroidBounds.min[bestAxis];
+	float const scale = kBins / (centroidBounds.max[bestAxis] - lo);
+	std::uint32_t* const middle = std::partition(objects, objects + count, [&](std::uint32_t object) {
+		return std::min(kBins - 1, int((centroids[object][bestAxis] - lo) * scale)) <= bestBin;
+	});
+
+	return static_cast<std::uint32_t>(middle - objects);
+}
+
+void SceneBvh::Update(std::uint32_t object, const AABB& box) {
+	objectBoxes[object] = box;
+
+	std::uint32_t const leaf = objectLeaves[object];
+	if (!leafDirty[leaf]) {
+		leafDirty[leaf] = true;
+		dirtyLeaves.push_back(leaf);
+	}
+}
+
+void SceneBvh::Refit() {
+	auto const start = Clock::now();
+	stats.refittedLeaves = static_cast<unsigned int>(dirtyLeaves.size());
+
+	if (dirtyLeaves.size() > nodes.size() / 8) {
+		// Most of the tree changed; a single bottom-up pass is cheaper than
+		// walking up from every leaf. Children always follow their parent.
+		for (std::size_t i = nodes.size(); i-- > 0; ) {
+			if (nodes[i].Leaf())
+				refit_leaf_(static_cast<std::uint32_t>(i));
+			else
+				refit_interior_(static_cast<std::uint32_t>(i));
+		}
+	}
+	else {
+		for (std::uint32_t leaf : dirtyLeaves) {
+			AABB const before = nodes[leaf].bounds;
+			refit_leaf_(leaf);
+			if (same_box(before, nodes[leaf].bounds))
+				continue;
+
+			// Ancestors only depend on their children, so stop as soon as
+			// one of them doesn't change.
+			for (std::uint32_t node = leaf; 0 != node; ) {
+				node = parents[node];
+				if (!refit_interior_(node))
+					break;
+			}
+		}
+	}
+
+	for (std::uint32_t leaf : dirtyLeaves)
+		leafDirty[leaf] = false;
+	dirtyLeaves.clear();
+
+	stats.refitMs = elapsed_ms(start);
+}
+
+void SceneBvh::refit_leaf_(std::uint32_t index) {
+	BvhNode& node = nodes[index];
+	node.bounds = AABB{};
+	for (std::uint32_t i = 0; i < node.objectCount; ++i)
+		node.bounds.Expand(objectBoxes[objectIndices[node.objectFirst + i]]);
+}
+
+bool SceneBvh::refit_interior_(std::uint32_t index) {
+	BvhNode& node = nodes[index];
+
+	AABB bounds = nodes[node.left].bounds;
+	bounds.Expand(nodes[node.left + 1].bounds);
+
+	if (same_box(bounds, node.bounds))
+		return false;
+	node.bounds = bounds;
+	return true;
+}
+
+void SceneBvh::Cull(const Frustum& frustum, std::vector<std::uint32_t>& visible) {
+	auto const start = Clock::now();
+	std::size_t const before = visible.size();
+	stats.nodesVisited = 0;
+
+	// Planes that a node is entirely inside of are dropped for its subtree;
+	// once none are left, the whole subtree is visible without more tests.
+	auto classify = [&](const AABB& box, std::uint32_t& mask) {
+		Vec3f const c = box.Center();
+		Vec3f const e = box.Extents();
+		for (int i = 0; i < 6; ++i) {
+			if (0 == (mask & (1u << i)))
+				continue;
+
+			Vec4f const& p = frustum.planes[i];
+			float const d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+			float const r = std::abs(p.x) * e.x + std::abs(p.y) * e.y + std::abs(p.z) * e.z;
+			if (d < -r)
+				return false;
+			if (d >= r)
+				mask &= ~(1u << i);
+		}
+		return true;
+	};
+
+	struct Entry { std::uint32_t node, mask; };
+	std::vector<Entry> stack;
+	if (!objectBoxes.empty())
+		stack.push_back({ 0, kAllPlanes });
+
+	while (!stack.empty()) {
+		Entry entry = stack.back();
+		stack.pop_back();
+		++stats.nodesVisited;
+
+		BvhNode const& node = nodes[entry.node];
+		if (!classify(node.bounds, entry.mask))
+			continue;
+
+		if (0 == entry.mask) {
+			visible.insert(visible.end(),
+				objectIndices.begin() + node.objectFirst,
+				objectIndices.begin() + node.objectFirst + node.objectCount
+			);
+			continue;
+		}
+
+		if (node.Leaf()) {
+			for (std::uint32_t i = 0; i < node.objectCount; ++i) {
+				std::uint32_t const object = objectIndices[node.objectFirst + i];
+				std::uint32_t mask = entry.mask;
+				if (!objectBoxes[object].Empty() && classify(objectBoxes[object], mask))
+					visible.push_back(object);
+			}
+			continue;
+		}
+
+		stack.push_back({ node.left + 1, entry.mask });
+		stack.push_back({ node.left, entry.mask });
+	}
+
+	stats.visible = static_cast<unsigned int>(visible.size() - before);
+	stats.culled = static_cast<unsigned int>(objectBoxes.size()) - stats.visible;
+	stats.cullMs = elapsed_ms(start);
+}
+
+bool SceneBvh::Raycast(Vec3f origin, Vec3f direction, float maxDistance, BvhHit& hit) const {
+	if (objectBoxes.empty())
+		return false;
+
+	Vec3f const invDirection{ 1.f / direction.x, 1.f / direction.y, 1.f / direction.z };
+	float best = maxDistance;
+	bool found = false;
+
+	if (std::isinf(ray_box(origin, invDirection, best, nodes[0].bounds)))
+		return false;
+
+	std::vector<std::uint32_t> stack{ 0 };
+	while (!stack.empty()) {
+		BvhNode const& node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (node.Leaf()) {
+			for (std::uint32_t i = 0; i < node.objectCount; ++i) {
+				std::uint32_t const object = objectIndices[node.objectFirst + i];
+				if (objectBoxes[object].Empty())
+					continue;
+
+				float const t = ray_box(origin, invDirection, best, objectBoxes[object]);
+				if (!std::isinf(t) && (!found || t < best)) {
+					best = t;
+					hit.object = object;
+					hit.distance = t;
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first, so that it can prune the other one.
+		float tLeft = ray_box(origin, invDirection, best, nodes[node.left].bounds);
+		float tRight = ray_box(origin, invDirection, best, nodes[node.left + 1].bounds);
+		std::uint32_t nearChild = node.left, farChild = node.left + 1;
+		if (tRight < tLeft) {
+			std::swap(nearChild, farChild);
+			std::swap(tLeft, tRight);
+		}
+		if (!std::isinf(tRight))
+			stack.push_back(farChild);
+		if (!std::isinf(tLeft))
+			stack.push_back(nearChild);
+	}
+
+	return found;
+}
+
+void SceneBvh::Overlap(const AABB& box, std::vector<std::uint32_t>& result) const {
+	if (objectBoxes.empty() || box.Empty())
+		return;
+
+	std::vector<std::uint32_t> stack{ 0 };
+	while (!stack.empty()) {
+		BvhNode const& node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!overlaps(node.bounds, box))
+			continue;
+
+		if (node.Leaf()) {
+			for (std::uint32_t i = 0; i < node.objectCount; ++i) {
+				std::uint32_t const object = objectIndices[node.objectFirst + i];
+				if (overlaps(objectBoxes[object], box))
+					result.push_back(object);
+			}
+			continue;
+		}
+
+		stack.push_back(node.left + 1);
+		stack.push_back(node.left);
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Bounds.h"
+
+struct BvhNode {
+    AABB bounds;
+    std::uint32_t left = 0;         // first child (the second follows it); 0 for leaves
+    std::uint32_t objectFirst = 0;  // objects below this node, in SceneBvh::objectIndices
+    std::uint32_t objectCount = 0;
+
+    bool Leaf() const { return 0 == left; }
+};
+
+struct BvhHit {
+    std::uint32_t object = 0;
+    float distance = 0.f;
+};
+
+struct BvhStats {
+    unsigned int objects = 0;
+    unsigned int nodes = 0;
+    unsigned int leaves = 0;
+    unsigned int depth = 0;
+    float buildMs = 0.f;
+
+    // Last Refit()
+    unsigned int refittedLeaves = 0;
+    float refitMs = 0.f;
+
+    // Last Cull()
+    unsigned int visible = 0;
+    unsigned int culled = 0;
+    unsigned int nodesVisited = 0;
+    float cullMs = 0.f;
+};
+
+
+// Bounding volume hierarchy over the world-space bounds of the scene's models,
+// used to frustum cull the scene before it is drawn and for ray and box
+// queries.
+//
+// Build() creates the tree top-down with a binned surface area heuristic.
+// When objects move, Update() their bounds and call Refit() once per frame:
+// only the changed leaves and their ancestors are recomputed. Refitting keeps
+// the topology, so the tree gets looser if objects move far; Build() again
+// when objects are added or removed.
+//
+// Nodes are stored with children after their parent, and the objects below
+// any node form a contiguous range of objectIndices.
+class SceneBvh {
+public:
+    static constexpr std::uint32_t kMaxLeafObjects = 4;
+    static constexpr int kBins = 16;
+
+    void Build(const std::vector<AABB>& boxes);
+
+    void Update(std::uint32_t object, const AABB& box);
+    void Refit();
+
+    // Appends the objects whose bounds intersect the frustum to visible.
+    void Cull(const Frustum& frustum, std::vector<std::uint32_t>& visible);
+
+    // Nearest object whose bounds are hit by the ray (direction need not be
+    // normalized; distances are in units of its length).
+    bool Raycast(Vec3f origin, Vec3f direction, float maxDistance, BvhHit& hit) const;
+
+    // Appends the objects whose bounds overlap box to result.
+    void Overlap(const AABB& box, std::vector<std::uint32_t>& result) const;
+
+    std::size_t Size() const { return objectBoxes.size(); }
+    const std::vector<AABB>& ObjectBounds() const { return objectBoxes; }
+    const AABB& Bounds() const { return nodes[0].bounds; }
+    const BvhStats& Stats() const { return stats; }
+
+private:
+    std::uint32_t split_(std::uint32_t node);
+    void refit_leaf_(std::uint32_t node);
+    bool refit_interior_(std::uint32_t node);
+
+    std::vector<BvhNode> nodes;
+    std::vector<std::uint32_t> parents;
+    std::vector<std::uint32_t> objectIndices;
+    std::vector<AABB> objectBoxes;
+    std::vector<Vec3f> centroids;           // only needed while building
+    std::vector<std::uint32_t> objectLeaves; // object -> leaf node
+
+    std::vector<std::uint32_t> dirtyLeaves;
+    std::vector<bool> leafDirty;
+
+    BvhStats stats;
+};
@@ -0,0 +1,137 @@
+#include "CameraPath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "../support/error.hpp"
+
+namespace {
+	// Scripted(): an orbit around the cats, in and out and up and down,
+	// once in kOrbitSeconds
+	constexpr double kOrbitSeconds = 16.0;
+	constexpr int kOrbitKeys = 16;
+	constexpr float kOrbitRadius = 6.f;
+	Vec3f const kOrbitTarget{ 0.f, 0.5f, -1.f };
+
+	float catmull_rom(float p0, float p1, float p2, float p3, float t) {
+		float const t2 = t * t, t3 = t2 * t;
+		return 0.5f * ((2.f * p1) + (p2 - p0) * t
+			+ (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * t2
+			+ (3.f * p1 - p0 - 3.f * p2 + p3) * t3);
+	}
+}
+
+CameraPath CameraPath::Load(const char* path_) {
+	std::FILE* file = std::fopen(path_, "r");
+	if (!file)
+		throw Error("CameraPath: unable to open '%s'", path_);
+
+	CameraPath path;
+	char line[256];
+	unsigned int lineNumber = 0;
+	while (std::fgets(line, sizeof(line), file)) {
+		++lineNumber;
+		char const* text = line;
+		while (' ' == *text || '\t' == *text)
+			++text;
+		if ('#' == *text || '\n' == *text || '\r' == *text || '\0' == *text)
+			continue;
+
+		CameraKey key;
+		if (6 != std::sscanf(text, "%lf %f %f %f %f %f", &key.time,
+			&key.position.x, &key.position.y, &key.position.z, &key.yaw, &key.pitch)) {
+			std::fclose(file);
+			throw Error("CameraPath: '%s', line %u: expected \"time x y z yaw pitch\"", path_, lineNumber);
+		}
+		if (!path.keys.empty() && key.time <= path.keys.back().time) {
+			std::fclose(file);
+			throw Error("CameraPath: '%s', line %u: times must increase", path_, lineNumber);
+		}
+		path.keys.push_back(key);
+	}
+	std::fclose(file);
+
+	if (path.keys.empty())
+		throw Error("CameraPath: '%s' has no keys", path_);
+	return path;
+}
+
+CameraPath CameraPath::Scripted() {
+	CameraPath path;
+	for (int i = 0; i <= kOrbitKeys; ++i) {
+		float const angle = 2.f * float(PI) * float(i) / float(kOrbitKeys);
+		float const radius = kOrbitRadius * (i % 2 ? 0.75f : 1.f);
+
+		CameraKey key;
+		key.time = kOrbitSeconds * double(i) / double(kOrbitKeys);
+		key.position = kOrbitTarget + Vec3f{ radius * std::sin(angle), 1.f + 1.5f * std::sin(0.5f * angle), radius * std::cos(angle) };
+
+		// Looking at the target; unwrapped, so that the spline turns the
+		// short way
+		Vec3f const to = kOrbitTarget - key.position;
+		key.yaw = -90.f - 360.f * float(i) / float(kOrbitKeys);
+		key.pitch = std::atan2(to.y, std::sqrt(to.x * to.x + to.z * to.z)) * 180.f / float(PI);
+		path.keys.push_back(key);
+	}
+	return path;
+}
+
+void CameraPath::Save(const char* path_) const {
+	std::FILE* file = std::fopen(path_, "w");
+	if (!file)
+		throw Error("CameraPath: unable to create '%s'", path_);
+
+	std::fprintf(file, "# time x y z yaw pitch\n");
+	for (auto const& key : keys) {
+		std::fprintf(file, "%.4f %.4f %.4f %.4f %.3f %.3f\n", key.time,
+			key.position.x, key.position.y, key.position.z, key.yaw, key.pitch);
+	}
+	std::fclose(file);
+}
+
+void CameraPath::Record(double time, const Camera& camera) {
+	if (keys.empty())
+		recordStart = time;
+	else if (time - recordStart - keys.back().time < kRecordInterval)
+		return;
+
+	CameraKey key;
+	key.time = time - recordStart;
+	key.position = camera.Position;
+	key.yaw = camera.Yaw;
+	key.pitch = camera.Pitch;
+	keys.push_back(key);
+}
+
+CameraKey CameraPath::Sample(double time) const {
+	if (keys.empty())
+		return CameraKey{};
+	if (time <= keys.front().time)
+		return keys.front();
+	if (time >= keys.back().time)
+		return keys.back();
+
+	// Segment [i, i + 1], with its neighbours clamped at the ends
+	auto const next = std::upper_bound(keys.begin(), keys.end(), time,
+		[](double t, CameraKey const& key) { return t < key.time; });
+	std::size_t const i = std::size_t(next - keys.begin()) - 1;
+	CameraKey const& k0 = keys[i > 0 ? i - 1 : i];
+	CameraKey const& k1 = keys[i];
+	CameraKey const& k2 = keys[i + 1];
+	CameraKey const& k3 = keys[std::min(i + 2, keys.size() - 1)];
+	float const t = float((time - k1.time) / (k2.time - k1.time));
+
+	CameraKey key;
+	key.time = time;
+	key.position.x = catmull_rom(k0.position.x, k1.position.x, k2.position.x, k3.position.x, t);
+	key.position.y = catmull_rom(k0.position.y, k1.position.y, k2.position.y, k3.position.y, t);
+	key.position.z = catmull_rom(k0.position.z, k1.position.z, k2.position.z, k3.position.z, t);
+	key.yaw = catmull_rom(k0.yaw, k1.yaw, k2.yaw, k3.yaw, t);
+	key.pitch = std::clamp(catmull_rom(k0.pitch, k1.pitch, k2.pitch, k3.pitch, t), -89.f, 89.f);
+	return key;
+}
+
+Camera CameraPath::ToCamera(const CameraKey& key) {
+	return Camera(key.position, Vec3f{ 0.f, 1.f, 0.f }, key.yaw, key.pitch);
+}
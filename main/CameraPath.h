@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include "camera.h"
+
+#include "../vmlib/vec3.hpp"
+
+struct CameraKey {
+    double time = 0.0;          // seconds from the start of the path
+    Vec3f position{ 0.f, 0.f, 0.f };
+    float yaw = YAW, pitch = PITCH; // degrees, as Camera
+};
+
+
+// A camera path: keyframes of the camera's position and orientation,
+// interpolated with a Catmull-Rom spline (so that both the position and its
+// velocity are continuous). Times before the first key or after the last
+// are clamped. Yaw isn't wrapped: keys that turn by more than 180 degrees
+// between them turn the long way.
+//
+// Paths are text files of one key per line, "time x y z yaw pitch", with #
+// starting comments. They can be recorded while flying the camera (keys
+// every kRecordInterval) and saved, or come from Scripted(), an orbit
+// around the scene.
+//
+// Usage:
+//    CameraPath path = CameraPath::Load( "assets/bench.path" );
+//    Camera camera = CameraPath::ToCamera( path.Sample( time ) );
+class CameraPath {
+public:
+    static constexpr double kRecordInterval = 0.25;
+
+    static CameraPath Load(const char* path_);
+    static CameraPath Scripted();
+
+    void Save(const char* path_) const;
+    // Adds a key if kRecordInterval has passed since the last one.
+    void Record(double time, const Camera& camera);
+
+    CameraKey Sample(double time) const;
+    static Camera ToCamera(const CameraKey& key);
+
+    double Duration() const { return keys.empty() ? 0.0 : keys.back().time; }
+    std::size_t KeyCount() const { return keys.size(); }
+
+private:
+    std::vector<CameraKey> keys;
+    double recordStart = 0.0;
+};
@@ -0,0 +1,355 @@
+#include "CascadedShadows.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "DepthPrepass.h"
+#include "GeometryArena.h"
+#include "StreamBuffer.h"
+
+#include "../support/error.hpp"
+
+namespace {
+	constexpr GLuint kNone = ~GLuint(0);
+
+	// Against shadow acne; slope scaled, as the light grazes the floor
+	constexpr float kOffsetFactor = 2.f;
+	constexpr float kOffsetUnits = 2.f;
+
+	// Clip space [-1, 1] to texture coordinates and depth [0, 1]
+	constexpr Mat44f kClipToTexture = { {
+		0.5f, 0.f, 0.f, 0.5f,
+		0.f, 0.5f, 0.f, 0.5f,
+		0.f, 0.f, 0.5f, 0.5f,
+		0.f, 0.f, 0.f, 1.f
+	} };
+}
+
+void CascadedShadows::PrepareCasters(const SceneStorage& scene, const std::vector<std::uint32_t>& staticCasters_,
+	const std::vector<std::uint32_t>& dynamicCasters_, ShadowCasters& casters) {
+	if (staticCasters_ != staticCasters) {
+		staticCasters = staticCasters_;
+		staticDirty = true;
+	}
+	// A new batch rather than an update, as frames being drawn may still
+	// refer to the old one
+	if (staticDirty || !staticBatch) {
+		auto batch = std::make_shared<ShadowBatch>();
+		build_batch_(scene, staticCasters, *batch);
+		staticBatch = std::move(batch);
+		staticDirty = false;
+	}
+
+	casters.staticBatch = staticBatch;
+	build_batch_(scene, dynamicCasters_, casters.dynamicBatch);
+}
+
+void CascadedShadows::Render(const ShadowCasters& casters, DepthPrepass& depth, Vec3f lightPosition_,
+	const Mat44f& view, const Mat44f& projection, float zNear, float zFar, int width, int height) {
+	if (!casters.staticBatch)
+		throw Error("CascadedShadows: Render() without casters; PrepareCasters() first");
+
+	init_();
+	timer.Begin();
+
+	bool const lightMoved = lightPosition_.x != lightPosition.x || lightPosition_.y != lightPosition.y || lightPosition_.z != lightPosition.z;
+	if (casters.staticBatch != cachedBatch || lightMoved || !lightValid) {
+		cachedBatch = casters.staticBatch;
+		update_light_(cachedBatch->bounds, lightPosition_);
+		for (auto& cascade : cascades)
+			cascade.halfExtent = 0.f;
+	}
+
+	// Camera position and direction, from the (rigid) view matrix
+	Vec3f const eye{
+		-(view(0, 0) * view(0, 3) + view(1, 0) * view(1, 3) + view(2, 0) * view(2, 3)),
+		-(view(0, 1) * view(0, 3) + view(1, 1) * view(1, 3) + view(2, 1) * view(2, 3)),
+		-(view(0, 2) * view(0, 3) + view(1, 2) * view(1, 3) + view(2, 2) * view(2, 3))
+	};
+	Vec3f const forward{ -view(2, 0), -view(2, 1), -view(2, 2) };
+
+	// Squared distance from the view axis to the corners of the view volume,
+	// at unit depth
+	float const tanX = 1.f / projection(0, 0);
+	float const tanY = 1.f / projection(1, 1);
+	float const corner2 = tanX * tanX + tanY * tanY;
+
+	unsigned int stale = 0;
+	for (int i = 0; i < kCascades; ++i) {
+		float const t = float(i + 1) / float(kCascades);
+		float const logSplit = zNear * std::pow(zFar / zNear, t);
+		float const uniformSplit = zNear + (zFar - zNear) * t;
+		splits[i] = kSplitLambda * logSplit + (1.f - kSplitLambda) * uniformSplit;
+
+		// Bounding sphere of the slice: its centre is on the view axis,
+		// equally far from the corners at both ends (or at the far end, if
+		// those are further apart).
+		float const n = i > 0 ? splits[i - 1] : zNear;
+		float const f = splits[i];
+		float const c = std::min(0.5f * (f + n) * (1.f + corner2), f);
+		float const radius = std::sqrt(std::max((c - n) * (c - n) + n * n * corner2, (f - c) * (f - c) + f * f * corner2));
+
+		Vec3f const centre = eye + forward * c;
+		Vec3f const local{ dot(lightAxes[0], centre), dot(lightAxes[1], centre), 0.f };
+		float const halfExtent = radius * kCacheScale;
+
+		// The cached map is still good while it contains the whole sphere
+		Cascade& cascade = cascades[i];
+		float const slack = cascade.halfExtent - radius;
+		if (halfExtent == cascade.halfExtent && std::abs(local.x - cascade.center.x) <= slack && std::abs(local.y - cascade.center.y) <= slack)
+			continue;
+
+		// Snapped to whole texels, so that the casters rasterize the same
+		// wherever the map is centred
+		float const texel = 2.f * halfExtent / float(kResolution);
+		cascade.halfExtent = halfExtent;
+		cascade.center = Vec3f{ std::floor(local.x / texel + 0.5f) * texel, std::floor(local.y / texel + 0.5f) * texel, 0.f };
+
+		float const depthScale = -2.f / (depthMax - depthMin);
+		Mat44f clip = kIdentity44f;
+		for (int j = 0; j < 3; ++j) {
+			clip(0, j) = lightAxes[0][j] / halfExtent;
+			clip(1, j) = lightAxes[1][j] / halfExtent;
+			clip(2, j) = lightAxes[2][j] * depthScale;
+		}
+		clip(0, 3) = -cascade.center.x / halfExtent;
+		clip(1, 3) = -cascade.center.y / halfExtent;
+		clip(2, 3) = -depthMax * depthScale - 1.f;  // nearest to the light at -1
+		cascade.clip = clip;
+
+		stale |= 1u << i;
+	}
+
+	GLboolean const depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glEnable(GL_DEPTH_TEST);
+	// Casters outside the depth range (dynamic ones may be) are clamped to
+	// it rather than clipped.
+	glEnable(GL_DEPTH_CLAMP);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(kOffsetFactor, kOffsetUnits);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, kResolution, kResolution);
+
+	if (stale)
+		draw_batch_(*cachedBatch, depth, cacheTexture, stale, true);
+
+	stats.staticCascadesRendered = 0;
+	for (int i = 0; i < kCascades; ++i) {
+		if (stale & (1u << i))
+			++stats.staticCascadesRendered;
+	}
+	stats.staticRenders += stats.staticCascadesRendered;
+
+	// Every frame: the cached maps, with the dynamic casters on top
+	glCopyImageSubData(cacheTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+		shadowTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+		kResolution, kResolution, kCascades);
+	draw_batch_(casters.dynamicBatch, depth, shadowTexture, (1u << kCascades) - 1, false);
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glDisable(GL_DEPTH_CLAMP);
+	if (!depthTest)
+		glDisable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+
+	glActiveTexture(GL_TEXTURE0 + kTextureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, shadowTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	timer.End();
+
+	stats.cascades = kCascades;
+	stats.resolution = kResolution;
+	stats.staticCasters = static_cast<unsigned int>(cachedBatch->instances.size());
+	stats.dynamicCasters = static_cast<unsigned int>(casters.dynamicBatch.instances.size());
+	std::copy(std::begin(splits), std::end(splits), stats.splits);
+	stats.passTimeMs = timer.Ms();
+}
+
+void CascadedShadows::SetUniforms(FrameUniforms& frame) const {
+	for (int i = 0; i < kCascades; ++i)
+		frame.shadowMatrices[i] = kClipToTexture * cascades[i].clip;
+	frame.shadowSplits = Vec4f{ splits[0], splits[1], splits[2], splits[3] };
+	for (int i = 0; i < kCascades; ++i)
+		(&frame.shadowTexel.x)[i] = 2.f * cascades[i].halfExtent / float(kResolution);
+	frame.shadowCascades[0] = kCascades;
+	frame.shadowCascades[1] = kResolution;
+}
+
+void CascadedShadows::Release() {
+	for (GLuint* texture : { &cacheTexture, &shadowTexture }) {
+		if (0 != *texture)
+			glDeleteTextures(1, texture);
+		*texture = 0;
+	}
+	if (0 != framebuffer)
+		glDeleteFramebuffers(1, &framebuffer);
+	framebuffer = 0;
+
+	timer.Release();
+	staticCasters.clear();
+	staticBatch.reset();
+	cachedBatch.reset();
+	staticDirty = true;
+	lightValid = false;
+}
+
+void CascadedShadows::init_() {
+	if (0 != framebuffer)
+		return;
+
+	static_assert(kCascades <= 4, "FrameUniforms holds up to 4 cascades");
+
+	for (GLuint* texture : { &cacheTexture, &shadowTexture }) {
+		glGenTextures(1, texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, *texture);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, kResolution, kResolution, kCascades);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	// Sampled with depth comparison and bilinear filtering (2x2 PCF per
+	// lookup); everything outside the maps is lit.
+	GLfloat const border[4] = { 1.f, 1.f, 1.f, 1.f };
+	glBindTexture(GL_TEXTURE_2D_ARRAY, shadowTexture);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	GLint previousDraw = 0, previousRead = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cacheTexture, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum const status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+	if (GL_FRAMEBUFFER_COMPLETE != status)
+		throw Error("CascadedShadows: framebuffer incomplete (0x%x)", status);
+}
+
+void CascadedShadows::update_light_(const AABB& casterBounds, Vec3f lightPosition_) {
+	lightPosition = lightPosition_;
+	lightValid = true;
+
+	AABB bounds = casterBounds;
+	if (bounds.Empty()) {
+		bounds.min = Vec3f{ -1.f, -1.f, -1.f };
+		bounds.max = Vec3f{ 1.f, 1.f, 1.f };
+	}
+
+	Vec3f const back = normalize(lightPosition - bounds.Center());
+	Vec3f const up = std::abs(back.y) < 0.99f ? Vec3f{ 0.f, 1.f, 0.f } : Vec3f{ 1.f, 0.f, 0.f };
+	lightAxes[0] = normalize(cross(up, back));
+	lightAxes[1] = cross(back, lightAxes[0]);
+	lightAxes[2] = back;
+
+	// Depth range of the static casters, with some room
+	depthMin = std::numeric_limits<float>::max();
+	depthMax = -std::numeric_limits<float>::max();
+	for (int i = 0; i < 8; ++i) {
+		Vec3f const corner{
+			(i & 1) ? bounds.max.x : bounds.min.x,
+			(i & 2) ? bounds.max.y : bounds.min.y,
+			(i & 4) ? bounds.max.z : bounds.min.z
+		};
+		depthMin = std::min(depthMin, dot(back, corner));
+		depthMax = std::max(depthMax, dot(back, corner));
+	}
+	depthMin -= 1.f;
+	depthMax += 1.f;
+}
+
+void CascadedShadows::build_batch_(const SceneStorage& scene, const std::vector<std::uint32_t>& slots, ShadowBatch& batch) {
+	// Grouped by mesh with a counting sort, as in IndirectRenderer::Submit()
+	batch.commands.clear();
+	batch.bounds = AABB{};
+	std::vector<GLuint> commandIndices;
+	for (std::uint32_t slot : slots) {
+		RenderObject const* ro = scene.Mesh(scene.Meshes()[slot]);
+		if (ro->id >= commandIndices.size())
+			commandIndices.resize(ro->id + 1, kNone);
+
+		GLuint& index = commandIndices[ro->id];
+		if (kNone == index) {
+			index = static_cast<GLuint>(batch.commands.size());
+
+			DrawElementsIndirectCommand command;
+			command.count = ro->geometry.indexCount;
+			command.instanceCount = 0;
+			command.firstIndex = ro->geometry.firstIndex;
+			command.baseVertex = ro->geometry.baseVertex;
+			command.baseInstance = 0;
+			batch.commands.push_back(command);
+		}
+		++batch.commands[index].instanceCount;
+	}
+
+	GLuint first = 0;
+	for (auto& command : batch.commands) {
+		command.baseInstance = first;
+		first += command.instanceCount;
+		command.instanceCount = 0;
+	}
+
+	batch.instances.resize(slots.size());
+	for (std::uint32_t slot : slots) {
+		auto& command = batch.commands[commandIndices[scene.Mesh(scene.Meshes()[slot])->id]];
+		InstanceData& instance = batch.instances[command.baseInstance + command.instanceCount++];
+		instance = InstanceData{};
+		instance.model = scene.Transforms()[slot];
+		batch.bounds.Expand(scene.Bounds()[slot]);
+	}
+}
+
+void CascadedShadows::draw_batch_(const ShadowBatch& batch, DepthPrepass& depth, GLuint texture, unsigned int cascadeMask, bool clear) {
+	if (batch.commands.empty() && !clear)
+		return;
+
+	StreamBuffer& stream = stream_buffer();
+	StreamAllocation instanceData, commandData;
+	if (!batch.commands.empty()) {
+		instanceData = stream.Upload(batch.instances.data(), batch.instances.size() * sizeof(InstanceData), stream.StorageAlignment());
+		commandData = stream.Upload(batch.commands.data(), batch.commands.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint));
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, instanceData.buffer, instanceData.offset, instanceData.size);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandData.buffer);
+	}
+
+	depth.BeginDepth();
+	for (int i = 0; i < kCascades; ++i) {
+		if (!(cascadeMask & (1u << i)))
+			continue;
+
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+		if (clear)
+			glClear(GL_DEPTH_BUFFER_BIT);
+		if (batch.commands.empty())
+			continue;
+
+		// vs_depth.glsl transforms by projection * view
+		FrameUniforms frame;
+		frame.view = cascades[i].clip;
+		frame.projection = kIdentity44f;
+		frame.viewPos = Vec4f{ 0.f, 0.f, 0.f, 1.f };
+		StreamAllocation const uniforms = stream.Upload(&frame, sizeof(frame), stream.UniformAlignment());
+		glBindBufferRange(GL_UNIFORM_BUFFER, 0, uniforms.buffer, uniforms.offset, uniforms.size);
+
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(commandData.offset),
+			static_cast<GLsizei>(batch.commands.size()), 0);
+	}
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	depth.End();
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+}
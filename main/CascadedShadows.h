@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Render.h"
+#include "SceneStorage.h"
+#include "IndirectRenderer.h"
+#include "GpuTimer.h"
+#include "Bounds.h"
+
+class DepthPrepass;
+
+// Shadow casters grouped by mesh, in the layout of IndirectRenderer
+struct ShadowBatch {
+    std::vector<InstanceData> instances;
+    std::vector<DrawElementsIndirectCommand> commands;
+    AABB bounds;
+};
+
+// The casters of a frame, as built by CascadedShadows::PrepareCasters().
+// The static batch is shared by the frames until the static casters change.
+struct ShadowCasters {
+    std::shared_ptr<const ShadowBatch> staticBatch;
+    ShadowBatch dynamicBatch;
+};
+
+struct CascadedShadowsStats {
+    unsigned int cascades = 0;
+    unsigned int resolution = 0;
+    float splits[4] = {};                   // far boundary (view depth) of each cascade
+    unsigned int staticCasters = 0;
+    unsigned int dynamicCasters = 0;
+    unsigned int staticCascadesRendered = 0; // this frame
+    unsigned int staticRenders = 0;          // cascades re-rendered since startup
+    float passTimeMs = 0.f;                 // GPU, all shadow passes of a frame
+};
+
+
+// Cascaded shadow maps for the main light, with the static casters cached.
+//
+// The camera's view depth range (near to far plane) is split into kCascades
+// slices, between a logarithmic and a uniform split (kSplitLambda). Each
+// slice gets an orthographic shadow map along the light's direction,
+// covering the slice's bounding sphere. The sphere doesn't depend on the
+// camera's orientation, only on its position, so a cascade's map stays valid
+// while the camera turns.
+//
+// Static casters are rendered into a cached array of depth maps, each
+// somewhat larger than its cascade needs (kCacheScale). A cascade's cache is
+// only re-rendered when the camera has moved far enough for the slice to
+// leave it, when the light moves or when the static casters change. Every
+// frame, the cached maps are copied into the array the shaders sample, and
+// the dynamic casters are drawn into it.
+//
+// Casters are drawn depth only with DepthPrepass's program and the geometry
+// arena's position stream, one multi-draw per cascade. Their batches are
+// built by PrepareCasters(), which doesn't call GL and may run on another
+// thread than Render() (see FramePipeline): the two share no state, only
+// the ShadowCasters handed from one to the other. The shadow matrices
+// are described to the shaders in FrameUniforms (see SetUniforms()); the
+// shadow maps are bound to texture unit kTextureUnit.
+//
+// The main light is a point light; its shadows are cast along the
+// direction from the static casters' centre to the light, as if it was
+// directional.
+class CascadedShadows {
+public:
+    static constexpr int kCascades = 4;
+    static constexpr GLsizei kResolution = 1024;
+    static constexpr float kSplitLambda = 0.95f;
+    static constexpr float kCacheScale = 1.25f;
+    static constexpr GLuint kTextureUnit = 7;
+
+    // Builds the batches of the casters, which are slots of the scene. The
+    // static casters are compared with the last ones; if they differ (or
+    // moved), the static batch is rebuilt, and so is the cache when it is
+    // rendered.
+    void PrepareCasters(const SceneStorage& scene, const std::vector<std::uint32_t>& staticCasters,
+        const std::vector<std::uint32_t>& dynamicCasters, ShadowCasters& casters);
+    // Static casters moved
+    void InvalidateStatic() { staticDirty = true; }
+
+    // Renders the shadow maps of the casters for the camera and binds them
+    // for drawing. Leaves the default framebuffer bound, with a width x
+    // height viewport.
+    void Render(const ShadowCasters& casters, DepthPrepass& depth, Vec3f lightPosition,
+        const Mat44f& view, const Mat44f& projection, float zNear, float zFar, int width, int height);
+    // Enables the shadows in the frame's uniforms, for the last Render().
+    void SetUniforms(FrameUniforms& frame) const;
+    void Release();
+
+    const CascadedShadowsStats& Stats() const { return stats; }
+
+private:
+    struct Cascade {
+        Vec3f center{ 0.f, 0.f, 0.f };  // light space, snapped to texels
+        float halfExtent = 0.f;         // 0: not rendered yet
+        Mat44f clip;                    // world -> clip space of the map
+    };
+
+    void init_();
+    void update_light_(const AABB& bounds, Vec3f lightPosition_);
+    static void build_batch_(const SceneStorage& scene, const std::vector<std::uint32_t>& slots, ShadowBatch& batch);
+    // Draws the batch into the layers of texture whose bits are set in
+    // cascadeMask, clearing them first if clear.
+    void draw_batch_(const ShadowBatch& batch, DepthPrepass& depth, GLuint texture, unsigned int cascadeMask, bool clear);
+
+    GLuint cacheTexture = 0;    // static casters
+    GLuint shadowTexture = 0;   // cache + dynamic casters, sampled
+    GLuint framebuffer = 0;
+
+    // PrepareCasters()
+    std::vector<std::uint32_t> staticCasters;
+    std::shared_ptr<const ShadowBatch> staticBatch;
+    bool staticDirty = true;
+
+    // Render(): the static batch the cache was rendered from
+    std::shared_ptr<const ShadowBatch> cachedBatch;
+
+    // Light space: rows of the rotation, and the depth range of the casters
+    Vec3f lightPosition{ 0.f, 0.f, 0.f };
+    Vec3f lightAxes[3];         // right, up, towards the light
+    float depthMin = 0.f, depthMax = 0.f;
+    bool lightValid = false;
+
+    Cascade cascades[kCascades];
+    float splits[kCascades] = {};
+
+    GpuTimer timer;
+    CascadedShadowsStats stats;
+};
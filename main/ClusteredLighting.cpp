@@ -0,0 +1,158 @@
+#include "ClusteredLighting.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "StreamBuffer.h"
+
+namespace {
+	// Only used by compute passes, which bind it themselves
+	constexpr GLuint kCounterBinding = 2;
+}
+
+void ClusteredLighting::Assign(const std::vector<PointLight>& lights, const Mat44f& view, const Mat44f& projection,
+	float zNear_, float zFar_, int width_, int height_) {
+	init_();
+	collect_results_();
+
+	zNear = zNear_;
+	zFar = zFar_;
+	sliceNear = std::max(zNear, kSliceNear);
+	width = width_;
+	height = height_;
+	stats.lights = static_cast<unsigned int>(lights.size());
+	stats.clusters = kClusters;
+
+	StreamBuffer& stream = stream_buffer();
+	StreamAllocation const lightData = stream.Upload(lights.data(), lights.size() * sizeof(PointLight), stream.StorageAlignment());
+
+	Frame& frame = frames[frameIndex];
+	frameIndex = (frameIndex + 1) % kLatency;
+	if (frame.fence) {
+		// Results of this slot were never collected; drop them.
+		glDeleteSync(frame.fence);
+		frame.fence = nullptr;
+	}
+
+	GLuint const zeros[3] = {};
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, frame.counters);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glUseProgram(program->programId());
+	glUniformMatrix4fv(viewLocation, 1, GL_TRUE, view.v);
+	// The projection's scale factors give the extent of the view volume at
+	// unit depth.
+	glUniform2f(tanHalfFovLocation, 1.f / projection(0, 0), 1.f / projection(1, 1));
+	glUniform3f(depthRangeLocation, zNear, sliceNear, zFar);
+	glUniform1ui(lightCountLocation, stats.lights);
+
+	if (lightData.size)
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 5, lightData.buffer, lightData.offset, lightData.size);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, countBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, indexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kCounterBinding, frame.counters);
+
+	glBeginQuery(GL_TIME_ELAPSED, frame.timer);
+	// One work group per slice (see cs_clusters.glsl)
+	glDispatchCompute(1, 1, kSlices);
+	glEndQuery(GL_TIME_ELAPSED);
+
+	frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// The lists are read by the fragment shaders of the draws; the lights
+	// stay bound at 5.
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void ClusteredLighting::SetUniforms(FrameUniforms& frame) const {
+	frame.clusterDepth = Vec4f{ sliceNear, zFar, float(kSlices) / std::log(zFar / sliceNear), 0.f };
+	frame.clusterTile = Vec4f{ float(width) / float(kTilesX), float(height) / float(kTilesY), 0.f, 0.f };
+	frame.clusterGrid[0] = kTilesX;
+	frame.clusterGrid[1] = kTilesY;
+	frame.clusterGrid[2] = kSlices;
+	frame.clusterGrid[3] = stats.lights ? 1 : 0;
+}
+
+void ClusteredLighting::Release() {
+	for (auto& frame : frames) {
+		if (frame.fence)
+			glDeleteSync(frame.fence);
+		if (0 != frame.counters)
+			glDeleteBuffers(1, &frame.counters);
+		if (0 != frame.timer)
+			glDeleteQueries(1, &frame.timer);
+		frame = Frame{};
+	}
+
+	for (GLuint* buffer : { &countBuffer, &indexBuffer }) {
+		if (0 != *buffer)
+			glDeleteBuffers(1, buffer);
+		*buffer = 0;
+	}
+
+	program.reset();
+}
+
+void ClusteredLighting::init_() {
+	if (program)
+		return;
+
+	program = std::make_unique<ShaderProgram>(std::vector<ShaderProgram::ShaderSource>{
+		{ GL_COMPUTE_SHADER, "assets/cs_clusters.glsl" }
+	});
+	viewLocation = glGetUniformLocation(program->programId(), "view");
+	tanHalfFovLocation = glGetUniformLocation(program->programId(), "tanHalfFov");
+	depthRangeLocation = glGetUniformLocation(program->programId(), "depthRange");
+	lightCountLocation = glGetUniformLocation(program->programId(), "lightCount");
+
+	glGenBuffers(1, &countBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, kClusters * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, kClusters * kMaxClusterLights * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+
+	for (auto& frame : frames) {
+		glGenBuffers(1, &frame.counters);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, frame.counters);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 3 * sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+		glGenQueries(1, &frame.timer);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void ClusteredLighting::collect_results_() {
+	// Read back results of earlier frames that have finished on the GPU,
+	// without waiting for the ones that haven't.
+	// Oldest first, so that the newest available result wins.
+	for (int i = 0; i < kLatency; ++i) {
+		Frame& frame = frames[(frameIndex + i) % kLatency];
+		if (!frame.fence)
+			continue;
+
+		GLenum const status = glClientWaitSync(frame.fence, 0, 0);
+		if (GL_ALREADY_SIGNALED != status && GL_CONDITION_SATISFIED != status)
+			continue;
+
+		glDeleteSync(frame.fence);
+		frame.fence = nullptr;
+
+		GLuint counters[3] = {};
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, frame.counters);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), counters);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		stats.lightRefs = counters[0];
+		stats.maxClusterLights = counters[1];
+		stats.overflowed = counters[2];
+
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(frame.timer, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (GL_TRUE == available) {
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(frame.timer, GL_QUERY_RESULT, &elapsed);
+			stats.assignTimeMs = float(elapsed) / 1e6f;
+		}
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Render.h"
+
+#include "../support/program.hpp"
+
+// Point light read by cs_clusters.glsl and fs_phong.glsl (std430).
+struct PointLight {
+    Vec4f positionRadius;   // world position, radius of influence
+    Vec4f colorIntensity;
+};
+
+struct ClusteredLightingStats {
+    unsigned int lights = 0;
+    unsigned int clusters = 0;
+    // Results of the assignment pass are read back a few frames late (see
+    // kLatency), so that reading them never stalls.
+    unsigned int lightRefs = 0;         // sum of the clusters' light counts
+    unsigned int maxClusterLights = 0;
+    unsigned int overflowed = 0;        // clusters with more than kMaxClusterLights lights
+    float assignTimeMs = 0.f;
+};
+
+
+// Clustered forward shading for many point lights.
+//
+// The view frustum is split into a grid of clusters ("froxels"): kTilesX x
+// kTilesY screen tiles and kSlices depth slices, spaced exponentially so
+// that clusters are roughly cubic at every distance. Each frame, a compute
+// pass (cs_clusters.glsl) transforms the lights into view space, keeps the
+// ones whose sphere touches a depth slice and tests those against the
+// view-space bounds of each cluster of the slice, writing a list of light
+// indices per cluster. fs_phong.glsl then finds the cluster of a fragment
+// from its window position and view depth, and only shades the lights in
+// that cluster's list, so the cost of a pixel depends on the lights near it
+// rather than on the total number of lights.
+//
+// Lights are uploaded to the stream buffer each frame; the cluster lists are
+// fixed-size (kMaxClusterLights per cluster, further lights are dropped and
+// counted in the stats).
+//
+// Buffers bound for the draws: lights at SSBO binding 5, per-cluster light
+// counts at 6, light lists at 7. The grid is described to the shaders in
+// FrameUniforms (see SetUniforms()).
+class ClusteredLighting {
+public:
+    static constexpr GLuint kTilesX = 16;
+    static constexpr GLuint kTilesY = 9;
+    static constexpr GLuint kSlices = 24;
+    static constexpr GLuint kClusters = kTilesX * kTilesY * kSlices;
+    static constexpr GLuint kMaxClusterLights = 512;
+    // Depth slices are spaced from here (or the near plane, if further);
+    // the first slice also covers everything closer.
+    static constexpr float kSliceNear = 0.1f;
+    static constexpr int kLatency = 3;
+
+    // Uploads the lights, builds the cluster lists for the view and binds
+    // the buffers for drawing.
+    void Assign(const std::vector<PointLight>& lights, const Mat44f& view, const Mat44f& projection,
+        float zNear, float zFar, int width, int height);
+    // Enables clustered lights in the frame's uniforms, for the grid of the
+    // last Assign().
+    void SetUniforms(FrameUniforms& frame) const;
+    void Release();
+
+    const ClusteredLightingStats& Stats() const { return stats; }
+
+private:
+    void init_();
+    void collect_results_();
+
+    std::unique_ptr<ShaderProgram> program;
+    GLint viewLocation = -1;
+    GLint tanHalfFovLocation = -1;
+    GLint depthRangeLocation = -1;
+    GLint lightCountLocation = -1;
+
+    GLuint countBuffer = 0;     // lights per cluster
+    GLuint indexBuffer = 0;     // kMaxClusterLights light indices per cluster
+
+    float zNear = 0.f, sliceNear = 0.f, zFar = 0.f;
+    int width = 0, height = 0;
+
+    // Ring of per-frame results
+    struct Frame {
+        GLuint counters = 0;    // light references, max lights, overflowed clusters
+        GLuint timer = 0;
+        GLsync fence = nullptr;
+    };
+    Frame frames[kLatency];
+    unsigned int frameIndex = 0;
+
+    ClusteredLightingStats stats;
+};
@@ -0,0 +1,71 @@
+#include "DeferredShading.h"
+
+namespace {
+	// See DeferredShading.h and the outputs of fs_phong.glsl
+	constexpr unsigned int kBytesPerPixel = 4 + 4 + 4 + 4 + 4;
+
+	char const* const kSamplers[] = {
+		"gbufferDiffuse", "gbufferSpecular", "gbufferNormal", "gbufferUnlit"
+	};
+}
+
+void DeferredShading::Begin(int width, int height) {
+	gbuffer.Resize(width, height, { GL_RGBA8, GL_RGBA8, GL_RG16_SNORM, GL_R11F_G11F_B10F });
+	gbuffer.Bind();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	stats.width = width;
+	stats.height = height;
+	stats.bytesPerPixel = kBytesPerPixel;
+
+	geometryTimer.Begin();
+}
+
+void DeferredShading::Resolve(Shader& lighting, GLuint output) {
+	geometryTimer.End();
+	lightingTimer.Begin();
+
+	if (0 == vao)
+		glGenVertexArrays(1, &vao);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, output);
+	glViewport(0, 0, gbuffer.Width(), gbuffer.Height());
+
+	lighting.use();
+	for (int i = 0; i < gbuffer.ColorCount(); ++i) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, gbuffer.ColorTexture(i));
+		lighting.setInt(kSamplers[i], i);
+	}
+	glActiveTexture(GL_TEXTURE0 + gbuffer.ColorCount());
+	glBindTexture(GL_TEXTURE_2D, gbuffer.DepthTexture());
+	lighting.setInt("gbufferDepth", gbuffer.ColorCount());
+
+	// Every pixel is shaded exactly once; the G-buffer's depth already
+	// resolved visibility.
+	GLboolean const depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	if (depthTest)
+		glEnable(GL_DEPTH_TEST);
+
+	for (int i = gbuffer.ColorCount(); i >= 0; --i) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	lightingTimer.End();
+	stats.geometryTimeMs = geometryTimer.Ms();
+	stats.lightingTimeMs = lightingTimer.Ms();
+}
+
+void DeferredShading::Release() {
+	gbuffer.Release();
+	if (0 != vao)
+		glDeleteVertexArrays(1, &vao);
+	vao = 0;
+	geometryTimer.Release();
+	lightingTimer.Release();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Render.h"
+#include "RenderTarget.h"
+#include "GpuTimer.h"
+
+struct DeferredShadingStats {
+    int width = 0, height = 0;
+    unsigned int bytesPerPixel = 0;     // all G-buffer textures, depth included
+    float geometryTimeMs = 0.f;
+    float lightingTimeMs = 0.f;
+};
+
+
+// Deferred shading: the scene is drawn once with the GBUFFER variant of
+// fs_phong.glsl, which stores each pixel's surface instead of shading it,
+// and a fullscreen pass with the DEFERRED_LIGHTING variant then shades
+// every pixel once, with the same Phong terms (and clustered point lights)
+// as the forward path. Overdrawn fragments thus only cost the G-buffer
+// writes, not the lighting.
+//
+// The G-buffer is kept compact, 20 bytes per pixel:
+//
+//   0  RGBA8            diffuse color (material diffuse x texture)
+//   1  RGBA8            specular color, shininess / 255
+//   2  RG16_SNORM       normal, octahedral encoded
+//   3  R11F_G11F_B10F   unlit color (emission + ambient)
+//      DEPTH32F         depth; the position is reconstructed from it
+//
+// so terms are clamped to [0, 1] (except the unlit color) and shininess is
+// rounded to an integer.
+//
+// Usage:
+//    deferred.Begin( width, height );
+//    ... draw the scene with the GBUFFER shaders ...
+//    deferred.Resolve( lightingShader );
+class DeferredShading {
+public:
+    // Resizes, binds and clears the G-buffer.
+    void Begin(int width, int height);
+    // Shades the G-buffer into output (the default framebuffer, or one of
+    // the same size), which is left bound. Its depth isn't written.
+    void Resolve(Shader& lighting, GLuint output = 0);
+    void Release();
+
+    const RenderTarget& GBuffer() const { return gbuffer; }
+    const DeferredShadingStats& Stats() const { return stats; }
+
+private:
+    RenderTarget gbuffer;
+    GLuint vao = 0;         // no attributes; vs_fullscreen.glsl uses gl_VertexID
+    GpuTimer geometryTimer;
+    GpuTimer lightingTimer;
+
+    DeferredShadingStats stats;
+};
@@ -0,0 +1,36 @@
+#include "DepthPrepass.h"
+
+#include "GeometryArena.h"
+
+void DepthPrepass::BeginDepth() {
+	glUseProgram(Program());
+	glBindVertexArray(geometry_arena().PositionVAO());
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+}
+
+void DepthPrepass::BeginShading() {
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_FALSE);
+	glDepthFunc(GL_EQUAL);
+}
+
+void DepthPrepass::End() {
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+}
+
+void DepthPrepass::Release() {
+	program.reset();
+}
+
+GLuint DepthPrepass::Program() {
+	if (!program) {
+		program = std::make_unique<ShaderProgram>(std::vector<ShaderProgram::ShaderSource>{
+			{ GL_VERTEX_SHADER, "assets/vs_depth.glsl" }
+		});
+	}
+	return program->programId();
+}
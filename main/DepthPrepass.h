@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+
+#include <glad.h>
+
+#include "../support/program.hpp"
+
+// Depth prepass: the visible geometry is first drawn depth only, from the
+// geometry arena's position stream (see GeometryArena::PositionVAO()) with a
+// vertex-only program (vs_depth.glsl). The shading pass then tests with
+// GL_EQUAL and doesn't write depth, so the fragment shader runs about once
+// per pixel however much the scene overdraws. vs_depth.glsl and
+// vs_phong.glsl compute gl_Position with the same invariant expression, so
+// the depths match exactly.
+//
+// The program and position stream also serve other depth-only passes (such
+// as shadow maps).
+//
+// The draw paths take an optional DepthPrepass and do:
+//    prepass->BeginDepth();
+//    ... draw positions only (the program and VAO are bound) ...
+//    prepass->BeginShading();
+//    ... draw shaded, as usual ...
+//    prepass->End();
+class DepthPrepass {
+public:
+    // Binds the program and the position VAO, and disables color writes.
+    void BeginDepth();
+    void BeginShading();
+    // Restores the default depth state (GL_LESS, depth writes).
+    void End();
+    void Release();
+
+    GLuint Program();
+
+private:
+    std::unique_ptr<ShaderProgram> program;
+};
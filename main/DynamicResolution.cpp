@@ -0,0 +1,127 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../support/error.hpp"
+
+void DynamicResolution::Configure(const DynamicResolutionSettings& settings_) {
+	if (!(settings_.minScale > 0.f && settings_.minScale <= settings_.maxScale && settings_.maxScale <= 1.f))
+		throw Error("DynamicResolution: scale limits %.2f to %.2f must be within (0, 1]", settings_.minScale, settings_.maxScale);
+	if (!(settings_.targetMs > 0.f))
+		throw Error("DynamicResolution: target frame time %.2f ms must be positive", settings_.targetMs);
+
+	settings = settings_;
+	stats.scale = std::clamp(stats.scale, settings.minScale, settings.maxScale);
+}
+
+void DynamicResolution::BeginFrame(int windowWidth_, int windowHeight_) {
+	windowWidth = windowWidth_;
+	windowHeight = windowHeight_;
+
+	stats.frameTimeMs = frameTimer.Ms();
+	update_scale_();
+
+	stats.width = std::max(1, int(std::lround(stats.scale * float(windowWidth))));
+	stats.height = std::max(1, int(std::lround(stats.scale * float(windowHeight))));
+
+	frameTimer.Begin();
+}
+
+void DynamicResolution::Bind() {
+	bool const resized = stats.width != target.Width() || stats.height != target.Height();
+	target.Resize(stats.width, stats.height);
+	if (resized) {
+		// Sampled bilinearly by the upscale
+		glBindTexture(GL_TEXTURE_2D, target.ColorTexture());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	target.Bind();
+}
+
+void DynamicResolution::EndFrame(GLuint output) {
+	if (stats.width == windowWidth && stats.height == windowHeight)
+		target.BlitTo(output);
+	else
+		upscale_(output);
+	glViewport(0, 0, windowWidth, windowHeight);
+
+	frameTimer.End();
+}
+
+void DynamicResolution::Release() {
+	target.Release();
+	program.reset();
+	if (0 != vao)
+		glDeleteVertexArrays(1, &vao);
+	vao = 0;
+	frameTimer.Release();
+}
+
+void DynamicResolution::update_scale_() {
+	stats.changed = false;
+	if (settle > 0) {
+		--settle;
+		return;
+	}
+	// No result yet
+	if (stats.frameTimeMs <= 0.f)
+		return;
+
+	float const time = stats.frameTimeMs;
+	if (time <= settings.targetMs && time >= kHeadroom * settings.targetMs)
+		return;
+
+	// Cost is mostly per pixel, i.e. proportional to scale^2
+	float const ideal = stats.scale * std::sqrt(settings.targetMs / time);
+	float const wanted = stats.scale + kGain * (ideal - stats.scale);
+
+	// Whole steps towards it (at least one), within the limits
+	float steps = std::max(1.f, std::floor(std::abs(wanted - stats.scale) / kScaleStep));
+	float scale = stats.scale + (wanted > stats.scale ? steps : -steps) * kScaleStep;
+	scale = std::clamp(scale, settings.minScale, settings.maxScale);
+	if (scale == stats.scale)
+		return;
+
+	stats.scale = scale;
+	stats.changed = true;
+	++stats.changes;
+	settle = kSettleFrames;
+}
+
+void DynamicResolution::upscale_(GLuint output) {
+	if (!program) {
+		program = std::make_unique<ShaderProgram>(std::vector<ShaderProgram::ShaderSource>{
+			{ GL_VERTEX_SHADER, "assets/vs_fullscreen.glsl" },
+			{ GL_FRAGMENT_SHADER, "assets/fs_upscale.glsl" }
+		});
+		sourceTexelLocation = glGetUniformLocation(program->programId(), "sourceTexel");
+		outputTexelLocation = glGetUniformLocation(program->programId(), "outputTexel");
+		sharpnessLocation = glGetUniformLocation(program->programId(), "sharpness");
+		glGenVertexArrays(1, &vao);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, output);
+	glViewport(0, 0, windowWidth, windowHeight);
+
+	glUseProgram(program->programId());
+	glUniform2f(sourceTexelLocation, 1.f / float(stats.width), 1.f / float(stats.height));
+	glUniform2f(outputTexelLocation, 1.f / float(windowWidth), 1.f / float(windowHeight));
+	glUniform1f(sharpnessLocation, settings.sharpness);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, target.ColorTexture());
+
+	GLboolean const depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	if (depthTest)
+		glEnable(GL_DEPTH_TEST);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <memory>
+
+#include <glad.h>
+
+#include "RenderTarget.h"
+#include "GpuTimer.h"
+
+#include "../support/program.hpp"
+
+struct DynamicResolutionSettings {
+    float targetMs = 14.f;      // GPU frame time to hold, with some headroom below vsync
+    float minScale = 0.5f;      // of the window's width and height
+    float maxScale = 1.f;
+    float sharpness = 0.6f;     // of the upscale, 0 to 1
+};
+
+struct DynamicResolutionStats {
+    float scale = 1.f;
+    int width = 0, height = 0;  // render size
+    float frameTimeMs = 0.f;    // GPU, last result available
+    bool changed = false;       // scale changed this frame
+    unsigned int changes = 0;   // since startup
+};
+
+
+// Dynamic resolution: the scene is rendered into an offscreen target whose
+// size is a fraction (the scale) of the window's, and upscaled to the
+// window with a sharpening filter (fs_upscale.glsl).
+//
+// The GPU time of whole frames is measured with a GpuTimer (timestamps, as
+// frames contain passes timed with GL_TIME_ELAPSED queries, which can't
+// nest). Each frame, a controller compares the last result with the
+// target: the cost of a frame is mostly per pixel, so the scale that would
+// meet the target is the current one times sqrt(target / time). The scale
+// moves part of the way there, in steps of kScaleStep (so that the targets
+// are only reallocated now and then), and only when the time is over the
+// target or below it by more than kHeadroom. After a change, it waits
+// kSettleFrames for results rendered at the new scale.
+//
+// Usage:
+//    resolution.BeginFrame( windowWidth, windowHeight );   // picks the size
+//    ... GPU work that doesn't draw the scene ...
+//    resolution.Bind();
+//    ... draw the scene at Width() x Height() ...
+//    resolution.EndFrame();    // upscales into the window
+class DynamicResolution {
+public:
+    static constexpr float kScaleStep = 0.05f;
+    static constexpr float kHeadroom = 0.85f;
+    static constexpr float kGain = 0.5f;
+    static constexpr int kSettleFrames = GpuTimer::kLatency + 2;
+
+    void Configure(const DynamicResolutionSettings& settings_);
+
+    void BeginFrame(int windowWidth_, int windowHeight_);
+    // Resizes and binds the offscreen target, with the viewport covering it.
+    void Bind();
+    // Upscales into output, the window's framebuffer unless headless.
+    void EndFrame(GLuint output = 0);
+    void Release();
+
+    GLuint Framebuffer() const { return target.Framebuffer(); }
+    int Width() const { return stats.width; }
+    int Height() const { return stats.height; }
+
+    const DynamicResolutionSettings& Settings() const { return settings; }
+    const DynamicResolutionStats& Stats() const { return stats; }
+
+private:
+    void update_scale_();
+    void upscale_(GLuint output);
+
+    DynamicResolutionSettings settings;
+    RenderTarget target;
+    int windowWidth = 0, windowHeight = 0;
+    int settle = 0;
+
+    std::unique_ptr<ShaderProgram> program;
+    GLint sourceTexelLocation = -1;
+    GLint outputTexelLocation = -1;
+    GLint sharpnessLocation = -1;
+    GLuint vao = 0;             // no attributes; vs_fullscreen.glsl uses gl_VertexID
+
+    GpuTimer frameTimer;
+    DynamicResolutionStats stats;
+};
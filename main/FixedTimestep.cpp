@@ -0,0 +1,20 @@
+#include "FixedTimestep.h"
+
+#include <algorithm>
+
+int FixedTimestep::Advance(double frameSeconds) {
+	accumulator += std::max(frameSeconds, 0.0);
+
+	int steps = int(accumulator / kStep);
+	if (steps > kMaxSteps) {
+		steps = kMaxSteps;
+		accumulator = kMaxSteps * kStep;
+		++stats.dropped;
+	}
+	accumulator -= steps * kStep;
+	time += steps * kStep;
+
+	stats.steps = static_cast<unsigned int>(steps);
+	stats.alpha = float(std::clamp(accumulator / kStep, 0.0, 1.0));
+	return steps;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+struct FixedTimestepStats {
+    unsigned int steps = 0;     // this frame
+    unsigned int dropped = 0;   // frames since startup that had more than kMaxSteps due
+    float alpha = 0.f;          // this frame
+};
+
+
+// Fixed timestep simulation: however long frames take, the simulation
+// advances in steps of kStep seconds, so that its results don't depend on
+// the frame rate. Each frame adds the real time that passed, and runs the
+// steps that are due; the remainder is carried over. Frames are drawn
+// between the last two steps (Alpha()), so that motion is smooth even when
+// the frame rate and the step rate don't match, at the cost of one step of
+// latency.
+//
+// After a long stall (e.g. dragging the window), at most kMaxSteps run in a
+// frame and the rest of the time is dropped, rather than the simulation
+// trying to catch up and making the next frames even longer.
+//
+// Usage:
+//    int const steps = timestep.Advance( frameSeconds );
+//    for( int i = 0; i < steps; ++i )
+//        step( FixedTimestep::kStep );        // previous = current, then update current
+//    draw( lerp( previous, current, timestep.Alpha() ) );
+class FixedTimestep {
+public:
+    static constexpr double kStep = 1.0 / 120.0;
+    static constexpr int kMaxSteps = 8;
+
+    // Adds the real time since the last frame; returns the steps to run.
+    int Advance(double frameSeconds);
+
+    // Position of the frame between the previous step and the current one
+    float Alpha() const { return stats.alpha; }
+    // Simulated time at the current step, and at the frame
+    double Time() const { return time; }
+    double FrameTime() const { return time - (1.0 - double(stats.alpha)) * kStep; }
+
+    const FixedTimestepStats& Stats() const { return stats; }
+
+private:
+    double accumulator = 0.0;
+    double time = 0.0;
+    FixedTimestepStats stats;
+};
@@ -0,0 +1,72 @@
+#include "FragmentCounter.h"
+
+#include <cstring>
+
+bool FragmentCounter::Supported() {
+	if (supported < 0) {
+		supported = GLAD_GL_VERSION_4_6 ? 1 : 0;
+
+		GLint extensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+		for (GLint i = 0; i < extensions && !supported; ++i) {
+			char const* name = reinterpret_cast<char const*>(glGetStringi(GL_EXTENSIONS, i));
+			if (0 == std::strcmp(name, "GL_ARB_pipeline_statistics_query"))
+				supported = 1;
+		}
+	}
+	return 1 == supported;
+}
+
+void FragmentCounter::Begin() {
+	if (!Supported())
+		return;
+
+	if (0 == frames[0].query) {
+		for (auto& frame : frames)
+			glGenQueries(1, &frame.query);
+	}
+
+	collect_results_();
+
+	// Results of this slot that were never collected are dropped
+	Frame& frame = frames[frameIndex];
+	frame.pending = false;
+	glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS, frame.query);
+}
+
+void FragmentCounter::End() {
+	if (!Supported())
+		return;
+
+	Frame& frame = frames[frameIndex];
+	frameIndex = (frameIndex + 1) % kLatency;
+
+	glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS);
+	frame.pending = true;
+}
+
+void FragmentCounter::Release() {
+	for (auto& frame : frames) {
+		if (0 != frame.query)
+			glDeleteQueries(1, &frame.query);
+		frame = Frame{};
+	}
+	frameIndex = 0;
+}
+
+void FragmentCounter::collect_results_() {
+	// Oldest first, so that the newest available result wins.
+	for (int i = 0; i < kLatency; ++i) {
+		Frame& frame = frames[(frameIndex + i) % kLatency];
+		if (!frame.pending)
+			continue;
+
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(frame.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (GL_TRUE != available)
+			continue;
+
+		glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &invocations);
+		frame.pending = false;
+	}
+}
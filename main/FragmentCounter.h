@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glad.h>
+
+// Number of fragment shader invocations between Begin() and End(), from a
+// GL_FRAGMENT_SHADER_INVOCATIONS query (GL 4.6 or
+// ARB_pipeline_statistics_query; without either, counts stay 0). Results
+// are read back a few frames late (see kLatency), so that reading them
+// never stalls.
+class FragmentCounter {
+public:
+    static constexpr int kLatency = 3;
+
+    void Begin();
+    void End();
+    void Release();
+
+    bool Supported();
+    // Last result available
+    GLuint64 Invocations() const { return invocations; }
+
+private:
+    void collect_results_();
+
+    struct Frame {
+        GLuint query = 0;
+        bool pending = false;
+    };
+    Frame frames[kLatency];
+    unsigned int frameIndex = 0;
+    int supported = -1;     // unknown until first asked
+    GLuint64 invocations = 0;
+};
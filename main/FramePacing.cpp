@@ -0,0 +1,137 @@
+#include "FramePacing.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "../support/error.hpp"
+
+namespace {
+	// Sleeps end this much before the deadline, and the rest is spun, as
+	// sleeps may overshoot by about a scheduler tick.
+	constexpr double kSpinSeconds = 0.002;
+}
+
+const char* FramePacing::ModeName(FramePacingMode mode_) {
+	switch (mode_) {
+	case FramePacingMode::vsync: return "vsync";
+	case FramePacingMode::adaptive: return "adaptive vsync";
+	case FramePacingMode::capped: return "capped";
+	case FramePacingMode::uncapped: return "uncapped";
+	}
+	return "unknown";
+}
+
+void FramePacing::SetMode(FramePacingMode mode_, float capFps_) {
+	if (FramePacingMode::capped == mode_ && !(capFps_ > 0.f))
+		throw Error("FramePacing: frame rate cap %.2f must be positive", capFps_);
+
+	mode = mode_;
+	capFps = capFps_;
+	deadline = 0.0;
+
+	stats.adaptiveSupported = glfwExtensionSupported("WGL_EXT_swap_control_tear")
+		|| glfwExtensionSupported("GLX_EXT_swap_control_tear");
+
+	switch (mode) {
+	case FramePacingMode::vsync:
+		glfwSwapInterval(1);
+		break;
+	case FramePacingMode::adaptive:
+		glfwSwapInterval(stats.adaptiveSupported ? -1 : 1);
+		break;
+	case FramePacingMode::capped:
+	case FramePacingMode::uncapped:
+		glfwSwapInterval(0);
+		break;
+	}
+}
+
+void FramePacing::BeginFrame() {
+	if (FramePacingMode::capped == mode) {
+		double const now = glfwGetTime();
+		if (now < deadline) {
+			double const sleep = deadline - now - kSpinSeconds;
+			if (sleep > 0.0)
+				std::this_thread::sleep_for(std::chrono::duration<double>(sleep));
+			while (glfwGetTime() < deadline)
+				std::this_thread::yield();
+		}
+
+		// The next deadline follows from this one, so that the rate holds
+		// on average, unless the frame is more than one interval late; then
+		// from now, so that a stall isn't followed by a burst of frames.
+		double const interval = 1.0 / double(capFps);
+		double const start = glfwGetTime();
+		deadline = (start - deadline > interval ? start : deadline) + interval;
+	}
+
+	double const now = glfwGetTime();
+	if (frameStart >= 0.0)
+		stats.frameMs = float(1000.0 * (now - frameStart));
+	frameStart = now;
+
+	poll_fences_();
+}
+
+void FramePacing::EndFrame(double inputTime) {
+	poll_fences_();
+
+	if (kFences == count) {
+		// Not finished after kFences frames; drop the oldest rather than wait
+		glDeleteSync(pending[first].fence);
+		pending[first].fence = nullptr;
+		first = (first + 1) % kFences;
+		--count;
+		++stats.missed;
+	}
+
+	Pending& frame = pending[(first + count) % kFences];
+	frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame.inputTime = inputTime;
+	++count;
+}
+
+void FramePacing::Release() {
+	for (auto& frame : pending) {
+		if (frame.fence)
+			glDeleteSync(frame.fence);
+		frame.fence = nullptr;
+	}
+	first = count = 0;
+}
+
+void FramePacing::poll_fences_() {
+	// Frames finish in order; stop at the first that hasn't
+	while (count > 0) {
+		Pending& frame = pending[first];
+		GLenum const status = glClientWaitSync(frame.fence, 0, 0);
+		if (GL_ALREADY_SIGNALED != status && GL_CONDITION_SATISFIED != status)
+			break;
+
+		record_(float(1000.0 * (glfwGetTime() - frame.inputTime)));
+		glDeleteSync(frame.fence);
+		frame.fence = nullptr;
+		first = (first + 1) % kFences;
+		--count;
+	}
+}
+
+void FramePacing::record_(float latencyMs) {
+	stats.latencyMs = latencyMs;
+	++stats.measured;
+
+	window[windowNext] = latencyMs;
+	windowNext = (windowNext + 1) % kWindow;
+	windowCount = std::min(windowCount + 1, unsigned(kWindow));
+
+	float sum = 0.f, maximum = 0.f;
+	for (unsigned int i = 0; i < windowCount; ++i) {
+		sum += window[i];
+		maximum = std::max(maximum, window[i]);
+	}
+	stats.latencyAverageMs = sum / float(windowCount);
+	stats.latencyMaxMs = maximum;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad.h>
+
+enum class FramePacingMode { vsync, adaptive, capped, uncapped };
+constexpr int kFramePacingModeCount = 4;
+
+struct FramePacingStats {
+    float frameMs = 0.f;            // CPU, from the start of a frame to the next
+    float latencyMs = 0.f;          // input to GPU completion, last frame measured
+    float latencyAverageMs = 0.f;   // over the last kWindow frames measured
+    float latencyMaxMs = 0.f;       // likewise
+    unsigned int measured = 0;      // frames measured since startup
+    unsigned int missed = 0;        // frames whose fence had to be dropped
+    bool adaptiveSupported = false; // else adaptive is plain vsync
+};
+
+
+// Frame pacing, and input latency measurement.
+//
+// Modes:
+//  - vsync: swap interval 1.
+//  - adaptive: swap interval -1, so that frames that miss a refresh are
+//    shown at once (and tear) rather than a whole refresh late. Needs
+//    EXT_swap_control_tear; else as vsync.
+//  - capped: swap interval 0, and BeginFrame() sleeps so that frames start
+//    at most capFps times per second.
+//  - uncapped: swap interval 0.
+//
+// The latency is measured from when the input a frame was made from was
+// sampled (a glfwGetTime() marker, passed to EndFrame()) to when the GPU
+// finished the frame, including its presentation: EndFrame() inserts a
+// fence after the swap. The fences are polled without waiting at the start
+// and end of each frame, so a result may be late by up to the polling
+// interval. That is input to photon minus the display's scanout.
+class FramePacing {
+public:
+    static constexpr int kFences = 4;   // frames measured in flight
+    static constexpr int kWindow = 64;  // frames averaged
+
+    static const char* ModeName(FramePacingMode mode_);
+
+    // Needs a current context.
+    void SetMode(FramePacingMode mode_, float capFps_);
+    // Waits until the frame may start, if capped.
+    void BeginFrame();
+    // After the swap: inputTime is when the frame's input was sampled.
+    void EndFrame(double inputTime);
+    void Release();
+
+    FramePacingMode Mode() const { return mode; }
+    float CapFps() const { return capFps; }
+    const FramePacingStats& Stats() const { return stats; }
+
+private:
+    void poll_fences_();
+    void record_(float latencyMs);
+
+    FramePacingMode mode = FramePacingMode::vsync;
+    float capFps = 120.f;
+    double deadline = 0.0;      // capped: earliest start of the next frame
+    double frameStart = -1.0;
+
+    // Ring of fences, oldest at first
+    struct Pending {
+        GLsync fence = nullptr;
+        double inputTime = 0.0;
+    };
+    Pending pending[kFences];
+    unsigned int first = 0, count = 0;
+
+    float window[kWindow] = {};
+    unsigned int windowNext = 0, windowCount = 0;
+
+    FramePacingStats stats;
+};
@@ -0,0 +1,120 @@
+#include "FramePipeline.h"
+
+#include <chrono>
+
+#include "../support/error.hpp"
+#include "../support/profile.hpp"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	float elapsed_ms(Clock::time_point since) {
+		return std::chrono::duration<float, std::milli>(Clock::now() - since).count();
+	}
+}
+
+FramePipeline::~FramePipeline() {
+	// Errors of a job nobody waited for are dropped
+	try {
+		Stop();
+	}
+	catch (...) {
+	}
+}
+
+void FramePipeline::Kick(std::function<void()> job_) {
+	if (pending)
+		throw Error("FramePipeline: Kick() while a job is in flight; Wait() first");
+
+	if (!worker.joinable())
+		worker = std::thread(&FramePipeline::run_, this);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = std::move(job_);
+		done = false;
+	}
+	pending = true;
+	kicked.notify_one();
+}
+
+void FramePipeline::Wait() {
+	if (!pending)
+		return;
+
+	auto const start = Clock::now();
+	std::exception_ptr thrown;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this] { return done; });
+		stats.prepareMs = jobMs;
+		std::swap(thrown, error);
+	}
+	pending = false;
+	stats.threaded = true;
+	stats.waitMs = elapsed_ms(start);
+
+	if (thrown)
+		std::rethrow_exception(thrown);
+}
+
+void FramePipeline::Run(const std::function<void()>& job_) {
+	Wait();
+
+	auto const start = Clock::now();
+	job_();
+	stats.threaded = false;
+	stats.prepareMs = elapsed_ms(start);
+	stats.waitMs = 0.f;
+}
+
+void FramePipeline::Stop() {
+	if (!worker.joinable())
+		return;
+
+	std::exception_ptr thrown;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this] { return done; });
+		std::swap(thrown, error);
+		stopping = true;
+	}
+	kicked.notify_one();
+	worker.join();
+	pending = false;
+	stopping = false;
+
+	if (thrown)
+		std::rethrow_exception(thrown);
+}
+
+void FramePipeline::run_() {
+	profile_thread_name("frame preparation");
+
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		kicked.wait(lock, [this] { return stopping || !done; });
+		if (stopping)
+			return;
+
+		std::function<void()> current = std::move(job);
+		job = nullptr;
+		lock.unlock();
+
+		auto const start = Clock::now();
+		std::exception_ptr thrown;
+		try {
+			current();
+		}
+		catch (...) {
+			thrown = std::current_exception();
+		}
+		float const ms = elapsed_ms(start);
+
+		lock.lock();
+		jobMs = ms;
+		error = thrown;
+		done = true;
+		finished.notify_one();
+	}
+}
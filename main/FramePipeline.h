@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct FramePipelineStats {
+    bool threaded = false;      // last job ran on the worker
+    float prepareMs = 0.f;      // CPU, last job
+    float waitMs = 0.f;         // GL thread, blocked in the last Wait()
+};
+
+
+// Runs the preparation of the next frame on a worker thread while the GL
+// thread submits the current one.
+//
+// There is a single job in flight: Kick() hands it to the worker, Wait()
+// blocks until it has finished (and rethrows what it threw). Between the
+// two, the job owns whatever it prepares; the caller must not touch it, nor
+// any state the job reads or writes. In practice, the frame's data is
+// double-buffered (one copy being prepared, one being submitted), and the
+// scene is only changed by the job or while no job is running.
+//
+// Run() runs a job on the calling thread instead, with the same stats, for
+// when preparation can't overlap the submission.
+//
+// Usage:
+//    pipeline.Wait();                          // frame N + 1 is prepared
+//    ... poll events ...
+//    pipeline.Kick( [&]{ prepare( frames[next] ); } );
+//    submit( frames[current] );                // frame N + 1, meanwhile
+class FramePipeline {
+public:
+    FramePipeline() = default;
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    void Kick(std::function<void()> job_);
+    void Wait();
+    void Run(const std::function<void()>& job_);
+    // Waits for the job in flight, if any, and joins the worker.
+    void Stop();
+
+    // A job was kicked and not waited for yet
+    bool Pending() const { return pending; }
+    const FramePipelineStats& Stats() const { return stats; }
+
+private:
+    void run_();
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable kicked, finished;
+    std::function<void()> job;
+    bool pending = false;       // GL thread only
+    bool done = true;           // guarded by mutex
+    bool stopping = false;      // likewise
+    std::exception_ptr error;   // likewise
+    float jobMs = 0.f;          // likewise
+
+    FramePipelineStats stats;
+};
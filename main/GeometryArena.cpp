@@ -0,0 +1,264 @@
+#include "GeometryArena.h"
+
+#include <cassert>
+#include <algorithm>
+
+#include "Render.h"
+
+#include "../support/error.hpp"
+
+RangeAllocator::RangeAllocator(std::size_t capacity_) {
+	Grow(capacity_);
+}
+
+bool RangeAllocator::Allocate(std::size_t size, std::size_t& offset) {
+	if (0 == size) {
+		offset = 0;
+		return true;
+	}
+
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+		if (it->second < size)
+			continue;
+
+		offset = it->first;
+		std::size_t const remaining = it->second - size;
+		freeRanges.erase(it);
+		if (remaining)
+			freeRanges.emplace(offset + size, remaining);
+
+		used += size;
+		return true;
+	}
+
+	return false;
+}
+
+void RangeAllocator::Free(std::size_t offset, std::size_t size) {
+	if (0 == size)
+		return;
+
+	assert(offset + size <= capacity);
+	assert(used >= size);
+	used -= size;
+
+	auto next = freeRanges.lower_bound(offset);
+
+	// Merge with the following free range
+	if (next != freeRanges.end() && offset + size == next->first) {
+		size += next->second;
+		next = freeRanges.erase(next);
+	}
+
+	// Merge with the preceding free range
+	if (next != freeRanges.begin()) {
+		auto prev = std::prev(next);
+		assert(prev->first + prev->second <= offset);
+		if (prev->first + prev->second == offset) {
+			prev->second += size;
+			return;
+		}
+	}
+
+	freeRanges.emplace(offset, size);
+}
+
+void RangeAllocator::Grow(std::size_t capacity_) {
+	if (capacity_ <= capacity)
+		return;
+
+	std::size_t const oldCapacity = capacity;
+	capacity = capacity_;
+
+	// Free() expects the range to be in use.
+	used += capacity_ - oldCapacity;
+	Free(oldCapacity, capacity_ - oldCapacity);
+}
+
+
+GeometryArena& geometry_arena() {
+	static GeometryArena arena;
+	return arena;
+}
+
+GeometryAllocation GeometryArena::Allocate(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices) {
+	init_();
+
+	std::size_t vertexOffset = 0;
+	if (!vertexRanges.Allocate(vertices.size(), vertexOffset)) {
+		grow_vertices_(vertexRanges.Capacity() + vertices.size());
+		if (!vertexRanges.Allocate(vertices.size(), vertexOffset))
+			throw Error("GeometryArena: unable to allocate %zu vertices", vertices.size());
+	}
+
+	std::size_t indexOffset = 0;
+	if (!indexRanges.Allocate(indices.size(), indexOffset)) {
+		grow_indices_(indexRanges.Capacity() + indices.size());
+		if (!indexRanges.Allocate(indices.size(), indexOffset))
+			throw Error("GeometryArena: unable to allocate %zu indices", indices.size());
+	}
+
+	GeometryAllocation allocation;
+	allocation.baseVertex = static_cast<GLint>(vertexOffset);
+	allocation.vertexCount = static_cast<GLuint>(vertices.size());
+	allocation.firstIndex = static_cast<GLuint>(indexOffset);
+	allocation.indexCount = static_cast<GLuint>(indices.size());
+
+	// Indices stay relative to the mesh; draws pass the base vertex.
+	if (!vertices.empty()) {
+		std::vector<Vec3f> positions;
+		positions.reserve(vertices.size());
+		for (auto const& vertex : vertices)
+			positions.push_back(vertex.Position);
+
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * sizeof(Vertex), vertices.size() * sizeof(Vertex), vertices.data());
+		glBindBuffer(GL_ARRAY_BUFFER, positionVbo);
+		glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * sizeof(Vec3f), positions.size() * sizeof(Vec3f), positions.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	if (!indices.empty()) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	return allocation;
+}
+
+void GeometryArena::Free(const GeometryAllocation& allocation) {
+	vertexRanges.Free(static_cast<std::size_t>(allocation.baseVertex), allocation.vertexCount);
+	indexRanges.Free(allocation.firstIndex, allocation.indexCount);
+}
+
+GLuint GeometryArena::VAO() {
+	init_();
+	return vao;
+}
+
+GLuint GeometryArena::PositionVAO() {
+	init_();
+	return positionVao;
+}
+
+void GeometryArena::Release() {
+	if (0 != vao)
+		glDeleteVertexArrays(1, &vao);
+	if (0 != vbo)
+		glDeleteBuffers(1, &vbo);
+	if (0 != ebo)
+		glDeleteBuffers(1, &ebo);
+	if (0 != positionVao)
+		glDeleteVertexArrays(1, &positionVao);
+	if (0 != positionVbo)
+		glDeleteBuffers(1, &positionVbo);
+
+	vao = vbo = ebo = 0;
+	positionVao = positionVbo = 0;
+	vertexRanges = RangeAllocator();
+	indexRanges = RangeAllocator();
+}
+
+void GeometryArena::init_() {
+	if (0 != vao)
+		return;
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glGenBuffers(1, &ebo);
+	glGenVertexArrays(1, &positionVao);
+	glGenBuffers(1, &positionVbo);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, kInitialVertices * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, positionVbo);
+	glBufferData(GL_ARRAY_BUFFER, kInitialVertices * sizeof(Vec3f), nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+	glBufferData(GL_COPY_WRITE_BUFFER, kInitialIndices * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	vertexRanges = RangeAllocator(kInitialVertices);
+	indexRanges = RangeAllocator(kInitialIndices);
+
+	setup_vao_();
+}
+
+namespace
+{
+	// Copies the contents of aBuffer into a new, larger buffer and returns it.
+	// The old buffer is deleted.
+	GLuint grow_buffer_(GLuint aBuffer, std::size_t aOldBytes, std::size_t aNewBytes)
+	{
+		GLuint buffer = 0;
+		glGenBuffers(1, &buffer);
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, aNewBytes, nullptr, GL_STATIC_DRAW);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, aBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, aOldBytes);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		glDeleteBuffers(1, &aBuffer);
+		return buffer;
+	}
+}
+
+void GeometryArena::grow_vertices_(std::size_t minimum) {
+	std::size_t const oldCapacity = vertexRanges.Capacity();
+	std::size_t const capacity = std::max(minimum, 2 * oldCapacity);
+
+	vbo = grow_buffer_(vbo, oldCapacity * sizeof(Vertex), capacity * sizeof(Vertex));
+	positionVbo = grow_buffer_(positionVbo, oldCapacity * sizeof(Vec3f), capacity * sizeof(Vec3f));
+	vertexRanges.Grow(capacity);
+	setup_vao_();
+}
+
+void GeometryArena::grow_indices_(std::size_t minimum) {
+	std::size_t const oldCapacity = indexRanges.Capacity();
+	std::size_t const capacity = std::max(minimum, 2 * oldCapacity);
+
+	ebo = grow_buffer_(ebo, oldCapacity * sizeof(GLuint), capacity * sizeof(GLuint));
+	indexRanges.Grow(capacity);
+	setup_vao_();
+}
+
+void GeometryArena::setup_vao_() {
+	glBindVertexArray(vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+
+	// vertex Positions
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	// vertex Normals
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+	// vertex Texture coordinates
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	// per-instance index
+	glBindBuffer(GL_ARRAY_BUFFER, instance_index_buffer());
+	glEnableVertexAttribArray(kInstanceIndexAttrib);
+	glVertexAttribIPointer(kInstanceIndexAttrib, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+	glVertexAttribDivisor(kInstanceIndexAttrib, 1);
+
+	// Same, with positions only
+	glBindVertexArray(positionVao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBindBuffer(GL_ARRAY_BUFFER, positionVbo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3f), (void*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_index_buffer());
+	glEnableVertexAttribArray(kInstanceIndexAttrib);
+	glVertexAttribIPointer(kInstanceIndexAttrib, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+	glVertexAttribDivisor(kInstanceIndexAttrib, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
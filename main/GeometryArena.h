@@ -0,0 +1,90 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <cstddef>
+
+#include <glad.h>
+
+struct Vertex;
+
+// First-fit free list over the range [0, capacity). Free ranges are kept
+// sorted by offset so that neighbouring ranges can be coalesced when an
+// allocation is returned.
+class RangeAllocator {
+public:
+    explicit RangeAllocator(std::size_t capacity = 0);
+
+    // Returns false if there is no free range large enough.
+    bool Allocate(std::size_t size, std::size_t& offset);
+    void Free(std::size_t offset, std::size_t size);
+
+    // Appends [Capacity(), capacity) to the free list.
+    void Grow(std::size_t capacity);
+
+    std::size_t Capacity() const { return capacity; }
+    std::size_t Used() const { return used; }
+
+private:
+    std::map<std::size_t, std::size_t> freeRanges; // offset -> size
+    std::size_t capacity = 0;
+    std::size_t used = 0;
+};
+
+
+// Location of one mesh in the geometry arena.
+struct GeometryAllocation {
+    GLint baseVertex = 0;
+    GLuint vertexCount = 0;
+    GLuint firstIndex = 0;
+    GLuint indexCount = 0;
+};
+
+
+// Global geometry arena: a single vertex buffer and a single index buffer
+// that all meshes are sub-allocated from, and the one VAO that describes them.
+// Meshes are drawn with their base vertex and first index, so switching
+// between meshes no longer requires a VAO switch, and the whole scene can be
+// submitted with a single multi-draw.
+//
+// Vertex positions are also stored in a second, tightly packed buffer (12
+// bytes per vertex instead of 32) at the same offsets, described by
+// PositionVAO(), for depth-only passes: they read less than half the vertex
+// data, and draws need no changes as meshes keep their base vertex and first
+// index.
+//
+// The buffers grow (by copying into larger buffers) when they run out of
+// space.
+class GeometryArena {
+public:
+    GeometryAllocation Allocate(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+    void Free(const GeometryAllocation& allocation);
+
+    GLuint VAO();
+    // Position (attribute 0) and per-instance index only
+    GLuint PositionVAO();
+    void Release();
+
+    std::size_t VertexCapacity() const { return vertexRanges.Capacity(); }
+    std::size_t IndexCapacity() const { return indexRanges.Capacity(); }
+
+    static constexpr std::size_t kInitialVertices = 1u << 18;
+    static constexpr std::size_t kInitialIndices = 1u << 18;
+
+private:
+    void init_();
+    void grow_vertices_(std::size_t minimum);
+    void grow_indices_(std::size_t minimum);
+    void setup_vao_();
+
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    GLuint positionVao = 0;
+    GLuint positionVbo = 0;
+
+    RangeAllocator vertexRanges;
+    RangeAllocator indexRanges;
+};
+
+GeometryArena& geometry_arena();
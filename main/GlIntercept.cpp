@@ -0,0 +1,337 @@
+#include "GlIntercept.h"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include "../support/error.hpp"
+
+// The entry points wrapped: those this program calls. Add new ones here.
+#define GL_INTERCEPT_ENTRIES(X) \
+	X(glActiveTexture) X(glAttachShader) X(glBeginConditionalRender) X(glBeginQuery) \
+	X(glBindBuffer) X(glBindBufferBase) X(glBindBufferRange) X(glBindFramebuffer) \
+	X(glBindImageTexture) X(glBindTexture) X(glBindVertexArray) X(glBlitFramebuffer) \
+	X(glBufferData) X(glBufferStorage) X(glBufferSubData) X(glCheckFramebufferStatus) \
+	X(glClear) X(glClientWaitSync) X(glColorMask) X(glCompileShader) \
+	X(glCopyBufferSubData) X(glCopyImageSubData) X(glCreateProgram) X(glCreateShader) \
+	X(glDebugMessageCallback) X(glDebugMessageControl) X(glDeleteBuffers) X(glDeleteFramebuffers) \
+	X(glDeleteProgram) X(glDeleteQueries) X(glDeleteShader) X(glDeleteSync) \
+	X(glDeleteTextures) X(glDeleteVertexArrays) X(glDepthFunc) X(glDepthMask) \
+	X(glDisable) X(glDispatchCompute) X(glDrawArrays) X(glDrawBuffer) \
+	X(glDrawBuffers) X(glDrawElements) X(glDrawElementsInstancedBaseVertexBaseInstance) X(glEnable) \
+	X(glEnableVertexAttribArray) X(glEndConditionalRender) X(glEndQuery) X(glFenceSync) \
+	X(glFramebufferTexture2D) X(glFramebufferTextureLayer) X(glGenBuffers) X(glGenFramebuffers) \
+	X(glGenQueries) X(glGenTextures) X(glGenVertexArrays) X(glGenerateMipmap) \
+	X(glGetBufferSubData) X(glGetError) X(glGetIntegerv) X(glGetProgramInfoLog) \
+	X(glGetProgramiv) X(glGetQueryObjectui64v) X(glGetQueryObjectuiv) X(glGetShaderInfoLog) \
+	X(glGetShaderiv) X(glGetString) X(glGetStringi) X(glGetTexLevelParameteriv) \
+	X(glGetUniformLocation) X(glIsEnabled) X(glLinkProgram) X(glMapBufferRange) \
+	X(glMemoryBarrier) X(glMultiDrawElementsIndirect) X(glPixelStorei) X(glPolygonMode) \
+	X(glPolygonOffset) X(glPopDebugGroup) X(glPushDebugGroup) X(glQueryCounter) \
+	X(glReadBuffer) X(glReadPixels) X(glShaderSource) X(glTexImage2D) \
+	X(glTexParameterf) X(glTexParameterfv) X(glTexParameteri) X(glTexStorage2D) \
+	X(glTexStorage3D) X(glUniform1f) X(glUniform1i) X(glUniform1ui) \
+	X(glUniform2f) X(glUniform2fv) X(glUniform2i) X(glUniform3f) \
+	X(glUniform3fv) X(glUniform4f) X(glUniform4fv) X(glUniformMatrix2fv) \
+	X(glUniformMatrix3fv) X(glUniformMatrix4fv) X(glUseProgram) X(glVertexAttribDivisor) \
+	X(glVertexAttribIPointer) X(glVertexAttribPointer) X(glViewport)
+
+namespace {
+	enum Entry {
+#		define GL_INTERCEPT_ENUM(name) name##Entry,
+		GL_INTERCEPT_ENTRIES(GL_INTERCEPT_ENUM)
+#		undef GL_INTERCEPT_ENUM
+		kEntryCount
+	};
+
+	const char* const kEntryNames[kEntryCount] = {
+#		define GL_INTERCEPT_NAME(name) #name,
+		GL_INTERCEPT_ENTRIES(GL_INTERCEPT_NAME)
+#		undef GL_INTERCEPT_NAME
+	};
+
+	// This frame's, reset by GlIntercept::EndFrame()
+	struct Counters {
+		unsigned int calls[kEntryCount];
+		unsigned int redundant[kEntryCount];
+	} counters;
+
+	bool installed = false;
+
+	// State as last set through the wrappers; unknown until then, or after
+	// something may have changed it behind our back (deleting bound objects)
+	template< typename tValue >
+	struct Shadow {
+		tValue value{};
+		bool known = false;
+
+		// Whether it already was value
+		bool Set(tValue const& value_) {
+			bool const same = known && value == value_;
+			value = value_;
+			known = true;
+			return same;
+		}
+		void Forget() { known = false; }
+	};
+
+	constexpr int kTextureUnits = 32;
+	constexpr GLenum kTextureTargets[] = {
+		GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_MULTISAMPLE
+	};
+	constexpr GLenum kBufferTargets[] = {
+		GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER,
+		GL_DRAW_INDIRECT_BUFFER, GL_DISPATCH_INDIRECT_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+		GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_QUERY_BUFFER, GL_ATOMIC_COUNTER_BUFFER
+	};
+	constexpr GLenum kCapabilities[] = {
+		GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_POLYGON_OFFSET_FILL, GL_SCISSOR_TEST, GL_STENCIL_TEST,
+		GL_FRAMEBUFFER_SRGB, GL_DEPTH_CLAMP, GL_RASTERIZER_DISCARD, GL_PROGRAM_POINT_SIZE,
+		GL_DEBUG_OUTPUT, GL_DEBUG_OUTPUT_SYNCHRONOUS
+	};
+	constexpr int kTextureTargetCount = int(sizeof(kTextureTargets) / sizeof(kTextureTargets[0]));
+	constexpr int kBufferTargetCount = int(sizeof(kBufferTargets) / sizeof(kBufferTargets[0]));
+	constexpr int kCapabilityCount = int(sizeof(kCapabilities) / sizeof(kCapabilities[0]));
+
+	template< std::size_t tCount >
+	int find(GLenum const (&values)[tCount], GLenum value) {
+		for (std::size_t i = 0; i < tCount; ++i) {
+			if (values[i] == value)
+				return int(i);
+		}
+		return -1;
+	}
+
+	struct State {
+		Shadow<GLuint> program, vertexArray, drawFramebuffer, readFramebuffer;
+		Shadow<GLenum> activeTexture, polygonMode, depthFunc;
+		Shadow<GLboolean> depthMask;
+		Shadow<std::array<GLboolean, 4>> colorMask;
+		Shadow<std::array<GLint, 4>> viewport;
+		Shadow<std::pair<GLfloat, GLfloat>> polygonOffset;
+		Shadow<GLuint> textures[kTextureUnits][kTextureTargetCount];
+		Shadow<GLuint> buffers[kBufferTargetCount];
+		Shadow<bool> capabilities[kCapabilityCount];
+
+		void ForgetTextures() {
+			for (auto& unit : textures) {
+				for (auto& texture : unit)
+					texture.Forget();
+			}
+		}
+		void ForgetBuffers() {
+			for (auto& buffer : buffers)
+				buffer.Forget();
+		}
+		Shadow<GLuint>* Buffer(GLenum target) {
+			int const index = find(kBufferTargets, target);
+			return index < 0 ? nullptr : &buffers[index];
+		}
+		Shadow<bool>* Capability(GLenum cap) {
+			int const index = find(kCapabilities, cap);
+			return index < 0 ? nullptr : &capabilities[index];
+		}
+	} state;
+
+	// Whether a call sets state to what it already was. Only for the
+	// entry points specialized below; the others are just counted.
+	template< int tEntry >
+	struct Track {
+		template< typename... tArgs >
+		static bool Redundant(tArgs...) { return false; }
+	};
+
+	template<> struct Track<glUseProgramEntry> {
+		static bool Redundant(GLuint program) { return state.program.Set(program); }
+	};
+	template<> struct Track<glBindVertexArrayEntry> {
+		static bool Redundant(GLuint array) {
+			// The element array buffer binding is the vertex array's
+			if (Shadow<GLuint>* elements = state.Buffer(GL_ELEMENT_ARRAY_BUFFER))
+				elements->Forget();
+			return state.vertexArray.Set(array);
+		}
+	};
+	template<> struct Track<glActiveTextureEntry> {
+		static bool Redundant(GLenum texture) { return state.activeTexture.Set(texture); }
+	};
+	template<> struct Track<glBindTextureEntry> {
+		static bool Redundant(GLenum target, GLuint texture) {
+			int const unit = state.activeTexture.known ? int(state.activeTexture.value - GL_TEXTURE0) : -1;
+			int const index = find(kTextureTargets, target);
+			if (unit < 0 || unit >= kTextureUnits || index < 0)
+				return false;
+			return state.textures[unit][index].Set(texture);
+		}
+	};
+	template<> struct Track<glBindFramebufferEntry> {
+		static bool Redundant(GLenum target, GLuint framebuffer) {
+			if (GL_DRAW_FRAMEBUFFER == target)
+				return state.drawFramebuffer.Set(framebuffer);
+			if (GL_READ_FRAMEBUFFER == target)
+				return state.readFramebuffer.Set(framebuffer);
+			bool const draw = state.drawFramebuffer.Set(framebuffer);
+			bool const read = state.readFramebuffer.Set(framebuffer);
+			return draw && read;
+		}
+	};
+	template<> struct Track<glBindBufferEntry> {
+		static bool Redundant(GLenum target, GLuint buffer) {
+			Shadow<GLuint>* shadow = state.Buffer(target);
+			return shadow && shadow->Set(buffer);
+		}
+	};
+	// Also bind the generic binding point; not redundant, as the indexed
+	// one isn't tracked
+	template<> struct Track<glBindBufferBaseEntry> {
+		static bool Redundant(GLenum target, GLuint, GLuint buffer) {
+			if (Shadow<GLuint>* shadow = state.Buffer(target))
+				shadow->Set(buffer);
+			return false;
+		}
+	};
+	template<> struct Track<glBindBufferRangeEntry> {
+		static bool Redundant(GLenum target, GLuint, GLuint buffer, GLintptr, GLsizeiptr) {
+			if (Shadow<GLuint>* shadow = state.Buffer(target))
+				shadow->Set(buffer);
+			return false;
+		}
+	};
+	// Core profiles only have GL_FRONT_AND_BACK
+	template<> struct Track<glPolygonModeEntry> {
+		static bool Redundant(GLenum, GLenum mode) { return state.polygonMode.Set(mode); }
+	};
+	template<> struct Track<glEnableEntry> {
+		static bool Redundant(GLenum cap) {
+			Shadow<bool>* shadow = state.Capability(cap);
+			return shadow && shadow->Set(true);
+		}
+	};
+	template<> struct Track<glDisableEntry> {
+		static bool Redundant(GLenum cap) {
+			Shadow<bool>* shadow = state.Capability(cap);
+			return shadow && shadow->Set(false);
+		}
+	};
+	template<> struct Track<glDepthFuncEntry> {
+		static bool Redundant(GLenum func) { return state.depthFunc.Set(func); }
+	};
+	template<> struct Track<glDepthMaskEntry> {
+		static bool Redundant(GLboolean flag) { return state.depthMask.Set(flag); }
+	};
+	template<> struct Track<glColorMaskEntry> {
+		static bool Redundant(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {
+			return state.colorMask.Set({ red, green, blue, alpha });
+		}
+	};
+	template<> struct Track<glViewportEntry> {
+		static bool Redundant(GLint x, GLint y, GLsizei width, GLsizei height) {
+			return state.viewport.Set({ x, y, width, height });
+		}
+	};
+	template<> struct Track<glPolygonOffsetEntry> {
+		static bool Redundant(GLfloat factor, GLfloat units) { return state.polygonOffset.Set({ factor, units }); }
+	};
+	// Deleting bound objects unbinds them
+	template<> struct Track<glDeleteTexturesEntry> {
+		static bool Redundant(GLsizei, const GLuint*) { state.ForgetTextures(); return false; }
+	};
+	template<> struct Track<glDeleteBuffersEntry> {
+		static bool Redundant(GLsizei, const GLuint*) { state.ForgetBuffers(); return false; }
+	};
+	template<> struct Track<glDeleteVertexArraysEntry> {
+		static bool Redundant(GLsizei, const GLuint*) {
+			state.vertexArray.Forget();
+			if (Shadow<GLuint>* elements = state.Buffer(GL_ELEMENT_ARRAY_BUFFER))
+				elements->Forget();
+			return false;
+		}
+	};
+	template<> struct Track<glDeleteFramebuffersEntry> {
+		static bool Redundant(GLsizei, const GLuint*) {
+			state.drawFramebuffer.Forget();
+			state.readFramebuffer.Forget();
+			return false;
+		}
+	};
+
+	// The wrapper of an entry point, and the driver's function it calls
+	template< int tEntry, typename tPointer >
+	struct Hook;
+
+	template< int tEntry, typename tResult, typename... tArgs >
+	struct Hook<tEntry, tResult (APIENTRYP)(tArgs...)> {
+		static inline tResult (APIENTRYP original)(tArgs...) = nullptr;
+
+		static tResult APIENTRY Call(tArgs... args) {
+			++counters.calls[tEntry];
+			if (Track<tEntry>::Redundant(args...))
+				++counters.redundant[tEntry];
+			return original(args...);
+		}
+	};
+
+	// Entry points the context lacks are left null
+	template< int tEntry, typename tPointer >
+	void install(tPointer& pointer) {
+		if (!pointer)
+			return;
+		Hook<tEntry, tPointer>::original = pointer;
+		pointer = &Hook<tEntry, tPointer>::Call;
+	}
+
+	std::vector<GlInterceptEntry> top(std::vector<GlInterceptEntry> entries, std::size_t count, bool redundant) {
+		auto const key = [redundant](GlInterceptEntry const& entry) { return redundant ? entry.redundant : entry.calls; };
+		entries.erase(std::remove_if(entries.begin(), entries.end(), [&key](GlInterceptEntry const& entry) { return 0 == key(entry); }), entries.end());
+		std::stable_sort(entries.begin(), entries.end(), [&key](GlInterceptEntry const& a, GlInterceptEntry const& b) { return key(a) > key(b); });
+		if (entries.size() > count)
+			entries.resize(count);
+		return entries;
+	}
+}
+
+void GlIntercept::Install() {
+	if (installed)
+		return;
+	if (::installed)
+		throw Error("GlIntercept: another one is installed already");
+
+#	define GL_INTERCEPT_INSTALL(name) install<name##Entry>(glad_##name);
+	GL_INTERCEPT_ENTRIES(GL_INTERCEPT_INSTALL)
+#	undef GL_INTERCEPT_INSTALL
+
+	counters = Counters{};
+	lastFrame.resize(kEntryCount);
+	total.resize(kEntryCount);
+	for (int i = 0; i < kEntryCount; ++i)
+		lastFrame[i].name = total[i].name = kEntryNames[i];
+
+	installed = ::installed = true;
+}
+
+void GlIntercept::EndFrame() {
+	if (!installed)
+		return;
+
+	stats.calls = stats.redundant = 0;
+	for (int i = 0; i < kEntryCount; ++i) {
+		lastFrame[i].calls = counters.calls[i];
+		lastFrame[i].redundant = counters.redundant[i];
+		total[i].calls += counters.calls[i];
+		total[i].redundant += counters.redundant[i];
+		stats.calls += counters.calls[i];
+		stats.redundant += counters.redundant[i];
+	}
+	stats.totalCalls += stats.calls;
+	stats.totalRedundant += stats.redundant;
+	++stats.frames;
+	counters = Counters{};
+}
+
+std::vector<GlInterceptEntry> GlIntercept::TopCalls(std::size_t count, bool total_) const {
+	return top(total_ ? total : lastFrame, count, false);
+}
+
+std::vector<GlInterceptEntry> GlIntercept::TopRedundant(std::size_t count, bool total_) const {
+	return top(total_ ? total : lastFrame, count, true);
+}
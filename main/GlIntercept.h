@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glad.h>
+
+struct GlInterceptEntry {
+    const char* name = nullptr;     // "glUseProgram"
+    unsigned long long calls = 0;
+    unsigned long long redundant = 0;   // set state to what it already was
+};
+
+struct GlInterceptStats {
+    unsigned int frames = 0;        // ended since Install()
+    unsigned int calls = 0;         // last frame, all entry points
+    unsigned int redundant = 0;     // likewise
+    unsigned long long totalCalls = 0;
+    unsigned long long totalRedundant = 0;
+};
+
+
+// GL call interception. Install() swaps glad's function pointers (which
+// every gl*() call goes through) for wrappers that count the calls per
+// entry point, then call the driver. The wrappers of state-setting entry
+// points also shadow the state, and count the calls that set it to what it
+// already was: the same program, vertex array, framebuffer, buffer or
+// texture rebound, the same capability enabled, glPolygonMode() or
+// glDepthMask() set again, and so on. Only the entry points this program
+// uses are wrapped (see the list in GlIntercept.cpp); others aren't counted.
+//
+// Not installed, glad's pointers are left alone, so there is no cost at
+// all; hence it can only be switched on at startup. Wrappers count without
+// synchronisation: GL calls must come from one thread (the one the context
+// is current on, as they must anyway).
+//
+// Counts roll over per frame (EndFrame()), and also add up since Install().
+//
+// Usage:
+//    gladLoadGLLoader( ... );
+//    intercept.Install();
+//    ... frame's GL calls ...
+//    intercept.EndFrame();
+//    intercept.TopRedundant( 5, false );   // last frame's worst offenders
+class GlIntercept {
+public:
+    // After glad has loaded the GL API. Once; one GlIntercept at a time.
+    void Install();
+    bool Installed() const { return installed; }
+
+    void EndFrame();
+
+    // Entry points called, most calls first; the last frame's, or since
+    // Install().
+    std::vector<GlInterceptEntry> TopCalls(std::size_t count, bool total) const;
+    // Entry points with redundant calls, most redundant first.
+    std::vector<GlInterceptEntry> TopRedundant(std::size_t count, bool total) const;
+
+    const GlInterceptStats& Stats() const { return stats; }
+
+private:
+    bool installed = false;
+    std::vector<GlInterceptEntry> lastFrame;
+    std::vector<GlInterceptEntry> total;
+    GlInterceptStats stats;
+};
@@ -0,0 +1,313 @@
+#include "GpuCulling.h"
+
+#include <algorithm>
+
+#include "Bounds.h"
+#include "DepthPrepass.h"
+
+void GpuCulling::Build(const SceneStorage& scene, IndirectRenderer& tables) {
+	init_();
+
+	// One command per mesh. Each command owns a range of the instance buffer
+	// large enough to hold all of the mesh's objects.
+	std::vector<GLuint> commandOfMesh;
+	commands.clear();
+	for (std::uint32_t mesh : scene.Meshes()) {
+		RenderObject const* ro = scene.Mesh(mesh);
+		if (ro->id >= commandOfMesh.size())
+			commandOfMesh.resize(ro->id + 1, ~GLuint(0));
+
+		if (~GLuint(0) == commandOfMesh[ro->id]) {
+			commandOfMesh[ro->id] = static_cast<GLuint>(commands.size());
+
+			DrawElementsIndirectCommand command;
+			command.count = ro->geometry.indexCount;
+			command.instanceCount = 0;
+			command.firstIndex = ro->geometry.firstIndex;
+			command.baseVertex = ro->geometry.baseVertex;
+			command.baseInstance = 0;
+			commands.push_back(command);
+		}
+
+		++commands[commandOfMesh[ro->id]].instanceCount;
+	}
+
+	GLuint first = 0;
+	for (auto& command : commands) {
+		command.baseInstance = first;
+		first += command.instanceCount;
+		command.instanceCount = 0;
+	}
+
+	objects.clear();
+	objects.reserve(scene.Size());
+	for (std::size_t i = 0; i < scene.Size(); ++i) {
+		RenderObject const* ro = scene.Mesh(scene.Meshes()[i]);
+
+		CullObject object;
+		object.model = scene.Transforms()[i];
+		object.material = tables.MaterialIndex(scene.Material(scene.Materials()[i]));
+		object.layer = tables.TextureLayer(scene.Textures()[i]);
+		object.command = commandOfMesh[ro->id];
+		object.pad = 0;
+		object.boundsMin = Vec4f{ ro->bounds.min.x, ro->bounds.min.y, ro->bounds.min.z, 1.f };
+		object.boundsMax = Vec4f{ ro->bounds.max.x, ro->bounds.max.y, ro->bounds.max.z, 1.f };
+		objects.push_back(object);
+	}
+
+	std::size_t const objectBytes = std::max<std::size_t>(objects.size(), 1) * sizeof(CullObject);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, objectBytes, nullptr, GL_DYNAMIC_DRAW);
+	if (!objects.empty())
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, objects.size() * sizeof(CullObject), objects.data());
+
+	// Everything starts out visible
+	std::vector<GLuint> const visibility(std::max<std::size_t>(objects.size(), 1), 1u);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, visibility.size() * sizeof(GLuint), visibility.data(), GL_DYNAMIC_COPY);
+
+	std::size_t const instanceBytes = std::max<std::size_t>(objects.size(), 1) * sizeof(InstanceData);
+	std::size_t const commandBytes = std::max<std::size_t>(commands.size(), 1) * sizeof(DrawElementsIndirectCommand);
+	for (int set = 0; set < 2; ++set) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffers[set]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, instanceBytes, nullptr, GL_DYNAMIC_COPY);
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffers[set]);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commandBytes, nullptr, GL_DYNAMIC_DRAW);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	dirtyBegin = dirtyEnd = 0;
+
+	stats.objects = static_cast<unsigned int>(objects.size());
+	stats.commands = static_cast<unsigned int>(commands.size());
+}
+
+void GpuCulling::UpdateTransform(std::size_t object, const Mat44f& world) {
+	objects[object].model = world;
+
+	if (dirtyBegin == dirtyEnd) {
+		dirtyBegin = object;
+		dirtyEnd = object + 1;
+	}
+	else {
+		dirtyBegin = std::min(dirtyBegin, object);
+		dirtyEnd = std::max(dirtyEnd, object + 1);
+	}
+}
+
+void GpuCulling::Submit(Shader& shader, IndirectRenderer& tables, const Mat44f& viewProjection,
+	const RenderTarget* occlusionTarget, DepthPrepass* prepass) {
+	init_();
+	collect_results_();
+
+	if (objects.empty())
+		return;
+
+	// Upload changed objects only
+	stats.uploadedObjects = static_cast<unsigned int>(dirtyEnd - dirtyBegin);
+	if (dirtyBegin != dirtyEnd) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+			dirtyBegin * sizeof(CullObject),
+			(dirtyEnd - dirtyBegin) * sizeof(CullObject),
+			objects.data() + dirtyBegin
+		);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		dirtyBegin = dirtyEnd = 0;
+	}
+
+	bool const occlusion = nullptr != occlusionTarget;
+
+	// Reset the instance counts of the commands
+	for (int set = 0; set < (occlusion ? 2 : 1); ++set) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffers[set]);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	Frame& frame = frames[frameIndex];
+	frameIndex = (frameIndex + 1) % kLatency;
+	if (frame.fence) {
+		// Results of this slot were never collected; drop them.
+		glDeleteSync(frame.fence);
+		frame.fence = nullptr;
+	}
+	frame.occlusion = occlusion;
+
+	GLuint const zeros[3] = {};
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, frame.counter);
+	glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(zeros), zeros);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+	// Culling pass
+	Frustum const frustum = make_frustum(viewProjection);
+
+	glUseProgram(program->programId());
+	glUniform4fv(frustumPlanesLocation, 6, &frustum.planes[0].x);
+	glUniform1ui(objectCountLocation, static_cast<GLuint>(objects.size()));
+	glUniformMatrix4fv(viewProjectionLocation, 1, GL_TRUE, viewProjection.v);
+	glUniform1i(hizLocation, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, objectBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, visibilityBuffer);
+	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, frame.counter);
+
+	glBeginQuery(GL_TIME_ELAPSED, frame.timers[kCullTimer]);
+	cull_(occlusion ? 1 : 0, 0);
+	glEndQuery(GL_TIME_ELAPSED);
+
+	// Draw whatever survived
+	draw_(shader, tables, 0, prepass);
+
+	if (occlusion) {
+		// Reduce the depth drawn so far, then test everything against it
+		glBeginQuery(GL_TIME_ELAPSED, frame.timers[kHizTimer]);
+		hiz.Build(occlusionTarget->DepthTexture(), occlusionTarget->Width(), occlusionTarget->Height());
+		glEndQuery(GL_TIME_ELAPSED);
+
+		glUseProgram(program->programId());
+		glUniform1i(hizLevelsLocation, hiz.Levels());
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, hiz.Texture());
+
+		glBeginQuery(GL_TIME_ELAPSED, frame.timers[kLateCullTimer]);
+		cull_(2, 1);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		draw_(shader, tables, 1, prepass);
+	}
+
+	frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void GpuCulling::cull_(GLuint phase, int set) {
+	glUniform1ui(phaseLocation, phase);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffers[set]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commandBuffers[set]);
+
+	glDispatchCompute(static_cast<GLuint>((objects.size() + 63) / 64), 1, 1);
+
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void GpuCulling::draw_(Shader& shader, IndirectRenderer& tables, int set, DepthPrepass* prepass) {
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffers[set]);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffers[set]);
+
+	if (prepass) {
+		prepass->BeginDepth();
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(commands.size()), 0);
+		prepass->BeginShading();
+	}
+
+	tables.BindResources(shader);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(commands.size()), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	if (prepass)
+		prepass->End();
+}
+
+void GpuCulling::Release() {
+	for (auto& frame : frames) {
+		if (frame.fence)
+			glDeleteSync(frame.fence);
+		if (0 != frame.counter)
+			glDeleteBuffers(1, &frame.counter);
+		if (0 != frame.timers[0])
+			glDeleteQueries(kTimerCount, frame.timers);
+		frame = Frame{};
+	}
+
+	for (GLuint* buffer : { &objectBuffer, &visibilityBuffer,
+		&commandBuffers[0], &commandBuffers[1], &instanceBuffers[0], &instanceBuffers[1] }) {
+		if (0 != *buffer)
+			glDeleteBuffers(1, buffer);
+		*buffer = 0;
+	}
+
+	hiz.Release();
+	program.reset();
+	objects.clear();
+	commands.clear();
+}
+
+void GpuCulling::init_() {
+	if (program)
+		return;
+
+	program = std::make_unique<ShaderProgram>(std::vector<ShaderProgram::ShaderSource>{
+		{ GL_COMPUTE_SHADER, "assets/cs_cull.glsl" }
+	});
+	frustumPlanesLocation = glGetUniformLocation(program->programId(), "frustumPlanes");
+	objectCountLocation = glGetUniformLocation(program->programId(), "objectCount");
+	phaseLocation = glGetUniformLocation(program->programId(), "phase");
+	viewProjectionLocation = glGetUniformLocation(program->programId(), "viewProjection");
+	hizLocation = glGetUniformLocation(program->programId(), "hiz");
+	hizLevelsLocation = glGetUniformLocation(program->programId(), "hizLevels");
+
+	glGenBuffers(1, &objectBuffer);
+	glGenBuffers(1, &visibilityBuffer);
+	glGenBuffers(2, commandBuffers);
+	glGenBuffers(2, instanceBuffers);
+
+	for (auto& frame : frames) {
+		glGenBuffers(1, &frame.counter);
+		glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, frame.counter);
+		glBufferData(GL_ATOMIC_COUNTER_BUFFER, 3 * sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+		glGenQueries(kTimerCount, frame.timers);
+	}
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+}
+
+void GpuCulling::collect_results_() {
+	// Read back results of earlier frames that have finished on the GPU,
+	// without waiting for the ones that haven't.
+	// Oldest first, so that the newest available result wins.
+	for (int i = 0; i < kLatency; ++i) {
+		Frame& frame = frames[(frameIndex + i) % kLatency];
+		if (!frame.fence)
+			continue;
+
+		GLenum const status = glClientWaitSync(frame.fence, 0, 0);
+		if (GL_ALREADY_SIGNALED != status && GL_CONDITION_SATISFIED != status)
+			continue;
+
+		glDeleteSync(frame.fence);
+		frame.fence = nullptr;
+
+		GLuint counters[3] = {};
+		glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, frame.counter);
+		glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(counters), counters);
+		glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+		stats.visible = counters[0] + counters[1];
+		stats.lateVisible = counters[1];
+		stats.occluded = counters[2];
+
+		auto elapsed_ms = [](GLuint query) {
+			GLuint available = GL_FALSE;
+			glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (GL_TRUE != available)
+				return 0.f;
+
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			return float(elapsed) / 1e6f;
+		};
+
+		stats.cullTimeMs = elapsed_ms(frame.timers[kCullTimer]);
+		stats.hizTimeMs = 0.f;
+		if (frame.occlusion) {
+			stats.cullTimeMs += elapsed_ms(frame.timers[kLateCullTimer]);
+			stats.hizTimeMs = elapsed_ms(frame.timers[kHizTimer]);
+		}
+	}
+}
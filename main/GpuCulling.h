@@ -0,0 +1,113 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Render.h"
+#include "IndirectRenderer.h"
+#include "RenderTarget.h"
+#include "HiZ.h"
+
+class DepthPrepass;
+
+#include "../support/program.hpp"
+
+// Per-object record read by cs_cull.glsl (std430).
+struct CullObject {
+    Mat44f model;
+    GLuint material;
+    GLuint layer;
+    GLuint command;
+    GLuint pad;
+    Vec4f boundsMin;
+    Vec4f boundsMax;
+};
+
+struct GpuCullingStats {
+    unsigned int objects = 0;
+    unsigned int commands = 0;
+    unsigned int uploadedObjects = 0;
+    // Results of the culling pass are read back a few frames late (see
+    // kLatency), so that reading them never stalls.
+    unsigned int visible = 0;
+    unsigned int lateVisible = 0;   // drawn in the second occlusion phase
+    unsigned int occluded = 0;      // in the frustum, but hidden in the Hi-Z
+    float cullTimeMs = 0.f;
+    float hizTimeMs = 0.f;
+};
+
+
+// GPU-driven frustum culling for the indirect draw path.
+//
+// Objects (world transform, local bounds, material index, texture layer and
+// the indirect command of their mesh) are kept in an SSBO that is only
+// updated for objects whose transform changed. Each frame, a compute pass
+// (cs_cull.glsl) tests every object against the view frustum and appends the
+// visible ones to their command's instance range, counting instances with
+// atomics. The multi-draw then consumes the commands directly, so the CPU
+// does no per-object work for static objects.
+//
+// Optionally, objects are also occlusion culled against a Hi-Z pyramid of the
+// scene's depth, in two phases (see cs_cull.glsl): objects visible last frame
+// are drawn first, their depth is reduced into the pyramid, and everything
+// else is tested against it and drawn if visible. This needs the scene to be
+// rendered into a RenderTarget, whose depth texture is read back.
+//
+// Material and texture tables are shared with the IndirectRenderer.
+class GpuCulling {
+public:
+    static constexpr int kLatency = 3;
+
+    // (Re-)builds the object and command buffers for the scene.
+    void Build(const SceneStorage& scene, IndirectRenderer& tables);
+    void UpdateTransform(std::size_t object, const Mat44f& world);
+
+    // Culls and draws the scene. With occlusionTarget, which must be bound
+    // and cleared, occlusion culling is enabled. With prepass, each phase's
+    // draws are drawn depth only first (see DepthPrepass).
+    void Submit(Shader& shader, IndirectRenderer& tables, const Mat44f& viewProjection,
+        const RenderTarget* occlusionTarget = nullptr, DepthPrepass* prepass = nullptr);
+    void Release();
+
+    std::size_t Size() const { return objects.size(); }
+    const GpuCullingStats& Stats() const { return stats; }
+
+private:
+    void init_();
+    void collect_results_();
+    void cull_(GLuint phase, int set);
+    void draw_(Shader& shader, IndirectRenderer& tables, int set, DepthPrepass* prepass);
+
+    std::vector<CullObject> objects;
+    std::vector<DrawElementsIndirectCommand> commands; // instanceCount = 0
+    std::size_t dirtyBegin = 0, dirtyEnd = 0;
+
+    std::unique_ptr<ShaderProgram> program;
+    GLint frustumPlanesLocation = -1;
+    GLint objectCountLocation = -1;
+    GLint phaseLocation = -1;
+    GLint viewProjectionLocation = -1;
+    GLint hizLocation = -1;
+    GLint hizLevelsLocation = -1;
+
+    GLuint objectBuffer = 0;
+    GLuint visibilityBuffer = 0;
+    // Phases of occlusion culling draw from separate commands and instances
+    GLuint commandBuffers[2] = {};
+    GLuint instanceBuffers[2] = {};
+
+    HiZBuffer hiz;
+
+    // Ring of per-frame results
+    enum Timer { kCullTimer, kHizTimer, kLateCullTimer, kTimerCount };
+    struct Frame {
+        GLuint counter = 0; // visible, late visible, occluded
+        GLuint timers[kTimerCount] = {};
+        bool occlusion = false;
+        GLsync fence = nullptr;
+    };
+    Frame frames[kLatency];
+    unsigned int frameIndex = 0;
+
+    GpuCullingStats stats;
+};
@@ -0,0 +1,177 @@
+#include "GpuProfiler.h"
+
+#include "../support/error.hpp"
+
+namespace {
+	// Queries are added to a slot's pool this many at a time
+	constexpr unsigned int kPoolGrowth = 32;
+
+	const char* const kFrameZone = "frame";
+}
+
+std::string GpuProfileFrame::Path(int index) const {
+	std::string path = zones[index].name;
+	for (int i = zones[index].parent; i >= 0; i = zones[i].parent)
+		path = std::string(zones[i].name) + "/" + path;
+	return path;
+}
+
+GpuProfiler::~GpuProfiler() {
+	if (csv)
+		std::fclose(csv);
+}
+
+void GpuProfiler::BeginFrame() {
+	collect_(false);
+
+	// Results of this slot that were never collected are dropped
+	Slot& slot = slots[frameIndex % kLatency];
+	if (slot.pending)
+		++stats.dropped;
+	slot.pending = false;
+	slot.used = 0;
+	slot.records.clear();
+	slot.frame = frameIndex;
+
+	inFrame = true;
+	Push(kFrameZone);
+}
+
+void GpuProfiler::EndFrame() {
+	if (!inFrame)
+		return;
+
+	Pop();
+	if (!open.empty())
+		throw Error("GpuProfiler: %zu zones still open at the end of the frame, innermost '%s'",
+			open.size(), slots[frameIndex % kLatency].records[open.back()].name);
+
+	slots[frameIndex % kLatency].pending = true;
+	inFrame = false;
+	++frameIndex;
+}
+
+void GpuProfiler::Push(const char* name) {
+	if (!inFrame)
+		return;
+
+	Slot& slot = slots[frameIndex % kLatency];
+	Record record;
+	record.name = name;
+	record.depth = int(open.size());
+	record.parent = open.empty() ? -1 : open.back();
+	record.begin = slot.used;
+	record.end = 0;
+	glQueryCounter(query_(slot), GL_TIMESTAMP);
+
+	open.push_back(int(slot.records.size()));
+	slot.records.push_back(record);
+
+	if (debugGroups)
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+}
+
+void GpuProfiler::Pop() {
+	if (!inFrame)
+		return;
+	if (open.empty())
+		throw Error("GpuProfiler: Pop() without a zone open");
+
+	if (debugGroups)
+		glPopDebugGroup();
+
+	Slot& slot = slots[frameIndex % kLatency];
+	slot.records[open.back()].end = slot.used;
+	glQueryCounter(query_(slot), GL_TIMESTAMP);
+	open.pop_back();
+}
+
+void GpuProfiler::Flush() {
+	collect_(true);
+}
+
+void GpuProfiler::Release() {
+	for (auto& slot : slots) {
+		if (!slot.pool.empty())
+			glDeleteQueries(GLsizei(slot.pool.size()), slot.pool.data());
+		slot = Slot{};
+	}
+	stats.queries = 0;
+	if (csv) {
+		std::fclose(csv);
+		csv = nullptr;
+	}
+}
+
+void GpuProfiler::OpenCsv(const char* path) {
+	if (csv)
+		std::fclose(csv);
+	csv = std::fopen(path, "w");
+	if (!csv)
+		throw Error("GpuProfiler: unable to create '%s'", path);
+	std::fprintf(csv, "frame,zone,depth,ms,self_ms\n");
+}
+
+GLuint GpuProfiler::query_(Slot& slot) {
+	if (slot.used == slot.pool.size()) {
+		slot.pool.resize(slot.pool.size() + kPoolGrowth);
+		glGenQueries(GLsizei(kPoolGrowth), slot.pool.data() + slot.used);
+		stats.queries += kPoolGrowth;
+	}
+	return slot.pool[slot.used++];
+}
+
+void GpuProfiler::collect_(bool wait) {
+	// Oldest first, so that frames are passed on in order; queries complete
+	// in order, so a frame whose last query isn't ready means the later
+	// ones aren't either.
+	for (int i = 0; i < kLatency; ++i) {
+		Slot& slot = slots[(frameIndex + i) % kLatency];
+		if (!slot.pending)
+			continue;
+
+		if (!wait) {
+			GLuint available = GL_FALSE;
+			glGetQueryObjectuiv(slot.pool[slot.records.front().end], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (GL_TRUE != available)
+				break;
+		}
+		read_(slot);
+	}
+}
+
+void GpuProfiler::read_(Slot& slot) {
+	last.frame = slot.frame;
+	last.zones.resize(slot.records.size());
+	for (std::size_t i = 0; i < slot.records.size(); ++i) {
+		Record const& record = slot.records[i];
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(slot.pool[record.begin], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(slot.pool[record.end], GL_QUERY_RESULT, &end);
+
+		GpuProfileZone& zone = last.zones[i];
+		zone.name = record.name;
+		zone.depth = record.depth;
+		zone.parent = record.parent;
+		zone.ms = zone.selfMs = float(double(end - begin) * 1e-6);
+	}
+	// Parents come before their children
+	for (auto const& zone : last.zones) {
+		if (zone.parent >= 0)
+			last.zones[zone.parent].selfMs -= zone.ms;
+	}
+	slot.pending = false;
+	++stats.frames;
+
+	if (csv)
+		write_csv_();
+	if (listener)
+		listener(last);
+}
+
+void GpuProfiler::write_csv_() {
+	for (int i = 0; i < int(last.zones.size()); ++i) {
+		auto const& zone = last.zones[i];
+		std::fprintf(csv, "%u,%s,%d,%.4f,%.4f\n", last.frame, last.Path(i).c_str(), zone.depth, zone.ms, zone.selfMs);
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <glad.h>
+
+struct GpuProfileZone {
+    const char* name = nullptr;
+    int depth = 0;              // 0 for the whole frame
+    int parent = -1;            // index in the frame's zones
+    float ms = 0.f;
+    float selfMs = 0.f;         // minus the zones nested in it
+};
+
+struct GpuProfileFrame {
+    unsigned int frame = 0;     // counted by BeginFrame(), from 0
+    std::vector<GpuProfileZone> zones;  // depth first; the whole frame first
+
+    // "frame/scene/G-buffer", for zone index
+    std::string Path(int index) const;
+};
+
+struct GpuProfilerStats {
+    unsigned int frames = 0;    // collected since startup
+    unsigned int dropped = 0;   // results not ready when their slot was reused
+    unsigned int queries = 0;   // pooled, over all slots
+};
+
+
+// GPU profiler with nested scopes. Each zone (Push() / Pop(), or a
+// GpuProfileScope) issues a pair of glQueryCounter(GL_TIMESTAMP) queries,
+// so zones may enclose passes timed with GL_TIME_ELAPSED queries, and each
+// other. The queries come from a pool per frame slot; there are kLatency
+// slots, and a frame's results are read back when available, a few frames
+// later, so that reading them never stalls (if they aren't ready when the
+// slot comes around again, they are dropped).
+//
+// Results roll up per frame into a tree of zones, the whole frame at its
+// root, with the time of each zone and the time not spent in the zones
+// nested in it. The latest frame collected is kept (LastFrame()); every
+// frame collected is passed to the listener, if any, and appended to the
+// CSV file, if open, in order.
+//
+// Zone names must outlive the results (string literals). With debug groups
+// on, zones are also glPushDebugGroup() ranges, for external tools
+// (RenderDoc, Nsight), which then show up in the debug output.
+//
+// Usage:
+//    profiler.BeginFrame();                // the "frame" zone
+//    {
+//        GpuProfileScope scope( profiler, "shadows" );
+//        ... GL commands ...
+//    }
+//    profiler.EndFrame();
+//    profiler.LastFrame().zones;           // from a few frames ago
+class GpuProfiler {
+public:
+    static constexpr int kLatency = 4;
+
+    ~GpuProfiler();
+
+    void BeginFrame();
+    void EndFrame();
+    // Outside a frame, zones are ignored.
+    void Push(const char* name);
+    void Pop();
+    // Waits for the frames in flight, and collects them.
+    void Flush();
+    void Release();
+
+    void SetDebugGroups(bool enabled) { debugGroups = enabled; }
+    void SetListener(std::function<void(const GpuProfileFrame&)> listener_) { listener = std::move(listener_); }
+    // Appends every frame collected from now on to path, one row per zone.
+    void OpenCsv(const char* path);
+
+    const GpuProfileFrame& LastFrame() const { return last; }
+    const GpuProfilerStats& Stats() const { return stats; }
+
+private:
+    struct Record {
+        const char* name;
+        int depth, parent;
+        unsigned int begin, end;    // indices into the slot's pool
+    };
+    struct Slot {
+        std::vector<GLuint> pool;
+        unsigned int used = 0;
+        std::vector<Record> records;
+        unsigned int frame = 0;
+        bool pending = false;
+    };
+
+    GLuint query_(Slot& slot);
+    // Oldest first; stops at the first slot not ready, unless waiting.
+    void collect_(bool wait);
+    void read_(Slot& slot);
+    void write_csv_();
+
+    Slot slots[kLatency];
+    unsigned int frameIndex = 0;
+    bool inFrame = false;
+    std::vector<int> open;          // records of the zones pushed, innermost last
+
+    bool debugGroups = false;
+    std::function<void(const GpuProfileFrame&)> listener;
+    std::FILE* csv = nullptr;
+
+    GpuProfileFrame last;
+    GpuProfilerStats stats;
+};
+
+class GpuProfileScope {
+public:
+    GpuProfileScope(GpuProfiler& profiler_, const char* name) : profiler(profiler_) { profiler.Push(name); }
+    ~GpuProfileScope() { profiler.Pop(); }
+
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+private:
+    GpuProfiler& profiler;
+};
@@ -0,0 +1,53 @@
+#include "GpuTimer.h"
+
+void GpuTimer::Begin() {
+	if (0 == frames[0].queries[0]) {
+		for (auto& frame : frames)
+			glGenQueries(2, frame.queries);
+	}
+
+	collect_results_();
+
+	// Results of this slot that were never collected are dropped
+	Frame& frame = frames[frameIndex];
+	frame.pending = false;
+	glQueryCounter(frame.queries[0], GL_TIMESTAMP);
+}
+
+void GpuTimer::End() {
+	Frame& frame = frames[frameIndex];
+	frameIndex = (frameIndex + 1) % kLatency;
+
+	glQueryCounter(frame.queries[1], GL_TIMESTAMP);
+	frame.pending = true;
+}
+
+void GpuTimer::Release() {
+	for (auto& frame : frames) {
+		if (0 != frame.queries[0])
+			glDeleteQueries(2, frame.queries);
+		frame = Frame{};
+	}
+	frameIndex = 0;
+}
+
+void GpuTimer::collect_results_() {
+	// Oldest first, so that the newest available result wins.
+	for (int i = 0; i < kLatency; ++i) {
+		Frame& frame = frames[(frameIndex + i) % kLatency];
+		if (!frame.pending)
+			continue;
+
+		// Queries complete in order, so the end implies the begin
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (GL_TRUE != available)
+			continue;
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(frame.queries[0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame.queries[1], GL_QUERY_RESULT, &end);
+		ms = float(end - begin) / 1e6f;
+		frame.pending = false;
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glad.h>
+
+// GPU time of a span of commands, from a pair of timestamp queries
+// (glQueryCounter()), so that the span may enclose passes that time
+// themselves with GL_TIME_ELAPSED queries. Results are read back a few
+// frames late (see kLatency), so that reading them never stalls.
+class GpuTimer {
+public:
+    static constexpr int kLatency = 3;
+
+    void Begin();
+    void End();
+    void Release();
+
+    // Last result available
+    float Ms() const { return ms; }
+
+private:
+    void collect_results_();
+
+    struct Frame {
+        GLuint queries[2] = {}; // begin, end
+        bool pending = false;
+    };
+    Frame frames[kLatency];
+    unsigned int frameIndex = 0;
+    float ms = 0.f;
+};
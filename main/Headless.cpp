@@ -0,0 +1,126 @@
+#include "Headless.h"
+
+#include <GLFW/glfw3.h>
+#include <stb_image_write.h>
+
+#include <vector>
+
+#include <cstdio>
+#include <cstring>
+
+#include "../support/error.hpp"
+
+namespace {
+	constexpr int kJpegQuality = 95;
+
+	bool ends_with(std::string const& text, char const* suffix) {
+		std::size_t const length = std::strlen(suffix);
+		return text.size() >= length && 0 == text.compare(text.size() - length, length, suffix);
+	}
+}
+
+void Headless::Configure(const HeadlessSettings& settings_) {
+	if (settings_.width <= 0 || settings_.height <= 0)
+		throw Error("Headless: frame size %dx%d must be positive", settings_.width, settings_.height);
+	if (0 == settings_.frames)
+		throw Error("Headless: at least one frame must be drawn");
+
+	settings = settings_;
+}
+
+void Headless::InitHints() const {
+	if (settings.enabled)
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+}
+
+void Headless::WindowHints() const {
+	if (!settings.enabled)
+		return;
+
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_CREATION_API,
+		HeadlessContext::egl == settings.context ? GLFW_EGL_CONTEXT_API : GLFW_OSMESA_CONTEXT_API);
+}
+
+void Headless::BeginFrame() {
+	if (startTime < 0.0)
+		startTime = glfwGetTime();
+
+	target.Resize(settings.width, settings.height);
+	target.Bind();
+}
+
+void Headless::EndFrame() {
+	if (writes_frame_())
+		write_frame_();
+
+	++stats.frames;
+	stats.elapsedMs = float(1000. * (glfwGetTime() - startTime));
+}
+
+void Headless::Release() {
+	target.Release();
+}
+
+const char* Headless::ContextName(HeadlessContext context_) {
+	switch (context_) {
+	case HeadlessContext::osmesa: return "OSMesa";
+	case HeadlessContext::egl: return "EGL";
+	}
+	return "unknown";
+}
+
+bool Headless::writes_frame_() const {
+	if (settings.output.empty())
+		return false;
+	if (0 == settings.outputEvery)
+		return stats.frames + 1 == settings.frames;
+	return 0 == stats.frames % settings.outputEvery;
+}
+
+void Headless::write_frame_() {
+	double const start = glfwGetTime();
+
+	int const width = target.Width(), height = target.Height();
+	std::vector<unsigned char> pixels(std::size_t(width) * height * 3);
+
+	GLint previous = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, target.Framebuffer());
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+
+	// <output>NNNNN.png, or the extension <output> ends with
+	std::string prefix = settings.output;
+	std::string extension = ".png";
+	for (char const* known : { ".png", ".bmp", ".tga", ".jpg" }) {
+		if (ends_with(prefix, known)) {
+			extension = known;
+			prefix.resize(prefix.size() - extension.size());
+			break;
+		}
+	}
+	char number[16];
+	std::snprintf(number, sizeof(number), "%05u", stats.frames);
+	std::string const path = prefix + number + extension;
+
+	// GL's rows go bottom to top
+	stbi_flip_vertically_on_write(1);
+	int written = 0;
+	if (".bmp" == extension)
+		written = stbi_write_bmp(path.c_str(), width, height, 3, pixels.data());
+	else if (".tga" == extension)
+		written = stbi_write_tga(path.c_str(), width, height, 3, pixels.data());
+	else if (".jpg" == extension)
+		written = stbi_write_jpg(path.c_str(), width, height, 3, pixels.data(), kJpegQuality);
+	else
+		written = stbi_write_png(path.c_str(), width, height, 3, pixels.data(), width * 3);
+
+	if (!written)
+		throw Error("Headless: unable to write frame %u to '%s'", stats.frames, path.c_str());
+
+	++stats.written;
+	stats.writeMs += float(1000. * (glfwGetTime() - start));
+}
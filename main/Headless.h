@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+
+#include <glad.h>
+
+#include "RenderTarget.h"
+
+enum class HeadlessContext { osmesa, egl };
+
+struct HeadlessSettings {
+    bool enabled = false;
+    HeadlessContext context = HeadlessContext::osmesa;
+    int width = 1280, height = 720;
+    unsigned int frames = 300;      // then the window closes
+    std::string output;             // path prefix of written frames; empty for none
+    unsigned int outputEvery = 0;   // write every Nth frame; 0 for the last one only
+};
+
+struct HeadlessStats {
+    unsigned int frames = 0;        // drawn so far
+    unsigned int written = 0;       // of these, written to files
+    float elapsedMs = 0.f;          // wall clock, from the first frame's start
+    float writeMs = 0.f;            // of which, reading back and writing frames
+};
+
+
+// Headless mode, for machines without a display (CI, servers): GLFW runs on
+// its null platform, with an OSMesa (Mesa's software renderer, llvmpipe) or
+// EGL context, and the frames are drawn into an offscreen target rather
+// than a window, for a given number of frames at a given size. OSMesa needs
+// libOSMesa at run time; EGL needs a driver whose default display has
+// window configs, as GLFW's null platform still creates a (dummy) window
+// surface.
+//
+// Frames are optionally read back and written with stb_image_write, as
+// <output>NNNNN.png (or .bmp, .tga, .jpg, if <output> ends with that
+// extension, which then goes after the number). Reading back stalls the
+// pipeline, so leave it off when measuring.
+//
+// Usage:
+//    headless.InitHints();                 // before glfwInit()
+//    headless.WindowHints();               // before glfwCreateWindow()
+//    while( !headless.Done() ) {
+//        headless.BeginFrame();
+//        ... draw into headless.Framebuffer() ...
+//        headless.EndFrame();              // writes the frame, if asked to
+//    }
+class Headless {
+public:
+    void Configure(const HeadlessSettings& settings_);
+
+    void InitHints() const;
+    void WindowHints() const;
+
+    // Resizes and binds the target; needs the context.
+    void BeginFrame();
+    void EndFrame();
+    void Release();
+
+    bool Enabled() const { return settings.enabled; }
+    bool Done() const { return stats.frames >= settings.frames; }
+    GLuint Framebuffer() const { return target.Framebuffer(); }
+
+    static const char* ContextName(HeadlessContext context_);
+
+    const HeadlessSettings& Settings() const { return settings; }
+    const HeadlessStats& Stats() const { return stats; }
+
+private:
+    bool writes_frame_() const;
+    void write_frame_();
+
+    HeadlessSettings settings;
+    RenderTarget target;
+    double startTime = -1.0;
+    HeadlessStats stats;
+};
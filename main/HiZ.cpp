@@ -0,0 +1,76 @@
+#include "HiZ.h"
+
+#include <algorithm>
+
+void HiZBuffer::Build(GLuint depthTexture, int width_, int height_) {
+	if (!program) {
+		program = std::make_unique<ShaderProgram>(std::vector<ShaderProgram::ShaderSource>{
+			{ GL_COMPUTE_SHADER, "assets/cs_hiz.glsl" }
+		});
+		fromDepthLocation = glGetUniformLocation(program->programId(), "fromDepth");
+		sourceSizeLocation = glGetUniformLocation(program->programId(), "sourceSize");
+	}
+
+	resize_(width_, height_);
+
+	glUseProgram(program->programId());
+
+	// Level 0: copy of the depth texture
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glBindImageTexture(1, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	glUniform1i(fromDepthLocation, 1);
+	glUniform2i(sourceSizeLocation, width, height);
+	glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Remaining levels reduce the one before
+	glUniform1i(fromDepthLocation, 0);
+	int sourceWidth = width, sourceHeight = height;
+	for (int level = 1; level < levels; ++level) {
+		int const w = std::max(1, sourceWidth / 2);
+		int const h = std::max(1, sourceHeight / 2);
+
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		glBindImageTexture(0, texture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glUniform2i(sourceSizeLocation, sourceWidth, sourceHeight);
+		glDispatchCompute((w + 7) / 8, (h + 7) / 8, 1);
+
+		sourceWidth = w;
+		sourceHeight = h;
+	}
+
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void HiZBuffer::Release() {
+	if (0 != texture)
+		glDeleteTextures(1, &texture);
+	texture = 0;
+	width = height = levels = 0;
+	program.reset();
+}
+
+void HiZBuffer::resize_(int width_, int height_) {
+	if (0 != texture && width_ == width && height_ == height)
+		return;
+
+	if (0 != texture)
+		glDeleteTextures(1, &texture);
+
+	width = width_;
+	height = height_;
+	levels = 1;
+	while ((std::max(width, height) >> levels) > 0)
+		++levels;
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+
+#include <glad.h>
+
+#include "../support/program.hpp"
+
+// Hierarchical depth buffer: an R32F mip chain where every texel holds the
+// farthest depth of the texels it covers in the level below. Level 0 is a
+// copy of a depth texture. Built with a compute shader (cs_hiz.glsl), one
+// dispatch per level.
+//
+// Levels are halved (rounding down); at odd sizes the last row/column also
+// covers the leftover texel, so that a texel at (x >> level), clamped to the
+// level's size, always bounds the depth at x.
+class HiZBuffer {
+public:
+    void Build(GLuint depthTexture, int width, int height);
+    void Release();
+
+    GLuint Texture() const { return texture; }
+    int Levels() const { return levels; }
+
+private:
+    void resize_(int width, int height);
+
+    std::unique_ptr<ShaderProgram> program;
+    GLint fromDepthLocation = -1;
+    GLint sourceSizeLocation = -1;
+
+    GLuint texture = 0;
+    int width = 0, height = 0;
+    int levels = 0;
+};
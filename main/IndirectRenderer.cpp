@@ -0,0 +1,164 @@
+#include "IndirectRenderer.h"
+
+#include <algorithm>
+
+#include "StreamBuffer.h"
+#include "DepthPrepass.h"
+
+#include "../support/error.hpp"
+
+namespace
+{
+	constexpr GLuint kNone = ~GLuint(0);
+}
+
+void IndirectRenderer::Begin() {
+	pending.clear();
+	stats = IndirectRendererStats{};
+}
+
+void IndirectRenderer::Push(const Model& model) {
+	Pending item;
+	item.ro = model.GetRenderObject();
+	item.instance.model = model.world_transform;
+	item.instance.material = MaterialIndex(model.material.get());
+	item.instance.layer = textures.LayerOf(model.texture);
+	item.instance.pad[0] = item.instance.pad[1] = 0;
+	pending.push_back(item);
+}
+
+void IndirectRenderer::Push(const SceneStorage& scene, std::uint32_t slot) {
+	Pending item;
+	item.ro = scene.Mesh(scene.Meshes()[slot]);
+	item.instance.model = scene.Transforms()[slot];
+	item.instance.material = MaterialIndex(scene.Material(scene.Materials()[slot]));
+	item.instance.layer = textures.LayerOf(scene.Textures()[slot]);
+	item.instance.pad[0] = item.instance.pad[1] = 0;
+	pending.push_back(item);
+}
+
+void IndirectRenderer::Submit(Shader& shader, DepthPrepass* prepass) {
+	if (pending.size() > kMaxInstances)
+		throw Error("IndirectRenderer: %zu instances exceed the limit of %u", pending.size(), kMaxInstances);
+
+	// Group the instances by mesh with a counting sort: one command per mesh,
+	// whose instances form a contiguous range starting at baseInstance.
+	commands.clear();
+	std::fill(commandIndices.begin(), commandIndices.end(), kNone);
+	for (auto const& item : pending) {
+		if (item.ro->id >= commandIndices.size())
+			commandIndices.resize(item.ro->id + 1, kNone);
+
+		GLuint& index = commandIndices[item.ro->id];
+		if (kNone == index) {
+			index = static_cast<GLuint>(commands.size());
+
+			DrawElementsIndirectCommand command;
+			command.count = item.ro->geometry.indexCount;
+			command.instanceCount = 0;
+			command.firstIndex = item.ro->geometry.firstIndex;
+			command.baseVertex = item.ro->geometry.baseVertex;
+			command.baseInstance = 0;
+			commands.push_back(command);
+		}
+
+		++commands[index].instanceCount;
+	}
+
+	GLuint first = 0;
+	for (auto& command : commands) {
+		command.baseInstance = first;
+		first += command.instanceCount;
+		command.instanceCount = 0;
+	}
+
+	instances.resize(pending.size());
+	for (auto const& item : pending) {
+		auto& command = commands[commandIndices[item.ro->id]];
+		instances[command.baseInstance + command.instanceCount++] = item.instance;
+	}
+
+	stats.commands = static_cast<unsigned int>(commands.size());
+	stats.instances = static_cast<unsigned int>(instances.size());
+	stats.materials = static_cast<unsigned int>(materials.size());
+	stats.textureLayers = static_cast<unsigned int>(textures.Layers());
+
+	if (commands.empty())
+		return;
+
+	StreamBuffer& stream = stream_buffer();
+	StreamAllocation const instanceData = stream.Upload(instances.data(), instances.size() * sizeof(InstanceData), stream.StorageAlignment());
+	StreamAllocation const commandData = stream.Upload(commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint));
+
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, instanceData.buffer, instanceData.offset, instanceData.size);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandData.buffer);
+
+	// The same commands draw the position stream
+	if (prepass) {
+		prepass->BeginDepth();
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(commandData.offset),
+			static_cast<GLsizei>(commands.size()), 0);
+		prepass->BeginShading();
+	}
+
+	BindResources(shader);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(commandData.offset),
+		static_cast<GLsizei>(commands.size()), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	if (prepass)
+		prepass->End();
+
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void IndirectRenderer::Release() {
+	if (0 != materialBuffer)
+		glDeleteBuffers(1, &materialBuffer);
+	materialBuffer = 0;
+	materialCapacity = 0;
+
+	textures.Release();
+	materials.clear();
+	materialIndices.clear();
+}
+
+void IndirectRenderer::BindResources(Shader& shader) {
+	// Materials only change when new ones are seen.
+	if (materialsDirty) {
+		stream_buffer_data(GL_SHADER_STORAGE_BUFFER, materialBuffer, materialCapacity, materials.data(), materials.size() * sizeof(GpuMaterial));
+		materialsDirty = false;
+	}
+
+	shader.use();
+	shader.setInt("texture_layers", 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textures.ID());
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, materialBuffer);
+
+	glBindVertexArray(geometry_arena().VAO());
+}
+
+GLuint IndirectRenderer::MaterialIndex(const PhongMaterial* material) {
+	if (material->id >= materialIndices.size())
+		materialIndices.resize(material->id + 1, kNone);
+
+	GLuint& index = materialIndices[material->id];
+	if (kNone == index) {
+		index = static_cast<GLuint>(materials.size());
+
+		GpuMaterial gpu{};
+		gpu.ambient = material->ambient;
+		gpu.diffuse = material->diffuse;
+		gpu.specular = material->specular;
+		gpu.shininess = material->shininess;
+		gpu.emission = material->emission;
+		materials.push_back(gpu);
+		materialsDirty = true;
+	}
+
+	return index;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+
+#include "Render.h"
+#include "SceneStorage.h"
+#include "TextureArray.h"
+
+class DepthPrepass;
+
+// Material layout in the Materials SSBO (std430; see fs_phong.glsl).
+struct GpuMaterial {
+    Vec3f ambient;
+    float pad0;
+    Vec3f diffuse;
+    float pad1;
+    Vec3f specular;
+    float shininess;
+    Vec3f emission;
+    float pad2;
+};
+
+struct IndirectRendererStats {
+    unsigned int commands = 0;
+    unsigned int instances = 0;
+    unsigned int materials = 0;
+    unsigned int textureLayers = 0;
+};
+
+// Layout of one command in the GL_DRAW_INDIRECT_BUFFER.
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+
+// Indirect draw path: the whole opaque scene is submitted with a single
+// glMultiDrawElementsIndirect() call.
+//
+// All meshes live in the shared geometry arena (one VAO). Models are grouped
+// by mesh, and each mesh becomes one indirect command whose instances cover a
+// contiguous range of the instance buffer. Per-instance data (transform,
+// material index and texture layer) goes into the instance SSBO. GL 4.3 has
+// no gl_DrawID, so the vertex shader finds its record through the
+// per-instance index attribute instead (baseInstance + instance id).
+// Materials are stored in a second SSBO, and textures are copied into layers
+// of a TextureArray, so no state changes are needed between meshes.
+//
+// The program must be built from vs_phong.glsl/fs_phong.glsl with
+// INDIRECT_MATERIALS defined.
+class IndirectRenderer {
+public:
+    void Begin();
+    void Push(const Model& model);
+    void Push(const SceneStorage& scene, std::uint32_t slot);
+    // With prepass, the commands are drawn depth only first (see
+    // DepthPrepass).
+    void Submit(Shader& shader, DepthPrepass* prepass = nullptr);
+    void Release();
+
+    // Material and texture tables, shared with other indirect draw paths
+    // (see GpuCulling). Materials are added on first use and kept.
+    GLuint MaterialIndex(const PhongMaterial* material);
+    GLuint TextureLayer(GLuint texture) { return textures.LayerOf(texture); }
+
+    // Binds the program, the texture array, the materials (binding 1) and
+    // the geometry arena's VAO for an indirect draw.
+    void BindResources(Shader& shader);
+
+    const IndirectRendererStats& Stats() const { return stats; }
+
+private:
+    struct Pending {
+        RenderObject* ro;
+        InstanceData instance;
+    };
+
+    std::vector<Pending> pending;
+    std::vector<InstanceData> instances;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<GpuMaterial> materials;
+    std::vector<GLuint> materialIndices;    // material id -> index, or ~0u
+    bool materialsDirty = false;
+    std::vector<GLuint> commandIndices;     // mesh id -> command, or ~0u
+
+    TextureArray textures;
+
+    // Instances and commands go into the frame's stream buffer
+    GLuint materialBuffer = 0;
+    std::size_t materialCapacity = 0;   // in bytes
+
+    IndirectRendererStats stats;
+};
@@ -0,0 +1,156 @@
+#include "JobBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "Bounds.h"
+
+#include "../support/error.hpp"
+#include "../support/jobs.hpp"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	float elapsed_ms(Clock::time_point since) {
+		return std::chrono::duration<float, std::milli>(Clock::now() - since).count();
+	}
+
+	constexpr int kRepetitions = 7;
+	constexpr std::size_t kSyntheticItems = 1 << 16;
+	constexpr std::size_t kEntities = 1000000;
+
+	// Up to rounding: the compiler may contract the serial and the parallel
+	// loops differently
+	bool close(const float* a, const float* b, std::size_t count) {
+		for (std::size_t i = 0; i < count; ++i) {
+			if (std::abs(a[i] - b[i]) > 1e-5f * std::max(1.f, std::abs(b[i])))
+				return false;
+		}
+		return true;
+	}
+
+	float median(std::vector<float> values) {
+		std::sort(values.begin(), values.end());
+		return values[values.size() / 2];
+	}
+
+	// A unit is a few dozen dependent flops
+	float synthetic_item(std::size_t i) {
+		unsigned int const units = 1 + unsigned(i * 2654435761u >> 7) % 64;
+		float x = float(i % 1000) * 1e-3f;
+		for (unsigned int u = 0; u < units * 8; ++u)
+			x = std::sqrt(x * x + 0.5f) * 0.75f;
+		return x;
+	}
+
+	struct Transforms {
+		std::vector<Mat44f> locals, worlds;
+		std::vector<AABB> bounds;
+	};
+
+	Transforms make_transforms() {
+		Transforms t;
+		t.locals.resize(kEntities);
+		t.worlds.resize(kEntities);
+		t.bounds.resize(kEntities);
+		std::size_t const side = std::size_t(std::ceil(std::sqrt(double(kEntities))));
+		for (std::size_t i = 0; i < kEntities; ++i) {
+			t.locals[i] = make_translation(Vec3f{ 2.f * float(i % side), 0.5f, 2.f * float(i / side) })
+				* make_rotation_y(0.01f * float(i % 628)) * make_scaling(0.5f, 0.5f, 0.5f);
+		}
+		return t;
+	}
+
+	void transform_range(Transforms& t, const Mat44f& parent, std::size_t begin, std::size_t end) {
+		AABB unit;
+		unit.min = Vec3f{ -0.5f, -0.5f, -0.5f };
+		unit.max = Vec3f{ 0.5f, 0.5f, 0.5f };
+		for (std::size_t i = begin; i < end; ++i) {
+			t.worlds[i] = parent * t.locals[i];
+			t.bounds[i] = transform_aabb(t.worlds[i], unit);
+		}
+	}
+
+	// Runs f() kRepetitions times after a warm-up; median time.
+	template< class F >
+	float measure(F&& f) {
+		f();
+		std::vector<float> times;
+		for (int r = 0; r < kRepetitions; ++r) {
+			auto const start = Clock::now();
+			f();
+			times.push_back(elapsed_ms(start));
+		}
+		return median(times);
+	}
+
+	void print(const char* workload, unsigned int threads, float ms, float serialMs, const JobSystemStats& stats) {
+		std::printf("%-10s %3u threads | %9.3f ms | speedup %5.2f (%3.0f%% efficiency) | %llu jobs, %llu stolen\n",
+			workload, threads, ms, serialMs / ms, 100.f * serialMs / ms / float(threads),
+			(unsigned long long)stats.jobs, (unsigned long long)stats.steals
+		);
+	}
+}
+
+void run_job_benchmark() {
+	unsigned int const cores = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int n = 1; n < cores; n *= 2)
+		threadCounts.push_back(n);
+	threadCounts.push_back(cores);
+
+	// Serial references
+	std::vector<float> expected(kSyntheticItems);
+	float const serialSyntheticMs = measure([&] {
+		for (std::size_t i = 0; i < kSyntheticItems; ++i)
+			expected[i] = synthetic_item(i);
+	});
+
+	Mat44f const parent = make_translation(Vec3f{ 0.f, 0.3f, -2.f }) * make_rotation_x(-0.5f);
+	Transforms reference = make_transforms();
+	float const serialTransformMs = measure([&] {
+		transform_range(reference, parent, 0, kEntities);
+	});
+
+	std::printf("jobs: %u hardware threads | serial: synthetic %.3f ms, transform %.3f ms\n",
+		cores, serialSyntheticMs, serialTransformMs
+	);
+
+	std::vector<float> results(kSyntheticItems);
+	Transforms transforms = make_transforms();
+	for (unsigned int threads : threadCounts) {
+		{
+			JobSystem jobs(threads);
+			float const ms = measure([&] {
+				jobs.parallelFor(0, kSyntheticItems, [&](std::size_t begin, std::size_t end) {
+					for (std::size_t i = begin; i < end; ++i)
+						results[i] = synthetic_item(i);
+				});
+			});
+			if (!close(results.data(), expected.data(), kSyntheticItems))
+				throw Error("Job benchmark: synthetic results on %u threads differ from the serial ones", threads);
+			print("synthetic", threads, ms, serialSyntheticMs, jobs.stats());
+		}
+		{
+			JobSystem jobs(threads);
+			float const ms = measure([&] {
+				jobs.parallelFor(0, kEntities, [&](std::size_t begin, std::size_t end) {
+					transform_range(transforms, parent, begin, end);
+				}, 1024);
+			});
+			for (std::size_t i = 0; i < kEntities; ++i) {
+				AABB const& box = transforms.bounds[i];
+				AABB const& expectedBox = reference.bounds[i];
+				float const corners[6] = { box.min.x, box.min.y, box.min.z, box.max.x, box.max.y, box.max.z };
+				float const expectedCorners[6] = { expectedBox.min.x, expectedBox.min.y, expectedBox.min.z, expectedBox.max.x, expectedBox.max.y, expectedBox.max.z };
+				if (!close(transforms.worlds[i].v, reference.worlds[i].v, 16) || !close(corners, expectedCorners, 6))
+					throw Error("Job benchmark: transforms on %u threads differ from the serial ones", threads);
+			}
+			print("transform", threads, ms, serialTransformMs, jobs.stats());
+		}
+	}
+}
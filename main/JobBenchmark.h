@@ -0,0 +1,10 @@
+#pragma once
+
+// Measures how the job system (support/jobs.hpp) scales, from one thread to
+// one per hardware thread, on two workloads: a synthetic one whose items
+// cost from 1 to 64 units (so that the threads only finish together if
+// work is stolen), and a batched vmlib transform of 1M entities (world
+// matrices from local ones, and world bounds). Checks the results against
+// a serial run and prints one line per workload and thread count.
+// Needs no GL context.
+void run_job_benchmark();
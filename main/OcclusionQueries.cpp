@@ -0,0 +1,193 @@
+#include "OcclusionQueries.h"
+
+namespace {
+	// Boxes are grown a little, so that an object's own surface (drawn
+	// before its query) never hides its box.
+	constexpr float kBoxMargin = 0.01f;
+
+	AABB grown(const AABB& box) {
+		Vec3f const margin = box.Extents() * kBoxMargin + Vec3f{ 1e-3f, 1e-3f, 1e-3f };
+		AABB result;
+		result.min = box.min - margin;
+		result.max = box.max + margin;
+		return result;
+	}
+
+	bool contains(const AABB& box, Vec3f p) {
+		return p.x >= box.min.x && p.x <= box.max.x
+			&& p.y >= box.min.y && p.y <= box.max.y
+			&& p.z >= box.min.z && p.z <= box.max.z;
+	}
+}
+
+void OcclusionQueries::Begin(std::size_t objectCount) {
+	++frame;
+
+	stats.issued = 0;
+	stats.read = 0;
+	stats.occluded = 0;
+	stats.conditional = 0;
+
+	// Last frame's conditional draws named queries that may be pooled below
+	conditional.clear();
+
+	// Collect the results that are ready, leave the others for later. The
+	// states are resized afterwards, so that the queries of objects the
+	// scene no longer has are still known, and go back to the pool.
+	std::size_t kept = 0;
+	for (std::uint32_t object : pending) {
+		State& state = states[object];
+		if (object >= objectCount) {
+			pool.push_back(state.query);
+			state.query = 0;
+			continue;
+		}
+
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (GL_TRUE != available) {
+			pending[kept++] = object;
+			continue;
+		}
+
+		GLuint passed = GL_TRUE;
+		glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &passed);
+		state.visible = GL_FALSE != passed;
+
+		pool.push_back(state.query);
+		state.query = 0;
+		++stats.read;
+	}
+	pending.resize(kept);
+	stats.pending = static_cast<unsigned int>(pending.size());
+
+	states.resize(objectCount);
+}
+
+void OcclusionQueries::Query(const Mat44f& viewProjection, Vec3f cameraPosition,
+	const std::vector<AABB>& boxes, const std::vector<std::uint32_t>& candidates,
+	const std::function<bool(std::uint32_t)>& expensive,
+	const std::function<void(std::uint32_t)>& draw) {
+	init_();
+
+	shader->use();
+	shader->setMat4("viewProjection", viewProjection);
+	GLint const boxMinLocation = glGetUniformLocation(shader->ID, "boxMin");
+	GLint const boxMaxLocation = glGetUniformLocation(shader->ID, "boxMax");
+
+	glBindVertexArray(vao);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+
+	for (std::uint32_t object : candidates) {
+		State& state = states[object];
+		if (!state.visible)
+			++stats.occluded;
+		if (0 != state.query)
+			continue; // previous query still in flight
+
+		AABB const box = grown(boxes[object]);
+		if (contains(box, cameraPosition)) {
+			// The box's faces would be clipped away
+			state.visible = true;
+			continue;
+		}
+
+		bool const due = !state.visible || 0 == (frame + object) % kRequeryInterval;
+		if (!due)
+			continue;
+
+		state.query = acquire_();
+		glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, state.query);
+		glUniform3f(boxMinLocation, box.min.x, box.min.y, box.min.z);
+		glUniform3f(boxMaxLocation, box.max.x, box.max.y, box.max.z);
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
+		glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+
+		pending.push_back(object);
+		++stats.issued;
+
+		if (!state.visible && expensive(object))
+			conditional.emplace_back(object, state.query);
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+	glBindVertexArray(0);
+
+	// Drawn by the GPU only if its box passed; never waits for the result.
+	for (auto const& [object, query] : conditional) {
+		glBeginConditionalRender(query, GL_QUERY_NO_WAIT);
+		draw(object);
+		glEndConditionalRender();
+	}
+	stats.conditional = static_cast<unsigned int>(conditional.size());
+	stats.pending = static_cast<unsigned int>(pending.size());
+	stats.pool = static_cast<unsigned int>(allQueries.size());
+}
+
+void OcclusionQueries::Release() {
+	if (!allQueries.empty())
+		glDeleteQueries(static_cast<GLsizei>(allQueries.size()), allQueries.data());
+	allQueries.clear();
+	pool.clear();
+	pending.clear();
+	states.clear();
+
+	if (0 != vao)
+		glDeleteVertexArrays(1, &vao);
+	if (0 != vbo)
+		glDeleteBuffers(1, &vbo);
+	if (0 != ebo)
+		glDeleteBuffers(1, &ebo);
+	vao = vbo = ebo = 0;
+	shader.reset();
+}
+
+void OcclusionQueries::init_() {
+	if (shader)
+		return;
+
+	shader = std::make_unique<Shader>("assets/vs_bounds.glsl", "assets/fs_bounds.glsl");
+
+	// Unit cube
+	float const corners[] = {
+		0, 0, 0,  1, 0, 0,  0, 1, 0,  1, 1, 0,
+		0, 0, 1,  1, 0, 1,  0, 1, 1,  1, 1, 1
+	};
+	unsigned int const indices[] = {
+		0, 2, 1,  1, 2, 3,  // z -ve
+		4, 5, 6,  5, 7, 6,  // z +ve
+		0, 1, 4,  1, 5, 4,  // y -ve
+		2, 6, 3,  3, 6, 7,  // y +ve
+		0, 4, 2,  2, 4, 6,  // x -ve
+		1, 3, 5,  3, 7, 5   // x +ve
+	};
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glGenBuffers(1, &ebo);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+GLuint OcclusionQueries::acquire_() {
+	if (pool.empty()) {
+		std::size_t const first = allQueries.size();
+		allQueries.resize(first + kPoolGrowth);
+		glGenQueries(kPoolGrowth, allQueries.data() + first);
+		pool.assign(allQueries.begin() + first, allQueries.end());
+	}
+
+	GLuint const query = pool.back();
+	pool.pop_back();
+	return query;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <glad.h>
+
+#include "Bounds.h"
+#include "shader.h"
+
+struct OcclusionQueryStats {
+    unsigned int issued = 0;        // queries this frame
+    unsigned int read = 0;          // results that became available
+    unsigned int pending = 0;       // results still in flight
+    unsigned int occluded = 0;      // candidates skipped as hidden
+    unsigned int conditional = 0;   // conditional draws this frame
+    unsigned int pool = 0;          // query objects allocated
+};
+
+
+// Hardware occlusion culling with GL_ANY_SAMPLES_PASSED_CONSERVATIVE queries
+// on each object's bounding box.
+//
+// Results are only read once GL reports them as available (usually the next
+// frame), so the CPU never waits for the GPU; until then, an object keeps
+// the visibility it had. Objects found visible are only re-queried every
+// kRequeryInterval frames (staggered by object), hidden ones every frame.
+//
+// Per frame: Begin() collects results, the caller draws the objects that
+// are Visible(), then Query() draws the boxes of the candidates that need a
+// query against that depth. Hidden objects that are expensive to draw are
+// also drawn right away under glBeginConditionalRender(), so that they
+// don't appear a frame late when they come into view; cheap ones wait for
+// the result.
+class OcclusionQueries {
+public:
+    static constexpr std::uint32_t kRequeryInterval = 4;
+    static constexpr GLsizei kPoolGrowth = 64;
+
+    void Begin(std::size_t objectCount);
+
+    bool Visible(std::uint32_t object) const { return states[object].visible; }
+
+    void Query(const Mat44f& viewProjection, Vec3f cameraPosition,
+        const std::vector<AABB>& boxes, const std::vector<std::uint32_t>& candidates,
+        const std::function<bool(std::uint32_t)>& expensive,
+        const std::function<void(std::uint32_t)>& draw);
+
+    void Release();
+
+    const OcclusionQueryStats& Stats() const { return stats; }
+
+private:
+    struct State {
+        GLuint query = 0;   // in flight, or 0
+        bool visible = true;
+    };
+
+    void init_();
+    GLuint acquire_();
+
+    std::vector<State> states;
+    std::vector<std::uint32_t> pending;     // objects with a query in flight
+    std::vector<std::pair<std::uint32_t, GLuint>> conditional;
+
+    std::vector<GLuint> pool;               // free queries
+    std::vector<GLuint> allQueries;
+    std::uint32_t frame = 0;
+
+    std::unique_ptr<Shader> shader;
+    GLuint vao = 0, vbo = 0, ebo = 0;
+
+    OcclusionQueryStats stats;
+};
@@ -4,6 +4,55 @@
 
 #include "shader.h"
 #include "defaults.hpp"
+#include "GeometryArena.h"
+#include "Bounds.h"
+
+// Per-instance data is looked up in the vertex shader through an "instance
+// index" attribute. The attribute reads from a shared buffer that holds the
+// sequence 0, 1, 2, ..., with a divisor of one. Combined with the base instance
+// of a draw, this gives each instance the index of its record in the instance
+// buffer (see vs_phong.glsl).
+constexpr GLuint kInstanceIndexAttrib = 3;
+constexpr GLuint kMaxInstances = 1u << 20;
+
+GLuint instance_index_buffer();
+
+// Deletes the buffer (while the context is alive); the next call to
+// instance_index_buffer() creates it again.
+void release_instance_index_buffer();
+
+// Uploads bytes to a buffer that is rewritten every frame. The buffer is
+// created on first use and grown as needed (capacity in bytes). Re-specifying
+// the storage orphans the old one, so that we don't wait for the previous
+// frame's draws to finish reading it.
+void stream_buffer_data(GLenum target, GLuint& buffer, std::size_t& capacity, const void* data, std::size_t bytes);
+
+// Per-instance record, as read by vs_phong.glsl (std430 layout). The material
+// index and texture layer are only used by the indirect draw path, which
+// looks materials and textures up on the GPU.
+struct InstanceData {
+    Mat44f model;
+    GLuint material;
+    GLuint layer;
+    GLuint pad[2];
+};
+
+// Per-frame uniforms, as read by vs_phong.glsl and fs_phong.glsl (std140,
+// uniform buffer binding 0). Written once per frame into the stream buffer.
+struct FrameUniforms {
+    Mat44f view;
+    Mat44f projection;
+    Vec4f viewPos;
+    // Light clusters (see ClusteredLighting.h); off unless clusterGrid[3] is set
+    Vec4f clusterDepth{ 0.f, 0.f, 0.f, 0.f };  // first slice boundary, far plane, slices / log(far / first)
+    Vec4f clusterTile{ 0.f, 0.f, 0.f, 0.f };   // size of a screen tile in pixels
+    GLuint clusterGrid[4] = {};                 // tiles x, y, slices, enabled
+    // Shadow maps (see CascadedShadows.h); off unless shadowCascades[0] is set
+    Mat44f shadowMatrices[4] = {};              // world -> shadow map coordinates and depth, per cascade
+    Vec4f shadowSplits{ 0.f, 0.f, 0.f, 0.f };  // far boundary (view depth) of each cascade
+    Vec4f shadowTexel{ 0.f, 0.f, 0.f, 0.f };   // world size of a shadow map texel, per cascade
+    GLuint shadowCascades[4] = {};              // cascades, shadow map size
+};
 
 struct Vertex {
 	Vec3f Position;
@@ -12,6 +61,8 @@ struct Vertex {
 };
 
 struct PhongMaterial {
+    // Small, unique id used to tell materials apart in render queue sort keys.
+    unsigned int id;
     Vec3f ambient;
     Vec3f diffuse;
     Vec3f specular;
@@ -24,7 +75,11 @@ struct PhongMaterial {
         specular = { g, h, i };
         shininess = j;
         emission = { k, l, m };
+        id = next_id_++;
     }
+
+private:
+    static inline unsigned int next_id_ = 0;
 };
 
 
@@ -46,16 +101,21 @@ public:
     const std::vector<Vertex> vertices;
     const std::vector<unsigned int> indices;
     //std::vector<Vec3f> normal;
-    unsigned int VAO, VBO, EBO;
+    // The mesh lives in the shared geometry arena, so VAO is the arena's VAO.
+    unsigned int VAO = 0;
+    GeometryAllocation geometry;
+    // Local-space bounds of the mesh, computed at load time.
+    AABB bounds;
+    // Small, unique id used to group instances of this mesh.
+    unsigned int id;
 
     /* Functions */
     //MyMesh(vector<Vertex> _vertices, vector<unsigned int> _indices, vector<Texture> _textures);
     //void readMeshFile(string filename);
     RenderObject(std::vector<Vertex> &vertices_, std::vector<unsigned int> &indices_);
-    RenderObject() {};
-    RenderObject(const RenderObject &renderObject) = default;
+    RenderObject();
+    RenderObject(const RenderObject &renderObject) = delete;
     ~RenderObject();
-    void Draw(Shader* shader);
 
     //glm::mat4 m_model_;
 
@@ -65,6 +125,8 @@ private:
     //unsigned int VAO, VBO;// , EBO;
     void setupMesh();
 
+    static inline unsigned int next_id_ = 0;
+
 };
 
 
@@ -73,7 +135,9 @@ public:
     Model(std::shared_ptr<RenderObject> ro_,
         std::shared_ptr<Shader> shader_);
 
-    void Draw();
+    RenderObject* GetRenderObject() const { return ro.get(); }
+    Shader* GetShader() const { return shader.get(); }
+
     Mat44f world_transform;
     std::shared_ptr<PhongMaterial> material;
     unsigned int texture;
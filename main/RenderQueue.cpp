@@ -0,0 +1,241 @@
+#include "RenderQueue.h"
+
+#include <cassert>
+#include <algorithm>
+
+#include "StreamBuffer.h"
+#include "DepthPrepass.h"
+
+#include "../support/error.hpp"
+
+namespace
+{
+	// Sentinel for "nothing known to be bound yet". GL object names are never
+	// this large in practice.
+	constexpr GLuint kUnbound = ~GLuint(0);
+
+	constexpr std::uint64_t mask_(unsigned bits) {
+		return (std::uint64_t(1) << bits) - 1;
+	}
+}
+
+std::uint64_t RenderQueue::make_key_(GLuint program, GLuint texture, GLuint vao, unsigned int material, float depth01) {
+	// GL object names are small integers handed out sequentially, so they fit
+	// the key fields for any scene of reasonable size.
+	assert(program <= mask_(kProgramBits));
+	assert(texture <= mask_(kTextureBits));
+	assert(vao <= mask_(kVaoBits));
+	assert(material <= mask_(kMaterialBits));
+
+	depth01 = std::min(std::max(depth01, 0.f), 1.f);
+	auto const depth = std::uint64_t(depth01 * float(mask_(kDepthBits)));
+
+	std::uint64_t key = program & mask_(kProgramBits);
+	key = (key << kTextureBits) | (texture & mask_(kTextureBits));
+	key = (key << kVaoBits) | (vao & mask_(kVaoBits));
+	key = (key << kMaterialBits) | (material & mask_(kMaterialBits));
+	key = (key << kDepthBits) | depth;
+	return key;
+}
+
+void RenderQueue::radix_sort_(std::vector<Item>& items, std::vector<Item>& scratch) {
+	// LSD radix sort over 8-bit digits. Passes where every key has the same
+	// digit (common for the upper program/texture bits) are skipped.
+	std::size_t const n = items.size();
+	if (n < 2)
+		return;
+
+	scratch.resize(n);
+	Item* src = items.data();
+	Item* dst = scratch.data();
+
+	for (unsigned shift = 0; shift < 64; shift += 8) {
+		std::size_t counts[256] = {};
+		for (std::size_t i = 0; i < n; ++i)
+			++counts[(src[i].key >> shift) & 0xff];
+
+		if (counts[(src[0].key >> shift) & 0xff] == n)
+			continue;
+
+		std::size_t offset = 0;
+		for (auto& count : counts) {
+			std::size_t const c = count;
+			count = offset;
+			offset += c;
+		}
+
+		for (std::size_t i = 0; i < n; ++i)
+			dst[counts[(src[i].key >> shift) & 0xff]++] = src[i];
+
+		std::swap(src, dst);
+	}
+
+	if (src != items.data())
+		items.swap(scratch);
+}
+
+void RenderQueue::Begin(const Mat44f& view_, float zFar_) {
+	view = view_;
+	zFar = zFar_;
+
+	items.clear();
+	draws.clear();
+	stats = RenderQueueStats{};
+}
+
+void RenderQueue::Push(const Model& model) {
+	push_(model.GetRenderObject(), model.GetShader(), model.texture, model.material.get(), model.world_transform);
+}
+
+void RenderQueue::Push(const SceneStorage& scene, std::uint32_t slot) {
+	push_(scene.Mesh(scene.Meshes()[slot]), scene.ShaderOf(scene.Shaders()[slot]), scene.Textures()[slot],
+		scene.Material(scene.Materials()[slot]), scene.Transforms()[slot]);
+}
+
+void RenderQueue::push_(RenderObject* ro, Shader* shader, GLuint texture, const PhongMaterial* material, const Mat44f& world) {
+	// View-space distance of the model's origin, used to order draws that
+	// share all other state front-to-back.
+	Vec4f const origin = view * (world * Vec4f{ 0.f, 0.f, 0.f, 1.f });
+	float const depth01 = -origin.z / zFar;
+
+	Item item;
+	item.key = make_key_(shader->ID, texture, ro->VAO, material->id, depth01);
+	item.draw = std::uint32_t(draws.size());
+	items.push_back(item);
+
+	draws.push_back(DrawData{ ro, shader, texture, material, world });
+}
+
+void RenderQueue::Sort() {
+	radix_sort_(items, scratch);
+}
+
+void RenderQueue::Submit(Shader* shaderOverride, DepthPrepass* prepass) {
+	if (items.size() > kMaxInstances)
+		throw Error("RenderQueue: %zu instances exceed the limit of %u", items.size(), kMaxInstances);
+
+	// Write the per-instance transforms in sorted order, so that each
+	// instanced run refers to a contiguous range of the instance buffer.
+	// They go straight into this frame's part of the stream buffer.
+	StreamBuffer& stream = stream_buffer();
+	StreamAllocation const allocation = stream.Allocate(items.size() * sizeof(InstanceData), stream.StorageAlignment());
+	InstanceData* instances = static_cast<InstanceData*>(allocation.data);
+	for (std::size_t i = 0; i < items.size(); ++i)
+		instances[i] = InstanceData{ draws[items[i].draw].world, 0, 0, {} };
+	stream.Commit(allocation);
+	if (allocation.size)
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, allocation.buffer, allocation.offset, allocation.size);
+
+	if (prepass) {
+		prepass->BeginDepth();
+		draw_depth_();
+		prepass->BeginShading();
+	}
+
+	GLuint program = kUnbound, texture = kUnbound, vao = kUnbound;
+	unsigned int material = ~0u;
+
+	glActiveTexture(GL_TEXTURE0);
+
+	std::uint64_t const stateMask = ~mask_(kDepthBits);
+	for (std::size_t first = 0; first < items.size(); ) {
+		auto const& draw = draws[items[first].draw];
+
+		// Find the run of items that can be drawn with one instanced draw.
+		std::size_t last = first + 1;
+		while (last < items.size()
+			&& (items[last].key & stateMask) == (items[first].key & stateMask)
+			&& draws[items[last].draw].ro == draw.ro)
+			++last;
+
+		Shader* const shader = shaderOverride ? shaderOverride : draw.shader;
+		bool const programChanged = shader->ID != program;
+		if (programChanged) {
+			shader->use();
+			shader->setInt("texture_diffuse", 0);
+			program = shader->ID;
+			++stats.programBinds;
+		}
+
+		if (draw.texture != texture) {
+			glBindTexture(GL_TEXTURE_2D, draw.texture);
+			texture = draw.texture;
+			++stats.textureBinds;
+		}
+
+		// Material uniforms are per-program state, so they need to be
+		// uploaded again whenever the program changes.
+		if (programChanged || draw.material->id != material) {
+			shader->setVec3("material.ambient", draw.material->ambient);
+			shader->setVec3("material.diffuse", draw.material->diffuse);
+			shader->setVec3("material.specular", draw.material->specular);
+			shader->setFloat("material.shininess", draw.material->shininess);
+			shader->setVec3("material.emission", draw.material->emission);
+			material = draw.material->id;
+			++stats.materialUploads;
+		}
+
+		if (draw.ro->VAO != vao) {
+			glBindVertexArray(draw.ro->VAO);
+			vao = draw.ro->VAO;
+			++stats.vaoBinds;
+		}
+
+		glDrawElementsInstancedBaseVertexBaseInstance(
+			GL_TRIANGLES,
+			static_cast<GLsizei>(draw.ro->geometry.indexCount),
+			GL_UNSIGNED_INT,
+			(void*)(draw.ro->geometry.firstIndex * sizeof(GLuint)),
+			static_cast<GLsizei>(last - first),
+			draw.ro->geometry.baseVertex,
+			static_cast<GLuint>(first)
+		);
+		++stats.draws;
+
+		first = last;
+	}
+
+	stats.instances = static_cast<unsigned int>(items.size());
+	stats.programSaved = stats.instances - stats.programBinds;
+	stats.textureSaved = stats.instances - stats.textureBinds;
+	stats.materialSaved = stats.instances - stats.materialUploads;
+	stats.vaoSaved = stats.instances - stats.vaoBinds;
+
+	if (prepass)
+		prepass->End();
+
+	// Leave the same defaults behind as the old direct draw path did.
+	glBindVertexArray(0);
+}
+
+void RenderQueue::draw_depth_() const {
+	// Only the mesh matters here, so runs can span several materials and
+	// textures.
+	for (std::size_t first = 0; first < items.size(); ) {
+		RenderObject const* ro = draws[items[first].draw].ro;
+
+		std::size_t last = first + 1;
+		while (last < items.size() && draws[items[last].draw].ro == ro)
+			++last;
+
+		glDrawElementsInstancedBaseVertexBaseInstance(
+			GL_TRIANGLES,
+			static_cast<GLsizei>(ro->geometry.indexCount),
+			GL_UNSIGNED_INT,
+			(void*)(ro->geometry.firstIndex * sizeof(GLuint)),
+			static_cast<GLsizei>(last - first),
+			ro->geometry.baseVertex,
+			static_cast<GLuint>(first)
+		);
+
+		first = last;
+	}
+}
+
+void RenderQueue::Release() {
+	// The instance data lives in the shared stream buffer; just free the
+	// queue's own memory.
+	std::vector<Item>().swap(items);
+	std::vector<Item>().swap(scratch);
+	std::vector<DrawData>().swap(draws);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Render.h"
+#include "SceneStorage.h"
+
+class DepthPrepass;
+
+// Per-frame counters for the render queue. "Saved" counts the state changes
+// that the old Model::Draw() path would have issued for every model, but that
+// the queue skipped because the state was already bound (or because the model
+// was folded into an instanced draw).
+struct RenderQueueStats {
+    unsigned int draws = 0;
+    unsigned int instances = 0;
+
+    unsigned int programBinds = 0, programSaved = 0;
+    unsigned int textureBinds = 0, textureSaved = 0;
+    unsigned int vaoBinds = 0, vaoSaved = 0;
+    unsigned int materialUploads = 0, materialSaved = 0;
+
+    unsigned int BindsSaved() const {
+        return programSaved + textureSaved + vaoSaved + materialSaved;
+    }
+};
+
+
+// State-sorted render queue.
+//
+// Each frame, models are pushed into a flat array together with a packed
+// 64-bit sort key. The key is laid out (from most to least significant bits)
+// as:
+//
+//   | program (8) | texture (12) | VAO (12) | material (8) | depth (24) |
+//
+// so that sorting the keys groups draws by the most expensive state changes
+// first, and orders draws that share all state front-to-back. The keys are
+// sorted with a LSD radix sort, and Submit() then walks the sorted array and
+// only issues the GL calls whose state differs from the previous draw.
+//
+// Runs of sorted items that share the same RenderObject, program, texture and
+// material are drawn as a single instanced draw. Their world transforms are
+// written, in sorted order, into the frame's stream buffer (see StreamBuffer)
+// and bound as the instance buffer (SSBO binding 0) that vs_phong.glsl
+// indexes with the per-instance index attribute.
+//
+// Usage:
+//    queue.Begin( view, zFar );
+//    for( std::uint32_t slot : visible )
+//        queue.Push( scene, slot );
+//    queue.Sort();
+//    queue.Submit();
+class RenderQueue {
+public:
+    void Begin(const Mat44f& view, float zFar);
+    void Push(const Model& model);
+    void Push(const SceneStorage& scene, std::uint32_t slot);
+    void Sort();
+    // With shaderOverride, every draw uses that program instead of its own
+    // (e.g. the G-buffer variant for deferred shading). With prepass, the
+    // queue is drawn depth only first (see DepthPrepass).
+    void Submit(Shader* shaderOverride = nullptr, DepthPrepass* prepass = nullptr);
+    void Release();
+
+    std::size_t Size() const { return items.size(); }
+    const RenderQueueStats& Stats() const { return stats; }
+
+    static constexpr unsigned kProgramBits = 8;
+    static constexpr unsigned kTextureBits = 12;
+    static constexpr unsigned kVaoBits = 12;
+    static constexpr unsigned kMaterialBits = 8;
+    static constexpr unsigned kDepthBits = 24;
+
+private:
+    struct Item {
+        std::uint64_t key;
+        std::uint32_t draw;
+    };
+
+    struct DrawData {
+        RenderObject* ro;
+        Shader* shader;
+        GLuint texture;
+        const PhongMaterial* material;
+        Mat44f world;
+    };
+
+    void draw_depth_() const;
+    void push_(RenderObject* ro, Shader* shader, GLuint texture, const PhongMaterial* material, const Mat44f& world);
+    static std::uint64_t make_key_(GLuint program, GLuint texture, GLuint vao, unsigned int material, float depth01);
+    static void radix_sort_(std::vector<Item>& items, std::vector<Item>& scratch);
+
+    Mat44f view = kIdentity44f;
+    float zFar = 1.f;
+
+    std::vector<Item> items;
+    std::vector<Item> scratch;
+    std::vector<DrawData> draws;
+
+    RenderQueueStats stats;
+};
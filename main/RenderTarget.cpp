@@ -0,0 +1,81 @@
+#include "RenderTarget.h"
+
+#include <algorithm>
+
+#include "../support/error.hpp"
+
+void RenderTarget::Resize(int width_, int height_, std::initializer_list<GLenum> colorFormats) {
+	if (colorFormats.size() < 1 || colorFormats.size() > kMaxColors)
+		throw Error("RenderTarget: %zu color textures requested, 1 to %d supported", colorFormats.size(), kMaxColors);
+
+	bool const sameFormats = colorFormats.size() == std::size_t(colorCount)
+		&& std::equal(colorFormats.begin(), colorFormats.end(), formats);
+	if (0 != framebuffer && width_ == width && height_ == height && sameFormats)
+		return;
+
+	Release();
+	width = width_;
+	height = height_;
+	colorCount = static_cast<int>(colorFormats.size());
+	std::copy(colorFormats.begin(), colorFormats.end(), formats);
+
+	glGenTextures(colorCount, colors);
+	for (int i = 0; i < colorCount; ++i) {
+		glBindTexture(GL_TEXTURE_2D, colors[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	glGenTextures(1, &depth);
+	glBindTexture(GL_TEXTURE_2D, depth);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLint previous = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	GLenum drawBuffers[kMaxColors];
+	for (int i = 0; i < colorCount; ++i) {
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colors[i], 0);
+		drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+	}
+	glDrawBuffers(colorCount, drawBuffers);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+
+	GLenum const status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previous);
+
+	if (GL_FRAMEBUFFER_COMPLETE != status)
+		throw Error("RenderTarget: framebuffer incomplete (0x%x) at %dx%d", status, width, height);
+}
+
+void RenderTarget::Bind() const {
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+}
+
+void RenderTarget::BlitTo(GLuint target) const {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
+
+void RenderTarget::Release() {
+	if (0 != framebuffer)
+		glDeleteFramebuffers(1, &framebuffer);
+	if (0 != colorCount)
+		glDeleteTextures(colorCount, colors);
+	if (0 != depth)
+		glDeleteTextures(1, &depth);
+
+	framebuffer = depth = 0;
+	std::fill(colors, colors + kMaxColors, 0u);
+	colorCount = 0;
+	width = height = 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <initializer_list>
+
+#include <glad.h>
+
+// Offscreen framebuffer with one or more color textures (a single RGBA8 one
+// unless other formats are given, e.g. for the attachments of a G-buffer)
+// and a 32-bit float depth texture, for passes that need to read back the
+// scene's depth. The first color texture is copied to the window with
+// BlitToDefault(), or to another framebuffer with BlitTo().
+class RenderTarget {
+public:
+    static constexpr int kMaxColors = 4;
+
+    // (Re-)creates the textures if the size or formats changed.
+    void Resize(int width, int height, std::initializer_list<GLenum> colorFormats = { GL_RGBA8 });
+
+    // Binds the framebuffer and sets the viewport to cover it.
+    void Bind() const;
+    void BlitToDefault() const { BlitTo(0); }
+    // Copies the first color texture to framebuffer (of the same size),
+    // which is left bound.
+    void BlitTo(GLuint target) const;
+
+    GLuint Framebuffer() const { return framebuffer; }
+    GLuint ColorTexture(int index = 0) const { return colors[index]; }
+    int ColorCount() const { return colorCount; }
+    GLuint DepthTexture() const { return depth; }
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    void Release();
+
+private:
+    GLuint framebuffer = 0;
+    GLuint colors[kMaxColors] = {};
+    GLenum formats[kMaxColors] = {};
+    int colorCount = 0;
+    GLuint depth = 0;
+    int width = 0, height = 0;
+};
@@ -0,0 +1,177 @@
+#include "SceneGraph.h"
+
+#include <chrono>
+#include <cmath>
+
+#include "../support/error.hpp"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	float elapsed_ms(Clock::time_point since) {
+		return std::chrono::duration<float, std::milli>(Clock::now() - since).count();
+	}
+
+	constexpr std::uint32_t kNoPosition = ~std::uint32_t(0);
+
+	// a * b for affine matrices (bottom row 0 0 0 1); skips the bottom row.
+	Mat44f affine_multiply(const Mat44f& a, const Mat44f& b) {
+		Mat44f result = kIdentity44f;
+		for (int i = 0; i < 3; ++i) {
+			float const a0 = a(i, 0), a1 = a(i, 1), a2 = a(i, 2);
+			for (int j = 0; j < 4; ++j)
+				result(i, j) = a0 * b(0, j) + a1 * b(1, j) + a2 * b(2, j);
+			result(i, 3) += a(i, 3);
+		}
+		return result;
+	}
+}
+
+Mat44f Transform::Matrix() const {
+	float const toRadians = PI / 180.f;
+	float const cx = std::cos(rotation.x * toRadians), sx = std::sin(rotation.x * toRadians);
+	float const cy = std::cos(rotation.y * toRadians), sy = std::sin(rotation.y * toRadians);
+	float const cz = std::cos(rotation.z * toRadians), sz = std::sin(rotation.z * toRadians);
+
+	// Rx * Ry * Rz, columns scaled
+	Mat44f m = kIdentity44f;
+	m(0, 0) = cy * cz * scale.x;
+	m(0, 1) = -cy * sz * scale.y;
+	m(0, 2) = sy * scale.z;
+	m(1, 0) = (cx * sz + sx * sy * cz) * scale.x;
+	m(1, 1) = (cx * cz - sx * sy * sz) * scale.y;
+	m(1, 2) = -sx * cy * scale.z;
+	m(2, 0) = (sx * sz - cx * sy * cz) * scale.x;
+	m(2, 1) = (sx * cz + cx * sy * sz) * scale.y;
+	m(2, 2) = cx * cy * scale.z;
+	m(0, 3) = translation.x;
+	m(1, 3) = translation.y;
+	m(2, 3) = translation.z;
+	return m;
+}
+
+SceneGraph::Node SceneGraph::Add(const Transform& local, Node parent) {
+	if (kNoParent != parent && parent >= positions.size())
+		throw Error("SceneGraph: parent %u does not exist", parent);
+
+	// Parents already exist, so appending keeps the order topological.
+	Node const node = static_cast<Node>(positions.size());
+	positions.push_back(static_cast<std::uint32_t>(nodes.size()));
+
+	nodes.push_back(node);
+	parents.push_back(parent);
+	parentPositions.push_back(kNoParent == parent ? kNoPosition : positions[parent]);
+	locals.push_back(local);
+	worlds.push_back(kIdentity44f);
+	dirty.push_back(1);
+	anyDirty = true;
+
+	stats.nodes = static_cast<unsigned int>(nodes.size());
+	return node;
+}
+
+void SceneGraph::SetParent(Node node, Node parent) {
+	for (Node ancestor = parent; kNoParent != ancestor; ancestor = Parent(ancestor)) {
+		if (ancestor == node)
+			throw Error("SceneGraph: node %u can't be a descendant of itself", node);
+	}
+
+	parents[positions[node]] = parent;
+	dirty[positions[node]] = 1;
+	anyDirty = true;
+	sort_();
+}
+
+void SceneGraph::SetLocal(Node node, const Transform& local) {
+	std::uint32_t const position = positions[node];
+	locals[position] = local;
+	dirty[position] = 1;
+	anyDirty = true;
+}
+
+void SceneGraph::Update() {
+	auto const start = Clock::now();
+
+	changed.clear();
+	if (anyDirty) {
+		// A recomputed node keeps its flag until the end of the pass, so its
+		// children (which come later) see it.
+		std::size_t const count = nodes.size();
+		for (std::size_t i = 0; i < count; ++i) {
+			std::uint32_t const parent = parentPositions[i];
+			if (!dirty[i] && (kNoPosition == parent || !dirty[parent]))
+				continue;
+
+			dirty[i] = 1;
+			Mat44f const local = locals[i].Matrix();
+			worlds[i] = kNoPosition == parent ? local : affine_multiply(worlds[parent], local);
+			changed.push_back(nodes[i]);
+		}
+
+		for (Node node : changed)
+			dirty[positions[node]] = 0;
+		anyDirty = false;
+	}
+
+	stats.updated = static_cast<unsigned int>(changed.size());
+	stats.updateMs = elapsed_ms(start);
+}
+
+void SceneGraph::sort_() {
+	std::size_t const count = nodes.size();
+
+	// Children of each node, in the current order
+	std::vector<std::uint32_t> childCounts(count + 1, 0);
+	for (std::size_t i = 0; i < count; ++i) {
+		if (kNoParent != parents[i])
+			++childCounts[parents[i] + 1];
+	}
+	for (std::size_t i = 0; i < count; ++i)
+		childCounts[i + 1] += childCounts[i];
+	std::vector<Node> children(count);
+	std::vector<std::uint32_t> fill(childCounts.begin(), childCounts.end() - 1);
+	for (std::size_t i = 0; i < count; ++i) {
+		if (kNoParent != parents[i])
+			children[fill[parents[i]]++] = nodes[i];
+	}
+
+	// Depth first from the roots, so subtrees end up contiguous
+	std::vector<std::uint32_t> order;   // old positions, in the new order
+	order.reserve(count);
+	std::vector<Node> stack;
+	for (std::size_t i = 0; i < count; ++i) {
+		if (kNoParent != parents[i])
+			continue;
+
+		stack.push_back(nodes[i]);
+		while (!stack.empty()) {
+			Node const node = stack.back();
+			stack.pop_back();
+			order.push_back(positions[node]);
+			for (std::uint32_t c = childCounts[node + 1]; c > childCounts[node]; --c)
+				stack.push_back(children[c - 1]);
+		}
+	}
+
+	std::vector<Node> newNodes(count), newParents(count);
+	std::vector<Transform> newLocals(count);
+	std::vector<Mat44f> newWorlds(count);
+	std::vector<std::uint8_t> newDirty(count);
+	for (std::size_t i = 0; i < count; ++i) {
+		std::uint32_t const old = order[i];
+		newNodes[i] = nodes[old];
+		newParents[i] = parents[old];
+		newLocals[i] = locals[old];
+		newWorlds[i] = worlds[old];
+		newDirty[i] = dirty[old];
+		positions[newNodes[i]] = static_cast<std::uint32_t>(i);
+	}
+	nodes.swap(newNodes);
+	parents.swap(newParents);
+	locals.swap(newLocals);
+	worlds.swap(newWorlds);
+	dirty.swap(newDirty);
+
+	for (std::size_t i = 0; i < count; ++i)
+		parentPositions[i] = kNoParent == parents[i] ? kNoPosition : positions[parents[i]];
+}
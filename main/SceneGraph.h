@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat44.hpp"
+
+// Local transform of a scene graph node: scale, then rotate, then translate.
+// The rotation is given as angles in degrees (like make_rotation_x() etc.)
+// and applied as Rx * Ry * Rz, i.e. about z first.
+struct Transform {
+    Vec3f translation{ 0.f, 0.f, 0.f };
+    Vec3f rotation{ 0.f, 0.f, 0.f };
+    Vec3f scale{ 1.f, 1.f, 1.f };
+
+    Mat44f Matrix() const;
+};
+
+struct SceneGraphStats {
+    unsigned int nodes = 0;
+    unsigned int updated = 0;   // world matrices recomputed by the last Update()
+    float updateMs = 0.f;
+};
+
+
+// Transform hierarchy. Each node has a local Transform and a cached world
+// matrix (parent's world * local).
+//
+// Nodes are stored in flat arrays in topological order (every parent before
+// its children), so Update() is a single linear pass: a node is recomputed
+// if it was changed or its parent was recomputed, and untouched subtrees
+// cost a flag test per node. Subtrees are not necessarily contiguous: Add()
+// appends, so a node added under an older parent comes after unrelated
+// nodes (SetParent() re-sorts depth first, which does make them contiguous
+// until the next Add()). Set the local transforms of
+// animated nodes from the current time before each Update() instead of
+// accumulating changes into them, so that they don't drift.
+//
+// Node handles stay valid when the arrays are reordered by SetParent().
+class SceneGraph {
+public:
+    using Node = std::uint32_t;
+    static constexpr Node kNoParent = ~Node(0);
+
+    // The parent must already exist.
+    Node Add(const Transform& local, Node parent = kNoParent);
+
+    // Moves the node (and its subtree) under another parent, or makes it a
+    // root. Reorders the arrays; throws if it would create a cycle.
+    void SetParent(Node node, Node parent);
+    Node Parent(Node node) const { return parents[positions[node]]; }
+
+    void SetLocal(Node node, const Transform& local);
+    const Transform& Local(Node node) const { return locals[positions[node]]; }
+
+    // As of the last Update().
+    const Mat44f& World(Node node) const { return worlds[positions[node]]; }
+
+    // Recomputes the world matrices of the changed nodes and their
+    // descendants, and lists them in Changed().
+    void Update();
+    const std::vector<Node>& Changed() const { return changed; }
+
+    std::size_t Size() const { return nodes.size(); }
+    const SceneGraphStats& Stats() const { return stats; }
+
+private:
+    void sort_();
+
+    // Indexed by position in the update order
+    std::vector<Node> nodes;                // position -> node
+    std::vector<Node> parents;              // parent node, or kNoParent
+    std::vector<std::uint32_t> parentPositions;
+    std::vector<Transform> locals;
+    std::vector<Mat44f> worlds;
+    std::vector<std::uint8_t> dirty;
+
+    std::vector<std::uint32_t> positions;   // node -> position
+    std::vector<Node> changed;
+    bool anyDirty = false;
+
+    SceneGraphStats stats;
+};
@@ -0,0 +1,110 @@
+#include "SceneStorage.h"
+
+#include "../support/error.hpp"
+
+std::uint32_t SceneStorage::AddMesh(std::shared_ptr<RenderObject> mesh) {
+	meshPointers.push_back(mesh.get());
+	meshBounds.push_back(mesh->bounds);
+	meshResources.push_back(std::move(mesh));
+	return static_cast<std::uint32_t>(meshResources.size() - 1);
+}
+
+std::uint32_t SceneStorage::AddShader(std::shared_ptr<Shader> shader) {
+	shaderPointers.push_back(shader.get());
+	shaderResources.push_back(std::move(shader));
+	return static_cast<std::uint32_t>(shaderResources.size() - 1);
+}
+
+std::uint32_t SceneStorage::AddMaterial(std::shared_ptr<PhongMaterial> material) {
+	materialPointers.push_back(material.get());
+	materialResources.push_back(std::move(material));
+	return static_cast<std::uint32_t>(materialResources.size() - 1);
+}
+
+Entity SceneStorage::Create(std::uint32_t mesh, std::uint32_t shader, std::uint32_t material, GLuint texture, const Mat44f& world) {
+	if (mesh >= meshPointers.size() || shader >= shaderPointers.size() || material >= materialPointers.size())
+		throw Error("SceneStorage: unknown resource (mesh %u, shader %u, material %u)", mesh, shader, material);
+
+	Entity entity;
+	if (!freeIndices.empty()) {
+		entity.index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else {
+		entity.index = static_cast<std::uint32_t>(slots.size());
+		slots.push_back(0);
+		generations.push_back(0);
+	}
+	entity.generation = generations[entity.index];
+
+	std::uint32_t const slot = static_cast<std::uint32_t>(entities.size());
+	slots[entity.index] = slot;
+	entities.push_back(entity);
+
+	transforms.push_back(world);
+	bounds.push_back(transform_aabb(world, meshBounds[mesh]));
+	meshes.push_back(mesh);
+	shaders.push_back(shader);
+	materials.push_back(material);
+	textures.push_back(texture);
+	visibility.push_back(1);
+	return entity;
+}
+
+void SceneStorage::Destroy(Entity entity) {
+	if (!Alive(entity))
+		return;
+
+	// Move the last entity into the freed slot
+	std::uint32_t const slot = slots[entity.index];
+	std::uint32_t const last = static_cast<std::uint32_t>(entities.size() - 1);
+	if (slot != last) {
+		transforms[slot] = transforms[last];
+		bounds[slot] = bounds[last];
+		meshes[slot] = meshes[last];
+		shaders[slot] = shaders[last];
+		materials[slot] = materials[last];
+		textures[slot] = textures[last];
+		visibility[slot] = visibility[last];
+		entities[slot] = entities[last];
+		slots[entities[slot].index] = slot;
+	}
+	transforms.pop_back();
+	bounds.pop_back();
+	meshes.pop_back();
+	shaders.pop_back();
+	materials.pop_back();
+	textures.pop_back();
+	visibility.pop_back();
+	entities.pop_back();
+
+	++generations[entity.index];
+	freeIndices.push_back(entity.index);
+}
+
+bool SceneStorage::Alive(Entity entity) const {
+	// Destroy() bumps the generation, so stale handles don't match
+	return entity.index < generations.size() && generations[entity.index] == entity.generation;
+}
+
+void SceneStorage::Clear() {
+	transforms.clear();
+	bounds.clear();
+	meshes.clear();
+	shaders.clear();
+	materials.clear();
+	textures.clear();
+	visibility.clear();
+	entities.clear();
+	slots.clear();
+	generations.clear();
+	freeIndices.clear();
+
+	meshResources.clear();
+	shaderResources.clear();
+	materialResources.clear();
+	meshPointers.clear();
+	meshBounds.clear();
+	shaderPointers.clear();
+	materialPointers.clear();
+}
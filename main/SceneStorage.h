@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Render.h"
+#include "Bounds.h"
+
+// Handle to an entity of a SceneStorage. The generation tells a destroyed
+// entity from a later one that reuses its index.
+struct Entity {
+    static constexpr std::uint32_t kInvalid = ~std::uint32_t(0);
+
+    std::uint32_t index = kInvalid;
+    std::uint32_t generation = 0;
+
+    bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+
+// Scene storage with one dense array per component (structure of arrays):
+// world transform, world bounds, mesh, shader, material, texture and a
+// visibility flag. Passes over the scene (updating bounds, culling, building
+// draw lists) are linear scans over the arrays they need, instead of walking
+// Models that each hold three shared_ptrs.
+//
+// Meshes, shaders and materials are registered once and referred to by
+// small ids; the storage keeps them alive.
+//
+// Entities are addressed by generational handles. Their components live at
+// a "slot" in the dense arrays; Destroy() moves the last entity into the
+// freed slot, so anything indexed by slot (the BVH, GPU culling buffers)
+// must be rebuilt after destroying entities.
+class SceneStorage {
+public:
+    std::uint32_t AddMesh(std::shared_ptr<RenderObject> mesh);
+    std::uint32_t AddShader(std::shared_ptr<Shader> shader);
+    std::uint32_t AddMaterial(std::shared_ptr<PhongMaterial> material);
+
+    RenderObject* Mesh(std::uint32_t id) const { return meshPointers[id]; }
+    Shader* ShaderOf(std::uint32_t id) const { return shaderPointers[id]; }
+    const PhongMaterial* Material(std::uint32_t id) const { return materialPointers[id]; }
+
+    Entity Create(std::uint32_t mesh, std::uint32_t shader, std::uint32_t material, GLuint texture, const Mat44f& world);
+    void Destroy(Entity entity);
+    bool Alive(Entity entity) const;
+
+    std::uint32_t Slot(Entity entity) const { return slots[entity.index]; }
+    Entity EntityAt(std::uint32_t slot) const { return entities[slot]; }
+
+    // Also recomputes the slot's world bounds.
+    void SetTransform(std::uint32_t slot, const Mat44f& world) {
+        bounds[slot] = transform_aabb(world, meshBounds[meshes[slot]]);
+        transforms[slot] = world;
+    }
+    void SetVisible(std::uint32_t slot, bool visible) { visibility[slot] = visible ? 1 : 0; }
+
+    std::size_t Size() const { return entities.size(); }
+    void Clear();
+
+    // Component arrays, indexed by slot
+    const std::vector<Mat44f>& Transforms() const { return transforms; }
+    const std::vector<AABB>& Bounds() const { return bounds; }
+    const std::vector<std::uint32_t>& Meshes() const { return meshes; }
+    const std::vector<std::uint32_t>& Shaders() const { return shaders; }
+    const std::vector<std::uint32_t>& Materials() const { return materials; }
+    const std::vector<GLuint>& Textures() const { return textures; }
+    const std::vector<std::uint8_t>& Visibility() const { return visibility; }
+
+private:
+    // Components
+    std::vector<Mat44f> transforms;
+    std::vector<AABB> bounds;
+    std::vector<std::uint32_t> meshes;
+    std::vector<std::uint32_t> shaders;
+    std::vector<std::uint32_t> materials;
+    std::vector<GLuint> textures;
+    std::vector<std::uint8_t> visibility;
+    std::vector<Entity> entities;           // slot -> entity
+
+    // Handles
+    std::vector<std::uint32_t> slots;       // entity index -> slot
+    std::vector<std::uint32_t> generations; // entity index -> current generation
+    std::vector<std::uint32_t> freeIndices;
+
+    // Resources
+    std::vector<std::shared_ptr<RenderObject>> meshResources;
+    std::vector<std::shared_ptr<Shader>> shaderResources;
+    std::vector<std::shared_ptr<PhongMaterial>> materialResources;
+    std::vector<RenderObject*> meshPointers;
+    std::vector<AABB> meshBounds;           // local bounds, by mesh id
+    std::vector<Shader*> shaderPointers;
+    std::vector<const PhongMaterial*> materialPointers;
+};
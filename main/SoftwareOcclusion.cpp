@@ -0,0 +1,477 @@
+#include "SoftwareOcclusion.h"
+
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#	include <intrin.h>
+#endif
+
+#include "../support/jobs.hpp"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	float elapsed_ms(Clock::time_point since) {
+		return std::chrono::duration<float, std::milli>(Clock::now() - since).count();
+	}
+
+	constexpr std::size_t kBatchIndices = 3 * 1024;    // triangles per batch
+	constexpr std::size_t kCullBatch = 256;             // boxes per test job, at least
+
+	// Slack for rounding differences between the projection of a box and of
+	// the occluder triangles it is tested against (an occluder's own box can
+	// touch its surface exactly).
+	constexpr float kDepthEpsilon = 1e-6f;
+
+	constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+	// AVX2 needs the CPU to have it, and the OS to save the YMM registers
+	bool cpu_has_avx2() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		__cpuid(info, 1);
+		bool const osxsave = 0 != (info[2] & (1 << 27));
+		bool const avx = 0 != (info[2] & (1 << 28));
+		if (!osxsave || !avx || 6 != (_xgetbv(0) & 6))
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return 0 != (info[1] & (1 << 5));
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_cpu_init();
+		return 0 != __builtin_cpu_supports("avx2"); // checks XGETBV as well
+#else
+		return false;
+#endif
+	}
+
+	// Bits of the pixels [begin, end) of a tile row, both in [0, 32].
+	std::uint32_t span_mask(int begin, int end) {
+		std::uint32_t const from = begin >= 32 ? 0u : ~0u >> begin;
+		std::uint32_t const to = end >= 32 ? 0u : ~0u >> end;
+		return from & ~to;
+	}
+
+	int clamp_int(float v, int lo, int hi) {
+		if (!(v > float(lo)))
+			return lo;
+		if (v >= float(hi))
+			return hi;
+		return int(v);
+	}
+}
+
+SoftwareOcclusion::SoftwareOcclusion(int width_, int height_, unsigned int threads) {
+	threadCount = 0 != threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+	UseAvx2(true);
+	Resize(width_, height_);
+}
+
+SoftwareOcclusion::~SoftwareOcclusion() = default;
+
+void SoftwareOcclusion::UseAvx2(bool enabled) {
+	avx2 = enabled && avx2_built_() && cpu_has_avx2();
+}
+
+void SoftwareOcclusion::Resize(int width_, int height_) {
+	width = width_;
+	height = height_;
+	tilesX = (width + kTileWidth - 1) / kTileWidth;
+	tilesY = (height + kTileHeight - 1) / kTileHeight;
+	binsX = (tilesX + kBinTilesX - 1) / kBinTilesX;
+	binsY = (tilesY + kBinTilesY - 1) / kBinTilesY;
+
+	tiles.resize(std::size_t(tilesX) * tilesY);
+	binned.clear();
+}
+
+void SoftwareOcclusion::Begin(const Mat44f& viewProjection_) {
+	// Workers are only started once occlusion culling is used
+	if (!jobs)
+		jobs = std::make_unique<JobSystem>(threadCount);
+
+	viewProjection = viewProjection_;
+	occluders.clear();
+	batches.clear();
+
+	for (auto& tile : tiles) {
+		std::fill(std::begin(tile.mask), std::end(tile.mask), 0u);
+		tile.zMax0 = 1.f;
+		tile.zMax1 = 0.f;
+	}
+	for (auto& bin : binned)
+		bin.clear();
+
+	stats.occluders = 0;
+	stats.triangles = 0;
+	stats.threads = threadCount;
+}
+
+void SoftwareOcclusion::AddOccluder(const Mat44f& world, const float* positions, std::size_t stride,
+	const unsigned int* indices, std::size_t indexCount) {
+	std::size_t const occluder = occluders.size();
+	occluders.push_back({ viewProjection * world, positions, stride, indices, indexCount - indexCount % 3 });
+
+	for (std::size_t first = 0; first < occluders.back().indexCount; first += kBatchIndices)
+		batches.push_back({ occluder, first, std::min(kBatchIndices, occluders.back().indexCount - first) });
+
+	++stats.occluders;
+}
+
+void SoftwareOcclusion::Rasterize() {
+	auto const start = Clock::now();
+
+	// Bins of every batch; they keep their memory from frame to frame
+	std::size_t const bins = std::size_t(binsX) * binsY;
+	if (binned.size() < batches.size() * bins)
+		binned.resize(batches.size() * bins);
+	triangleCounts.assign(batches.size(), 0u);
+
+	jobs->parallelFor(0, batches.size(), [this](std::size_t begin, std::size_t end) {
+		for (std::size_t batch = begin; batch < end; ++batch)
+			bin_(batches[batch], batch);
+	});
+
+	jobs->parallelFor(0, bins, [this](std::size_t begin, std::size_t end) {
+		for (std::size_t bin = begin; bin < end; ++bin)
+			rasterize_bin_(static_cast<int>(bin));
+	});
+
+	stats.triangles = 0;
+	for (unsigned int count : triangleCounts)
+		stats.triangles += count;
+	stats.rasterMs = elapsed_ms(start);
+}
+
+void SoftwareOcclusion::bin_(const Batch& batch, std::size_t slot) {
+	Occluder const& occluder = occluders[batch.occluder];
+
+	for (std::size_t i = batch.firstIndex; i < batch.firstIndex + batch.indexCount; i += 3) {
+		Vec4f clip[3];
+		for (int k = 0; k < 3; ++k) {
+			auto const* bytes = reinterpret_cast<const unsigned char*>(occluder.positions);
+			auto const* p = reinterpret_cast<const float*>(bytes + occluder.stride * occluder.indices[i + k]);
+			clip[k] = occluder.transform * Vec4f{ p[0], p[1], p[2], 1.f };
+		}
+		bin_triangle_(clip, slot);
+	}
+}
+
+void SoftwareOcclusion::bin_triangle_(const Vec4f clip[3], std::size_t slot) {
+	// Reject triangles entirely outside one of the frustum planes (other
+	// than the near plane, which is clipped against below).
+	auto outside = [&](auto&& test) {
+		return test(clip[0]) && test(clip[1]) && test(clip[2]);
+	};
+	if (outside([](const Vec4f& v) { return v.x < -v.w; }) || outside([](const Vec4f& v) { return v.x > v.w; })
+		|| outside([](const Vec4f& v) { return v.y < -v.w; }) || outside([](const Vec4f& v) { return v.y > v.w; })
+		|| outside([](const Vec4f& v) { return v.z > v.w; }))
+		return;
+
+	// Clip against the near plane (z >= -w)
+	Vec4f polygon[4];
+	int count = 0;
+	for (int i = 0; i < 3; ++i) {
+		Vec4f const& a = clip[i];
+		Vec4f const& b = clip[(i + 1) % 3];
+		float const da = a.z + a.w;
+		float const db = b.z + b.w;
+
+		if (da >= 0.f)
+			polygon[count++] = a;
+		if ((da >= 0.f) != (db >= 0.f)) {
+			float const t = da / (da - db);
+			polygon[count++] = a + t * (b - a);
+		}
+	}
+	if (count < 3)
+		return;
+
+	Triangle screen[2];
+	for (int i = 0; i < count; ++i) {
+		float const invW = 1.f / polygon[i].w;
+		float const x = (polygon[i].x * invW * 0.5f + 0.5f) * width;
+		float const y = (polygon[i].y * invW * 0.5f + 0.5f) * height;
+		float const z = polygon[i].z * invW * 0.5f + 0.5f;
+
+		// Fan: (0, 1, 2) and (0, 2, 3)
+		if (i < 3) {
+			screen[0].x[i] = x; screen[0].y[i] = y; screen[0].z[i] = z;
+		}
+		if (0 == i || i >= 2) {
+			int const k = 0 == i ? 0 : i - 1;
+			screen[1].x[k] = x; screen[1].y[k] = y; screen[1].z[k] = z;
+		}
+	}
+
+	int const bins = binsX * binsY;
+	for (int t = 0; t < count - 2; ++t) {
+		Triangle const& tri = screen[t];
+
+		// Back faces and degenerate triangles
+		float const area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+		if (!(area > 0.f))
+			continue;
+
+		float const minX = std::min({ tri.x[0], tri.x[1], tri.x[2] });
+		float const maxX = std::max({ tri.x[0], tri.x[1], tri.x[2] });
+		float const minY = std::min({ tri.y[0], tri.y[1], tri.y[2] });
+		float const maxY = std::max({ tri.y[0], tri.y[1], tri.y[2] });
+
+		int const binX0 = clamp_int(minX / (kTileWidth * kBinTilesX), 0, binsX);
+		int const binX1 = clamp_int(maxX / (kTileWidth * kBinTilesX) + 1.f, 0, binsX);
+		int const binY0 = clamp_int(minY / (kTileHeight * kBinTilesY), 0, binsY);
+		int const binY1 = clamp_int(maxY / (kTileHeight * kBinTilesY) + 1.f, 0, binsY);
+
+		for (int by = binY0; by < binY1; ++by) {
+			for (int bx = binX0; bx < binX1; ++bx)
+				binned[slot * bins + by * binsX + bx].push_back(tri);
+		}
+		++triangleCounts[slot];
+	}
+}
+
+void SoftwareOcclusion::rasterize_bin_(int bin) {
+	int const bx = bin % binsX;
+	int const by = bin / binsX;
+	int const tileX0 = bx * kBinTilesX;
+	int const tileY0 = by * kBinTilesY;
+	int const tileX1 = std::min(tileX0 + kBinTilesX, tilesX);
+	int const tileY1 = std::min(tileY0 + kBinTilesY, tilesY);
+
+	// Batches' triangles in batch order, whichever thread binned them
+	int const bins = binsX * binsY;
+	Edges edges;
+	for (std::size_t batch = 0; batch < batches.size(); ++batch) {
+		for (auto const& tri : binned[batch * bins + bin]) {
+			if (!setup_triangle_(tri, tileX0, tileY0, tileX1, tileY1, edges))
+				continue;
+
+			if (avx2)
+				rasterize_triangle_avx2_(edges, tiles.data(), tilesX);
+			else
+				rasterize_triangle_(edges);
+		}
+	}
+}
+
+bool SoftwareOcclusion::setup_triangle_(const Triangle& tri, int tileX0, int tileY0, int tileX1, int tileY1, Edges& edges) const {
+	float const minX = std::min({ tri.x[0], tri.x[1], tri.x[2] });
+	float const maxX = std::max({ tri.x[0], tri.x[1], tri.x[2] });
+	edges.minY = std::min({ tri.y[0], tri.y[1], tri.y[2] });
+	edges.maxY = std::max({ tri.y[0], tri.y[1], tri.y[2] });
+	edges.maxZ = std::max({ tri.z[0], tri.z[1], tri.z[2] });
+
+	edges.tileX0 = std::max(tileX0, clamp_int(minX / kTileWidth, 0, tilesX));
+	edges.tileX1 = std::min(tileX1, clamp_int(maxX / kTileWidth + 1.f, 0, tilesX));
+	edges.tileY0 = std::max(tileY0, clamp_int(edges.minY / kTileHeight, 0, tilesY));
+	edges.tileY1 = std::min(tileY1, clamp_int(edges.maxY / kTileHeight + 1.f, 0, tilesY));
+	if (edges.tileX0 >= edges.tileX1 || edges.tileY0 >= edges.tileY1)
+		return false;
+
+	float const dx1 = tri.x[1] - tri.x[0], dy1 = tri.y[1] - tri.y[0], dz1 = tri.z[1] - tri.z[0];
+	float const dx2 = tri.x[2] - tri.x[0], dy2 = tri.y[2] - tri.y[0], dz2 = tri.z[2] - tri.z[0];
+	float const area = dx1 * dy2 - dx2 * dy1;
+	edges.a = (dz1 * dy2 - dz2 * dy1) / area;
+	edges.b = (dx1 * dz2 - dx2 * dz1) / area;
+	edges.c = tri.z[0] - edges.a * tri.x[0] - edges.b * tri.y[0];
+
+	edges.lefts = 0;
+	edges.rights = 0;
+	for (int e = 0; e < 3; ++e) {
+		int const f = (e + 1) % 3;
+		float const dy = tri.y[f] - tri.y[e];
+		if (0.f == dy)
+			continue;
+
+		float const slope = (tri.x[f] - tri.x[e]) / dy;
+		if (dy > 0.f) {
+			int const i = edges.rights++;
+			edges.rightX[i] = tri.x[e]; edges.rightY[i] = tri.y[e]; edges.rightSlope[i] = slope;
+		}
+		else {
+			int const i = edges.lefts++;
+			edges.leftX[i] = tri.x[e]; edges.leftY[i] = tri.y[e]; edges.leftSlope[i] = slope;
+		}
+	}
+	return true;
+}
+
+void SoftwareOcclusion::rasterize_triangle_(const Edges& edges) {
+	for (int ty = edges.tileY0; ty < edges.tileY1; ++ty) {
+		float const rowBase = float(ty * kTileHeight) + 0.5f;
+
+		// Rows of the tile, sampled at pixel centres
+		float left[kTileHeight], right[kTileHeight];
+		bool rows[kTileHeight];
+		bool anyRow = false;
+		for (int r = 0; r < kTileHeight; ++r) {
+			float const y = rowBase + r;
+			left[r] = -kInfinity;
+			right[r] = kInfinity;
+			for (int i = 0; i < edges.lefts; ++i)
+				left[r] = std::max(left[r], edges.leftX[i] + (y - edges.leftY[i]) * edges.leftSlope[i]);
+			for (int i = 0; i < edges.rights; ++i)
+				right[r] = std::min(right[r], edges.rightX[i] + (y - edges.rightY[i]) * edges.rightSlope[i]);
+			rows[r] = y >= edges.minY && y < edges.maxY;
+			anyRow = anyRow || rows[r];
+		}
+		if (!anyRow)
+			continue;
+
+		for (int tx = edges.tileX0; tx < edges.tileX1; ++tx) {
+			float const columnBase = float(tx * kTileWidth) + 0.5f;
+
+			// Covered pixels of each row: centres in [left, right)
+			std::uint32_t mask[kTileHeight];
+			bool any = false;
+			for (int r = 0; r < kTileHeight; ++r) {
+				int const begin = clamp_int(std::ceil(left[r] - columnBase), 0, kTileWidth);
+				int const end = clamp_int(std::ceil(right[r] - columnBase), 0, kTileWidth);
+				mask[r] = rows[r] ? span_mask(begin, end) : 0u;
+				any = any || 0 != mask[r];
+			}
+			if (!any)
+				continue;
+
+			// Farthest depth of the triangle within the tile: the plane's
+			// maximum over the tile's corners, but no more than the farthest
+			// vertex.
+			float const x0 = float(tx * kTileWidth), x1 = x0 + kTileWidth;
+			float const y0 = float(ty * kTileHeight), y1 = y0 + kTileHeight;
+			float const z = std::min(edges.maxZ, edges.c + std::max(edges.a * x0, edges.a * x1) + std::max(edges.b * y0, edges.b * y1));
+
+			update_tile_(tiles[std::size_t(ty) * tilesX + tx], mask, z);
+		}
+	}
+}
+
+void SoftwareOcclusion::update_tile_(Tile& tile, const std::uint32_t mask[kTileHeight], float z) {
+	// Nothing to learn from triangles behind what is already known
+	if (z >= tile.zMax0)
+		return;
+
+	// If the triangle is much nearer than the working layer, start the
+	// working layer over (its pixels fall back to zMax0) rather than pushing
+	// the triangle's depth back to it.
+	bool const discard = tile.zMax1 - z > tile.zMax0 - tile.zMax1;
+
+	bool full = true;
+	for (int r = 0; r < kTileHeight; ++r) {
+		tile.mask[r] = (discard ? 0u : tile.mask[r]) | mask[r];
+		full = full && ~0u == tile.mask[r];
+	}
+	if (full)
+		std::fill(std::begin(tile.mask), std::end(tile.mask), 0u);
+
+	tile.zMax1 = discard ? z : std::max(tile.zMax1, z);
+
+	// Fully covered: the working layer becomes the tile's depth
+	if (full) {
+		tile.zMax0 = tile.zMax1;
+		tile.zMax1 = 0.f;
+	}
+}
+
+bool SoftwareOcclusion::covered_(const Tile& tile, std::uint32_t columns, int row0, int row1) {
+	for (int r = row0; r < row1; ++r) {
+		if (0 != (columns & ~tile.mask[r]))
+			return false;
+	}
+	return true;
+}
+
+bool SoftwareOcclusion::Visible(const AABB& box) const {
+	if (box.Empty())
+		return false;
+
+	float minX = kInfinity, maxX = -kInfinity;
+	float minY = kInfinity, maxY = -kInfinity;
+	float nearest = kInfinity;
+	for (int i = 0; i < 8; ++i) {
+		Vec4f const corner{
+			(i & 1) ? box.max.x : box.min.x,
+			(i & 2) ? box.max.y : box.min.y,
+			(i & 4) ? box.max.z : box.min.z,
+			1.f
+		};
+		Vec4f const clip = viewProjection * corner;
+		if (clip.z < -clip.w)
+			return true; // crosses the near plane
+
+		float const invW = 1.f / clip.w;
+		float const x = (clip.x * invW * 0.5f + 0.5f) * width;
+		float const y = (clip.y * invW * 0.5f + 0.5f) * height;
+		minX = std::min(minX, x); maxX = std::max(maxX, x);
+		minY = std::min(minY, y); maxY = std::max(maxY, y);
+		nearest = std::min(nearest, clip.z * invW * 0.5f + 0.5f);
+	}
+	nearest -= kDepthEpsilon;
+
+	// Pixels the box's screen rectangle touches
+	int const x0 = clamp_int(std::floor(minX), 0, width);
+	int const x1 = clamp_int(std::ceil(maxX), 0, width);
+	int const y0 = clamp_int(std::floor(minY), 0, height);
+	int const y1 = clamp_int(std::ceil(maxY), 0, height);
+	if (x0 >= x1 || y0 >= y1)
+		return false; // off screen
+
+	for (int ty = y0 / kTileHeight; ty <= (y1 - 1) / kTileHeight; ++ty) {
+		int const row0 = std::max(y0 - ty * kTileHeight, 0);
+		int const row1 = std::min(y1 - ty * kTileHeight, kTileHeight);
+
+		for (int tx = x0 / kTileWidth; tx <= (x1 - 1) / kTileWidth; ++tx) {
+			Tile const& tile = tiles[std::size_t(ty) * tilesX + tx];
+
+			if (nearest > tile.zMax0)
+				continue; // behind everything in the tile
+			if (nearest <= tile.zMax1)
+				return true; // in front of everything in the tile
+
+			// In between: visible if any of its pixels is outside the
+			// working layer's mask.
+			std::uint32_t const columns = span_mask(
+				std::max(x0 - tx * kTileWidth, 0),
+				std::min(x1 - tx * kTileWidth, kTileWidth)
+			);
+			bool const covered = avx2 ? covered_avx2_(tile, columns, row0, row1) : covered_(tile, columns, row0, row1);
+			if (!covered)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+void SoftwareOcclusion::Cull(const std::vector<AABB>& boxes, std::vector<std::uint32_t>& objects) {
+	auto const start = Clock::now();
+
+	std::vector<unsigned char> visible(objects.size());
+	jobs->parallelFor(0, objects.size(), [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; ++i)
+			visible[i] = Visible(boxes[objects[i]]) ? 1 : 0;
+	}, kCullBatch);
+
+	std::size_t kept = 0;
+	for (std::size_t i = 0; i < objects.size(); ++i) {
+		if (visible[i])
+			objects[kept++] = objects[i];
+	}
+
+	stats.tested = static_cast<unsigned int>(objects.size());
+	stats.occluded = static_cast<unsigned int>(objects.size() - kept);
+	objects.resize(kept);
+	stats.testMs = elapsed_ms(start);
+}
+
+float SoftwareOcclusion::Depth(int x, int y) const {
+	Tile const& tile = tiles[std::size_t(y / kTileHeight) * tilesX + x / kTileWidth];
+	bool const covered = 0 != ((tile.mask[y % kTileHeight] >> (31 - x % kTileWidth)) & 1u);
+	return covered ? tile.zMax1 : tile.zMax0;
+}
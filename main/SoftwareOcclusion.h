@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Bounds.h"
+
+class JobSystem;
+
+struct SoftwareOcclusionStats {
+    unsigned int occluders = 0;
+    unsigned int triangles = 0;     // after clipping and backface culling
+    unsigned int tested = 0;
+    unsigned int occluded = 0;
+    unsigned int threads = 0;
+    float rasterMs = 0.f;           // transform, binning and rasterization
+    float testMs = 0.f;
+};
+
+
+// CPU occlusion culling with a masked, hierarchical software depth buffer
+// (after Hasselgren et al., "Masked Software Occlusion Culling").
+//
+// A few large occluder meshes are rasterized at low resolution. The buffer
+// is split into 32x8 pixel tiles; instead of a depth per pixel, each tile
+// keeps a coverage mask (one bit per pixel, 32 bits per row) and two depths:
+// the farthest depth of the whole tile (zMax0), and the farthest depth of the
+// pixels set in the mask (zMax1). Triangles are merged into a tile with their
+// farthest depth within it, so a pixel's depth is only ever overestimated
+// and tests stay conservative. Rows of a tile are processed with AVX2 (one
+// 32-bit lane per row) if the CPU supports it, checked at runtime; the AVX2
+// code lives in SoftwareOcclusionAvx2.cpp, the only file built with AVX2
+// enabled.
+//
+// Rasterization runs on a JobSystem of its own, created by the first
+// Begin(): triangles are transformed and binned into screen regions in
+// parallel, then each region is rasterized by one job, taking the triangles
+// in the order they were added, so the result doesn't depend on the number
+// of threads. Bounding boxes are tested against the result, also in
+// parallel. Exceptions thrown by the jobs come out of Rasterize() and
+// Cull().
+//
+// Depths are window depths in [0, 1] (larger is farther). Uses no OpenGL.
+class SoftwareOcclusion {
+public:
+    static constexpr int kTileWidth = 32;
+    static constexpr int kTileHeight = 8;
+    static constexpr int kBinTilesX = 2;    // bin = 64x32 pixels
+    static constexpr int kBinTilesY = 4;
+
+    // threads = 0 uses all hardware threads.
+    explicit SoftwareOcclusion(int width = 320, int height = 180, unsigned int threads = 0);
+    ~SoftwareOcclusion();
+
+    void Resize(int width, int height);
+
+    // Clears the buffer and starts collecting occluders.
+    void Begin(const Mat44f& viewProjection);
+
+    // Positions are three floats, stride bytes apart. The mesh must stay
+    // alive until Rasterize() returns. Front faces are counter-clockwise.
+    void AddOccluder(const Mat44f& world, const float* positions, std::size_t stride,
+        const unsigned int* indices, std::size_t indexCount);
+
+    void Rasterize();
+
+    // False if the box is certainly hidden by the occluders.
+    bool Visible(const AABB& box) const;
+
+    // Removes the hidden objects from objects, keeping the order.
+    void Cull(const std::vector<AABB>& boxes, std::vector<std::uint32_t>& objects);
+
+    // Upper bound of the occluder depth at a pixel (1 where there are none).
+    float Depth(int x, int y) const;
+
+    // Whether the AVX2 code is used; it is by default where the CPU
+    // supports it. Enabling it elsewhere does nothing.
+    bool Avx2() const { return avx2; }
+    void UseAvx2(bool enabled);
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    const SoftwareOcclusionStats& Stats() const { return stats; }
+
+private:
+    struct alignas(32) Tile {
+        std::uint32_t mask[kTileHeight];    // bit 31 is the leftmost pixel
+        float zMax0;
+        float zMax1;
+    };
+
+    // Screen-space triangle: x, y in pixels (y up), z window depth.
+    struct Triangle {
+        float x[3], y[3], z[3];
+    };
+
+    struct Occluder {
+        Mat44f transform;   // viewProjection * world
+        const float* positions;
+        std::size_t stride;
+        const unsigned int* indices;
+        std::size_t indexCount;
+    };
+
+    struct Batch {
+        std::size_t occluder;
+        std::size_t firstIndex, indexCount;
+    };
+
+    // A triangle set up for rasterization, clipped to a range of tiles.
+    // The triangle is the intersection of its edges' half planes: for a
+    // counter-clockwise triangle (y up), edges going up bound rows on the
+    // right, edges going down on the left.
+    struct Edges {
+        int tileX0, tileY0, tileX1, tileY1;
+        float minY, maxY, maxZ;
+        float a, b, c;      // depth plane z = a x + b y + c
+        float leftX[3], leftY[3], leftSlope[3];
+        float rightX[3], rightY[3], rightSlope[3];
+        int lefts, rights;
+    };
+
+    void bin_(const Batch& batch, std::size_t slot);
+    void bin_triangle_(const Vec4f clip[3], std::size_t slot);
+    void rasterize_bin_(int bin);
+    bool setup_triangle_(const Triangle& tri, int tileX0, int tileY0, int tileX1, int tileY1, Edges& edges) const;
+    void rasterize_triangle_(const Edges& edges);
+    static void update_tile_(Tile& tile, const std::uint32_t mask[kTileHeight], float z);
+    static bool covered_(const Tile& tile, std::uint32_t columns, int row0, int row1);
+
+    // AVX2 versions (SoftwareOcclusionAvx2.cpp); only called if the CPU
+    // supports AVX2. avx2_built_() is false if the compiler couldn't
+    // target it.
+    static bool avx2_built_();
+    static void rasterize_triangle_avx2_(const Edges& edges, Tile* tiles, int tilesX);
+    static bool covered_avx2_(const Tile& tile, std::uint32_t columns, int row0, int row1);
+
+    int width = 0, height = 0;
+    int tilesX = 0, tilesY = 0;
+    int binsX = 0, binsY = 0;
+    unsigned int threadCount = 1;
+    bool avx2 = false;
+    std::unique_ptr<JobSystem> jobs;
+
+    Mat44f viewProjection;
+    std::vector<Tile> tiles;
+    std::vector<Occluder> occluders;
+    std::vector<Batch> batches;
+    std::vector<std::vector<Triangle>> binned;  // [batch * bins + bin]
+    std::vector<unsigned int> triangleCounts;   // per batch
+
+    SoftwareOcclusionStats stats;
+};
@@ -0,0 +1,124 @@
+#include "SoftwareOcclusion.h"
+
+// The AVX2 code of SoftwareOcclusion, the only file built with AVX2 enabled
+// (see premake5.lua); SoftwareOcclusion only calls it if the CPU supports
+// AVX2. Anything here may be compiled to AVX2 instructions, including
+// inline functions and templates, whose copies the linker may pick for the
+// other files as well: hence this uses nothing but intrinsics and its own
+// helpers, and takes the tiles as a plain pointer.
+
+#include <limits>
+
+#if defined(__AVX2__)
+#	include <immintrin.h>
+
+namespace {
+	constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+	float min_(float a, float b) { return b < a ? b : a; }
+	float max_(float a, float b) { return a < b ? b : a; }
+}
+
+bool SoftwareOcclusion::avx2_built_() {
+	return true;
+}
+
+void SoftwareOcclusion::rasterize_triangle_avx2_(const Edges& edges, Tile* tiles, int tilesX) {
+	__m256i const ones = _mm256_set1_epi32(-1);
+	__m256 const zero = _mm256_setzero_ps();
+	__m256 const full = _mm256_set1_ps(float(kTileWidth));
+
+	for (int ty = edges.tileY0; ty < edges.tileY1; ++ty) {
+		float const rowBase = float(ty * kTileHeight) + 0.5f;
+
+		// One lane per row of the tile, sampled at pixel centres
+		__m256 const y = _mm256_add_ps(_mm256_set1_ps(rowBase), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+		__m256 left = _mm256_set1_ps(-kInfinity);
+		__m256 right = _mm256_set1_ps(kInfinity);
+		for (int i = 0; i < edges.lefts; ++i) {
+			__m256 const x = _mm256_add_ps(_mm256_set1_ps(edges.leftX[i]),
+				_mm256_mul_ps(_mm256_sub_ps(y, _mm256_set1_ps(edges.leftY[i])), _mm256_set1_ps(edges.leftSlope[i])));
+			left = _mm256_max_ps(left, x);
+		}
+		for (int i = 0; i < edges.rights; ++i) {
+			__m256 const x = _mm256_add_ps(_mm256_set1_ps(edges.rightX[i]),
+				_mm256_mul_ps(_mm256_sub_ps(y, _mm256_set1_ps(edges.rightY[i])), _mm256_set1_ps(edges.rightSlope[i])));
+			right = _mm256_min_ps(right, x);
+		}
+		__m256i const rows = _mm256_castps_si256(_mm256_and_ps(
+			_mm256_cmp_ps(y, _mm256_set1_ps(edges.minY), _CMP_GE_OQ),
+			_mm256_cmp_ps(y, _mm256_set1_ps(edges.maxY), _CMP_LT_OQ)
+		));
+		if (_mm256_testz_si256(rows, rows))
+			continue;
+
+		for (int tx = edges.tileX0; tx < edges.tileX1; ++tx) {
+			float const columnBase = float(tx * kTileWidth) + 0.5f;
+
+			// Covered pixels of each row: centres in [left, right)
+			__m256 const offset = _mm256_set1_ps(columnBase);
+			__m256 const begin = _mm256_min_ps(_mm256_max_ps(_mm256_ceil_ps(_mm256_sub_ps(left, offset)), zero), full);
+			__m256 const end = _mm256_min_ps(_mm256_max_ps(_mm256_ceil_ps(_mm256_sub_ps(right, offset)), zero), full);
+			__m256i covered = _mm256_andnot_si256(
+				_mm256_srlv_epi32(ones, _mm256_cvttps_epi32(end)),
+				_mm256_srlv_epi32(ones, _mm256_cvttps_epi32(begin))
+			);
+			covered = _mm256_and_si256(covered, rows);
+			if (_mm256_testz_si256(covered, covered))
+				continue;
+
+			// Farthest depth of the triangle within the tile, as in
+			// rasterize_triangle_()
+			float const x0 = float(tx * kTileWidth), x1 = x0 + kTileWidth;
+			float const y0 = float(ty * kTileHeight), y1 = y0 + kTileHeight;
+			float const z = min_(edges.maxZ, edges.c + max_(edges.a * x0, edges.a * x1) + max_(edges.b * y0, edges.b * y1));
+
+			// Merged as by update_tile_()
+			Tile& tile = tiles[std::size_t(ty) * tilesX + tx];
+			if (z >= tile.zMax0)
+				continue;
+
+			bool const discard = tile.zMax1 - z > tile.zMax0 - tile.zMax1;
+
+			__m256i current = _mm256_load_si256(reinterpret_cast<const __m256i*>(tile.mask));
+			if (discard)
+				current = _mm256_setzero_si256();
+			current = _mm256_or_si256(current, covered);
+			bool const tileFull = 0 != _mm256_testc_si256(current, ones);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(tile.mask), tileFull ? _mm256_setzero_si256() : current);
+
+			tile.zMax1 = discard ? z : max_(tile.zMax1, z);
+			if (tileFull) {
+				tile.zMax0 = tile.zMax1;
+				tile.zMax1 = 0.f;
+			}
+		}
+	}
+}
+
+bool SoftwareOcclusion::covered_avx2_(const Tile& tile, std::uint32_t columns, int row0, int row1) {
+	__m256i const lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i const inRows = _mm256_and_si256(
+		_mm256_cmpgt_epi32(lane, _mm256_set1_epi32(row0 - 1)),
+		_mm256_cmpgt_epi32(_mm256_set1_epi32(row1), lane)
+	);
+	__m256i const rect = _mm256_and_si256(_mm256_set1_epi32(int(columns)), inRows);
+	__m256i const covered = _mm256_load_si256(reinterpret_cast<const __m256i*>(tile.mask));
+	return 0 != _mm256_testc_si256(covered, rect);
+}
+
+#else // !__AVX2__
+
+// The compiler can't target AVX2; never called.
+bool SoftwareOcclusion::avx2_built_() {
+	return false;
+}
+
+void SoftwareOcclusion::rasterize_triangle_avx2_(const Edges&, Tile*, int) {
+}
+
+bool SoftwareOcclusion::covered_avx2_(const Tile&, std::uint32_t, int, int) {
+	return false;
+}
+
+#endif // __AVX2__
@@ -0,0 +1,178 @@
+#include "StorageBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "Bounds.h"
+#include "RenderQueue.h"
+#include "SceneStorage.h"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	float elapsed_ms(Clock::time_point since) {
+		return std::chrono::duration<float, std::milli>(Clock::now() - since).count();
+	}
+
+	struct Timings {
+		float updateMs = 0.f;
+		float cullMs = 0.f;
+		float drawListMs = 0.f;
+		std::size_t visible = 0;
+	};
+
+	float median(std::vector<float> values) {
+		std::sort(values.begin(), values.end());
+		return values[values.size() / 2];
+	}
+
+	// Runs update/cull/draw list passes and returns the median of each.
+	template< class Update, class Cull, class DrawList >
+	Timings measure(int repetitions, Update&& update, Cull&& cull, DrawList&& drawList) {
+		std::vector<float> updates, culls, drawLists;
+		std::size_t visible = 0;
+		for (int r = 0; r < repetitions; ++r) {
+			auto start = Clock::now();
+			update(r);
+			updates.push_back(elapsed_ms(start));
+
+			start = Clock::now();
+			visible = cull();
+			culls.push_back(elapsed_ms(start));
+
+			start = Clock::now();
+			drawList();
+			drawLists.push_back(elapsed_ms(start));
+		}
+
+		Timings result;
+		result.updateMs = median(updates);
+		result.cullMs = median(culls);
+		result.drawListMs = median(drawLists);
+		result.visible = visible;
+		return result;
+	}
+
+	// Cheap on purpose, so that the update pass measures memory traffic
+	// rather than the animation.
+	Mat44f animated(Vec3f base, int repetition) {
+		float const offset = 0.25f * float(repetition % 4);
+		Mat44f world = make_scaling(0.5f, 0.5f, 0.5f);
+		world(0, 3) = base.x;
+		world(1, 3) = base.y + offset;
+		world(2, 3) = base.z;
+		return world;
+	}
+
+	// The current layout's record: Model has no bounds, so they are kept
+	// next to it.
+	struct ModelRecord {
+		Model model;
+		AABB box;
+	};
+
+	void print(const char* layout, std::size_t count, std::size_t bytesPerEntity, const Timings& t) {
+		std::printf("%-14s %8zu entities | %4zu B/entity | update %8.3f ms | cull %8.3f ms (%zu visible) | draw list %8.3f ms\n",
+			layout, count, bytesPerEntity, t.updateMs, t.cullMs, t.visible, t.drawListMs
+		);
+	}
+}
+
+void run_storage_benchmark(std::shared_ptr<RenderObject> mesh, std::shared_ptr<Shader> shader,
+	std::shared_ptr<PhongMaterial> material, GLuint texture,
+	const Mat44f& view, const Mat44f& projection, float zFar) {
+	Frustum const frustum = make_frustum(projection * view);
+	RenderQueue queue;
+
+	for (std::size_t count : { std::size_t(10000), std::size_t(1000000) }) {
+		int const repetitions = count > 100000 ? 5 : 50;
+
+		// Same grid as the --objects stress test
+		std::vector<Vec3f> positions(count);
+		std::size_t const side = std::size_t(std::ceil(std::sqrt(double(count))));
+		for (std::size_t i = 0; i < count; ++i) {
+			positions[i] = Vec3f{ 2.f * (float(i % side) - 0.5f * side), 0.5f, 2.f * (float(i / side) - 0.5f * side) };
+		}
+
+		// Current layout: one Model per object, with its bounds in the same
+		// record (computed from the model's mesh by the update), so culling
+		// strides over whole records to read the boxes.
+		{
+			std::vector<ModelRecord> models;
+			models.reserve(count);
+			for (std::size_t i = 0; i < count; ++i) {
+				models.push_back({ Model(mesh, shader), AABB{} });
+				models.back().model.material = material;
+				models.back().model.texture = texture;
+			}
+			std::vector<std::uint32_t> visible;
+
+			Timings const t = measure(repetitions,
+				[&](int r) {
+					for (std::size_t i = 0; i < count; ++i) {
+						Model& model = models[i].model;
+						model.world_transform = animated(positions[i], r);
+						models[i].box = transform_aabb(model.world_transform, model.GetRenderObject()->bounds);
+					}
+				},
+				[&]() {
+					visible.clear();
+					for (std::size_t i = 0; i < count; ++i) {
+						if (intersects(frustum, models[i].box))
+							visible.push_back(static_cast<std::uint32_t>(i));
+					}
+					return visible.size();
+				},
+				[&]() {
+					queue.Begin(view, zFar);
+					for (std::uint32_t i : visible)
+						queue.Push(models[i].model);
+					queue.Sort();
+				}
+			);
+			print("vector<Model>", count, sizeof(ModelRecord), t);
+		}
+
+		// SceneStorage
+		{
+			SceneStorage scene;
+			std::uint32_t const meshId = scene.AddMesh(mesh);
+			std::uint32_t const shaderId = scene.AddShader(shader);
+			std::uint32_t const materialId = scene.AddMaterial(material);
+			for (std::size_t i = 0; i < count; ++i)
+				scene.Create(meshId, shaderId, materialId, texture, kIdentity44f);
+			std::vector<std::uint32_t> visible;
+
+			Timings const t = measure(repetitions,
+				[&](int r) {
+					for (std::size_t i = 0; i < count; ++i)
+						scene.SetTransform(static_cast<std::uint32_t>(i), animated(positions[i], r));
+				},
+				[&]() {
+					visible.clear();
+					auto const& bounds = scene.Bounds();
+					auto const& shown = scene.Visibility();
+					for (std::size_t i = 0; i < count; ++i) {
+						if (shown[i] && intersects(frustum, bounds[i]))
+							visible.push_back(static_cast<std::uint32_t>(i));
+					}
+					return visible.size();
+				},
+				[&]() {
+					queue.Begin(view, zFar);
+					for (std::uint32_t i : visible)
+						queue.Push(scene, i);
+					queue.Sort();
+				}
+			);
+			std::size_t const bytesPerEntity = sizeof(Mat44f) + sizeof(AABB) + 3 * sizeof(std::uint32_t)
+				+ sizeof(GLuint) + sizeof(std::uint8_t) + sizeof(Entity) + 2 * sizeof(std::uint32_t);
+			print("SceneStorage", count, bytesPerEntity, t);
+		}
+	}
+
+	queue.Release();
+}
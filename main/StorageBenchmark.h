@@ -0,0 +1,13 @@
+#pragma once
+
+#include <memory>
+
+#include "Render.h"
+
+// Compares the std::vector<Model> scene layout with SceneStorage at 10k and
+// 1M entities: updating transforms and bounds, linear frustum culling, and
+// building and sorting a render queue. Prints one line per layout and size.
+// Needs a GL context (for the mesh and shader), but draws nothing.
+void run_storage_benchmark(std::shared_ptr<RenderObject> mesh, std::shared_ptr<Shader> shader,
+    std::shared_ptr<PhongMaterial> material, GLuint texture,
+    const Mat44f& view, const Mat44f& projection, float zFar);
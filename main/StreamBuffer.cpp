@@ -0,0 +1,195 @@
+#include "StreamBuffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "../support/error.hpp"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	float elapsed_ms(Clock::time_point since) {
+		return std::chrono::duration<float, std::milli>(Clock::now() - since).count();
+	}
+
+	// Not used by anything else, so binding the buffer here for setup and
+	// uploads disturbs no other state.
+	constexpr GLenum kTarget = GL_COPY_WRITE_BUFFER;
+
+	constexpr GLbitfield kMapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	constexpr GLuint64 kWaitTimeout = 1000000000; // ns
+}
+
+StreamBuffer& stream_buffer() {
+	static StreamBuffer buffer;
+	return buffer;
+}
+
+void StreamBuffer::BeginFrame() {
+	init_();
+
+	frameAllocations = 0;
+	frameBytes = 0;
+	frameWaitMs = 0.f;
+	head = 0;
+
+	GLsync& fence = fences[region];
+	if (!fence)
+		return;
+
+	// Only wait if the GPU hasn't finished with the region yet
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (GL_TIMEOUT_EXPIRED == result) {
+		++stats.waits;
+		auto const start = Clock::now();
+		do {
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kWaitTimeout);
+		} while (GL_TIMEOUT_EXPIRED == result);
+		frameWaitMs = elapsed_ms(start);
+	}
+	if (GL_WAIT_FAILED == result)
+		throw Error("StreamBuffer: glClientWaitSync() failed");
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void StreamBuffer::EndFrame() {
+	if (0 == buffer)
+		return;
+
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	region = (region + 1) % kRegions;
+
+	// GL keeps them alive until the GPU is done with them
+	if (!retired.empty()) {
+		glDeleteBuffers(static_cast<GLsizei>(retired.size()), retired.data());
+		retired.clear();
+		retiredShadows.clear();
+	}
+
+	stats.allocations = frameAllocations;
+	stats.bytes = frameBytes;
+	stats.waitMs = frameWaitMs;
+	++stats.frames;
+}
+
+StreamAllocation StreamBuffer::Allocate(std::size_t bytes, std::size_t alignment) {
+	init_();
+
+	std::size_t offset = (head + alignment - 1) & ~(alignment - 1);
+	if (offset + bytes > regionBytes) {
+		grow_(bytes + alignment);
+		offset = 0;
+	}
+	head = offset + bytes;
+
+	++frameAllocations;
+	frameBytes += bytes;
+
+	StreamAllocation allocation;
+	allocation.buffer = buffer;
+	allocation.offset = region * regionBytes + offset;
+	allocation.size = bytes;
+	allocation.data = mapped + allocation.offset;
+	return allocation;
+}
+
+void StreamBuffer::Commit(const StreamAllocation& allocation) {
+	// Coherent mappings are seen by the GPU as they are written.
+	if (persistent || 0 == allocation.size)
+		return;
+
+	glBindBuffer(kTarget, allocation.buffer);
+	glBufferSubData(kTarget, allocation.offset, allocation.size, allocation.data);
+	glBindBuffer(kTarget, 0);
+}
+
+StreamAllocation StreamBuffer::Upload(const void* data, std::size_t bytes, std::size_t alignment) {
+	StreamAllocation const allocation = Allocate(bytes, alignment);
+	if (bytes)
+		std::memcpy(allocation.data, data, bytes);
+	Commit(allocation);
+	return allocation;
+}
+
+std::size_t StreamBuffer::UniformAlignment() {
+	init_();
+	return static_cast<std::size_t>(uniformAlignment);
+}
+
+std::size_t StreamBuffer::StorageAlignment() {
+	init_();
+	return static_cast<std::size_t>(storageAlignment);
+}
+
+void StreamBuffer::Release() {
+	for (GLsync& fence : fences) {
+		if (fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	if (0 != buffer)
+		glDeleteBuffers(1, &buffer);   // also unmaps it
+	if (!retired.empty())
+		glDeleteBuffers(static_cast<GLsizei>(retired.size()), retired.data());
+	buffer = 0;
+	mapped = nullptr;
+	retired.clear();
+	shadow.clear();
+	retiredShadows.clear();
+	regionBytes = 0;
+	region = 0;
+	head = 0;
+}
+
+void StreamBuffer::init_() {
+	if (0 != buffer)
+		return;
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+	uniformAlignment = std::max(uniformAlignment, 16);
+	storageAlignment = std::max(storageAlignment, 16);
+
+	persistent = nullptr != glBufferStorage;
+	stats.persistent = persistent;
+	create_(std::max(regionBytes, kInitialRegionBytes));
+}
+
+void StreamBuffer::create_(std::size_t regionBytes_) {
+	regionBytes = regionBytes_;
+	std::size_t const total = kRegions * regionBytes;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(kTarget, buffer);
+	if (persistent) {
+		glBufferStorage(kTarget, total, nullptr, kMapFlags);
+		mapped = static_cast<unsigned char*>(glMapBufferRange(kTarget, 0, total, kMapFlags));
+		if (!mapped)
+			throw Error("StreamBuffer: unable to map %zu bytes", total);
+	}
+	else {
+		glBufferData(kTarget, total, nullptr, GL_STREAM_DRAW);
+		shadow.assign(total, 0);
+		mapped = shadow.data();
+	}
+	glBindBuffer(kTarget, 0);
+
+	stats.regionBytes = regionBytes;
+}
+
+void StreamBuffer::grow_(std::size_t minimum) {
+	// Earlier allocations of this frame point into the old buffer, so keep
+	// it (mapped) until the end of the frame.
+	retired.push_back(buffer);
+	if (!persistent)
+		retiredShadows.push_back(std::move(shadow));
+
+	// The new buffer's regions haven't been used by the GPU; the fences of
+	// the old ones still pace the CPU.
+	create_(std::max(2 * regionBytes, 2 * minimum));
+	++stats.grows;
+}
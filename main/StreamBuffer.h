@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glad.h>
+
+// Part of the stream buffer handed out for this frame. Write through data,
+// then Commit() before GL reads it; bind with buffer and offset.
+struct StreamAllocation {
+    GLuint buffer = 0;
+    std::size_t offset = 0;
+    std::size_t size = 0;
+    void* data = nullptr;
+};
+
+struct StreamBufferStats {
+    bool persistent = false;        // false: glBufferSubData fallback
+    std::size_t regionBytes = 0;
+
+    // Last completed frame
+    unsigned int allocations = 0;
+    std::size_t bytes = 0;
+    float waitMs = 0.f;
+
+    // Since startup
+    unsigned int frames = 0;
+    unsigned int waits = 0;         // frames where the CPU had to wait for the GPU
+    unsigned int grows = 0;
+};
+
+
+// Ring buffer for data that is rewritten every frame (per-frame uniforms,
+// instance data, indirect commands).
+//
+// One buffer is split into kRegions equal regions, one per frame in flight.
+// It is created with glBufferStorage() and mapped once, persistently and
+// coherently, so allocations are written in place and need no driver copy
+// or implicit synchronization. Each region is guarded by a fence set at the
+// end of its frame; BeginFrame() waits on it before the region is reused,
+// which only blocks if the GPU is kRegions frames behind. The waits are
+// counted in the stats.
+//
+// When a frame needs more than a region, the buffer is replaced by a larger
+// one; the old one is kept until the end of the frame, so the frame's
+// earlier allocations stay valid.
+//
+// Without GL 4.4 (glBufferStorage), allocations are written to a copy in
+// client memory and uploaded by Commit() with glBufferSubData() into the
+// fenced region, which still avoids stalls on buffers in use.
+class StreamBuffer {
+public:
+    static constexpr int kRegions = 3;
+    static constexpr std::size_t kInitialRegionBytes = std::size_t(4) << 20;
+
+    void BeginFrame();
+    void EndFrame();
+
+    // alignment must be a power of two.
+    StreamAllocation Allocate(std::size_t bytes, std::size_t alignment);
+    void Commit(const StreamAllocation& allocation);
+
+    // Copies bytes into a new allocation and commits it.
+    StreamAllocation Upload(const void* data, std::size_t bytes, std::size_t alignment);
+
+    // Offset alignments required for binding ranges of the buffer
+    std::size_t UniformAlignment();
+    std::size_t StorageAlignment();
+
+    void Release();
+
+    const StreamBufferStats& Stats() const { return stats; }
+
+private:
+    void init_();
+    void create_(std::size_t regionBytes_);
+    void grow_(std::size_t minimum);
+
+    GLuint buffer = 0;
+    unsigned char* mapped = nullptr;        // persistent mapping, or shadow.data()
+    std::vector<unsigned char> shadow;      // fallback only
+    bool persistent = false;
+
+    std::size_t regionBytes = 0;
+    int region = 0;
+    std::size_t head = 0;                   // next free byte of the current region
+    GLsync fences[kRegions] = {};
+
+    std::vector<GLuint> retired;            // replaced buffers, deleted at EndFrame()
+    std::vector<std::vector<unsigned char>> retiredShadows;
+
+    GLint uniformAlignment = 0;
+    GLint storageAlignment = 0;
+
+    unsigned int frameAllocations = 0;
+    std::size_t frameBytes = 0;
+    float frameWaitMs = 0.f;
+    StreamBufferStats stats;
+};
+
+StreamBuffer& stream_buffer();
@@ -0,0 +1,74 @@
+#include "TextureArray.h"
+
+#include <algorithm>
+
+#include "../support/error.hpp"
+
+GLuint TextureArray::LayerOf(GLuint texture) {
+	auto const it = std::find(textures.begin(), textures.end(), texture);
+	if (it != textures.end())
+		return static_cast<GLuint>(it - textures.begin());
+
+	if (textures.size() >= std::size_t(kMaxLayers))
+		throw Error("TextureArray: out of layers (%d)", kMaxLayers);
+
+	init_();
+
+	GLuint const layer = static_cast<GLuint>(textures.size());
+	textures.push_back(texture);
+
+	GLint width = 0, height = 0;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Copy (and rescale) the source texture into the new layer.
+	GLint previousRead = 0, previousDraw = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array, 0, layer);
+
+	glBlitFramebuffer(0, 0, width, height, 0, 0, kLayerSize, kLayerSize, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+
+	return layer;
+}
+
+void TextureArray::Release() {
+	if (0 != array)
+		glDeleteTextures(1, &array);
+	if (0 != readFbo)
+		glDeleteFramebuffers(1, &readFbo);
+	if (0 != drawFbo)
+		glDeleteFramebuffers(1, &drawFbo);
+
+	array = readFbo = drawFbo = 0;
+	textures.clear();
+}
+
+void TextureArray::init_() {
+	if (0 != array)
+		return;
+
+	glGenTextures(1, &array);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, kLayerSize, kLayerSize, kMaxLayers);
+
+	// Same sampling as loadTexture() uses for the individual textures. (With
+	// nearest filtering there is no point in keeping mipmaps around.)
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glGenFramebuffers(1, &readFbo);
+	glGenFramebuffers(1, &drawFbo);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include <glad.h>
+
+// 2D texture array that regular 2D textures are copied into, one per layer,
+// so that shaders can select a texture per instance instead of the CPU
+// binding textures between draws. Textures of other sizes are rescaled (with
+// a linear filter blit) to kLayerSize x kLayerSize.
+class TextureArray {
+public:
+    static constexpr GLsizei kLayerSize = 1024;
+    static constexpr GLsizei kMaxLayers = 16;
+
+    // Returns the layer that holds texture, copying it in on first use.
+    GLuint LayerOf(GLuint texture);
+
+    GLuint ID() const { return array; }
+    std::size_t Layers() const { return textures.size(); }
+
+    void Release();
+
+private:
+    void init_();
+
+    GLuint array = 0;
+    GLuint readFbo = 0, drawFbo = 0;
+    std::vector<GLuint> textures; // layer -> source texture
+};
@@ -7,12 +7,18 @@
 #include <stdexcept>
 
 #include <cstdio>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <string>
 
 #include "../support/error.hpp"
 #include "../support/program.hpp"
 #include "../support/checkpoint.hpp"
 #include "../support/debug_output.hpp"
+#include "../support/profile.hpp"
 #include "rapidobj/rapidobj.hpp"
 
 
@@ -21,6 +27,32 @@
 
 #include "camera.h"
 #include "Render.h"
+#include "RenderQueue.h"
+#include "IndirectRenderer.h"
+#include "GpuCulling.h"
+#include "Bvh.h"
+#include "SoftwareOcclusion.h"
+#include "OcclusionQueries.h"
+#include "SceneGraph.h"
+#include "SceneStorage.h"
+#include "StorageBenchmark.h"
+#include "JobBenchmark.h"
+#include "StreamBuffer.h"
+#include "ClusteredLighting.h"
+#include "DeferredShading.h"
+#include "GpuTimer.h"
+#include "GpuProfiler.h"
+#include "GlIntercept.h"
+#include "DepthPrepass.h"
+#include "FragmentCounter.h"
+#include "CascadedShadows.h"
+#include "DynamicResolution.h"
+#include "FramePipeline.h"
+#include "FixedTimestep.h"
+#include "FramePacing.h"
+#include "Headless.h"
+#include "Benchmark.h"
+#include "CameraPath.h"
 
 
 namespace
@@ -41,6 +73,87 @@ namespace
 	};
 }
 
+namespace RenderOptions
+{
+	// How the opaque scene is submitted (cycle with F2):
+	//  - queue: state-sorted render queue, one draw per batch
+	//  - indirect: a single glMultiDrawElementsIndirect(), built on the CPU
+	//  - gpu culled: as indirect, with commands filled in by a frustum
+	//    culling compute pass
+	//  - gpu occlusion culled: as gpu culled, plus two-phase Hi-Z occlusion
+	//    culling; renders into an offscreen target
+	enum class DrawPath { queue, indirect, gpuCulled, gpuOcclusionCulled };
+	constexpr int kDrawPathCount = 4;
+	DrawPath draw_path = DrawPath::queue;
+
+	char const* draw_path_name( DrawPath aPath )
+	{
+		switch( aPath )
+		{
+			case DrawPath::queue: return "render queue";
+			case DrawPath::indirect: return "multi-draw indirect";
+			case DrawPath::gpuCulled: return "multi-draw indirect, GPU culled";
+			case DrawPath::gpuOcclusionCulled: return "multi-draw indirect, GPU frustum + Hi-Z occlusion culled";
+		}
+		return "unknown";
+	}
+
+	// Frustum cull the scene on the CPU with the scene BVH before drawing
+	// it with the queue or indirect path (toggle with F3).
+	bool cpu_culling = true;
+
+	// Occlusion cull the queue and indirect paths against a software
+	// rasterized depth buffer of the scene's occluders (toggle with F5).
+	bool software_occlusion = false;
+
+	// Occlusion cull the queue path with hardware occlusion queries on the
+	// models' bounding boxes (toggle with F6).
+	bool occlusion_queries = false;
+
+	// Extra cubes added to the scene for stress testing (--objects N).
+	std::size_t extra_objects = 0;
+
+	// Point lights scattered over the scene (--lights N), shaded with
+	// clustered forward lighting (toggle with F7).
+	std::size_t point_lights = 0;
+	bool clustered_lighting = true;
+
+	// Shade the scene in a fullscreen pass over a G-buffer instead of while
+	// drawing it, with any draw path (toggle with F8).
+	bool deferred_shading = false;
+
+	// Draw the scene depth only first, so that each pixel is shaded once
+	// (toggle with F9).
+	bool depth_prepass = false;
+
+	// Cascaded shadow maps for the main light, with the static casters
+	// cached (toggle with F10).
+	bool shadows = false;
+
+	// Render the scene at a fraction of the window's size, adjusted to hold
+	// a GPU frame time, and upscale it (toggle with F11; --dynamic-resolution,
+	// limits with --target-ms MS, --min-scale S, --max-scale S).
+	bool dynamic_resolution = false;
+	DynamicResolutionSettings dynamic_resolution_settings;
+
+	// Prepare the next frame (animation, culling, sorted draw list) on a
+	// worker thread while the GL thread submits the current one; adds a
+	// frame of latency. Only the queue path without occlusion queries is
+	// prepared this way, the others stay serial (toggle with F12;
+	// --threaded).
+	bool threaded_preparation = false;
+
+	// Frame pacing (cycle with P; --pacing vsync|adaptive|capped|uncapped,
+	// cap with --fps-cap N).
+	FramePacingMode frame_pacing = FramePacingMode::vsync;
+	float fps_cap = 120.f;
+}
+
+namespace SceneControl
+{
+	void pick( Camera const& );
+}
+
 namespace WindowControl
 {
 	constexpr char const* kWindowTitle = "COMP3811 - Coursework 2";
@@ -54,8 +167,31 @@ namespace WindowControl
 	bool firstMouse;
 	float deltaTime;
 	float lastFrameTime;
+	bool showStats = false;
+	float lastStatsTime;
 	Camera camera(Vec3f{ 0.f, 1.f, 5.f });
 
+	// The camera moves in the simulation's fixed steps; frames are drawn
+	// between its position at the last two.
+	FixedTimestep timestep;
+	Vec3f camera_previous_position = camera.Position;
+	FramePacing frame_pacing;
+	Headless headless;
+	Benchmark benchmark;
+	CameraPath recorded_path;	// with --record-path
+
+	// Held keys, sampled once per frame (see sample_input())
+	struct InputState
+	{
+		bool forward = false, backward = false, left = false, right = false;
+		float speedFactor = 1.f;
+	};
+	InputState input;
+	double input_time = 0.0; // glfwGetTime() when sampled
+
+	constexpr float kFastFactor = 3.f;			// while Shift is held
+	constexpr float kSlowFactor = 1.f / 3.f;	// while Ctrl is held
+
 	void glfw_callback_error_( int aErrNum, char const* aErrDesc )
 	{
 		std::fprintf( stderr, "GLFW error: %s (%d)\n", aErrDesc, aErrNum );
@@ -68,24 +204,108 @@ namespace WindowControl
 			glfwSetWindowShouldClose( aWindow, GLFW_TRUE );
 			return;
 		}
-		if (glfwGetKey(aWindow, GLFW_KEY_W) == GLFW_PRESS)
-			camera.ProcessKeyboard(FORWARD, deltaTime);
-		if (glfwGetKey(aWindow, GLFW_KEY_S) == GLFW_PRESS)
-			camera.ProcessKeyboard(BACKWARD, deltaTime);
-		if (glfwGetKey(aWindow, GLFW_KEY_A) == GLFW_PRESS)
-			camera.ProcessKeyboard(LEFT, deltaTime);
-		if (glfwGetKey(aWindow, GLFW_KEY_D) == GLFW_PRESS)
-			camera.ProcessKeyboard(RIGHT, deltaTime);
-		if (glfwGetKey(aWindow, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-			camera.MovementSpeed *= 1.2;
-		if (glfwGetKey(aWindow, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-			camera.MovementSpeed *= 0.8;
+		if( GLFW_KEY_F1 == aKey && GLFW_PRESS == aAction )
+		{
+			showStats = !showStats;
+			return;
+		}
+		if( GLFW_KEY_F2 == aKey && GLFW_PRESS == aAction )
+		{
+			using RenderOptions::DrawPath;
+			auto& path = RenderOptions::draw_path;
+			path = DrawPath( (int(path) + 1) % RenderOptions::kDrawPathCount );
+			std::printf( "draw path: %s\n", RenderOptions::draw_path_name( path ) );
+			return;
+		}
+		if( GLFW_KEY_F3 == aKey && GLFW_PRESS == aAction )
+		{
+			RenderOptions::cpu_culling = !RenderOptions::cpu_culling;
+			std::printf( "CPU frustum culling: %s\n", RenderOptions::cpu_culling ? "on" : "off" );
+			return;
+		}
+		if( GLFW_KEY_F5 == aKey && GLFW_PRESS == aAction )
+		{
+			RenderOptions::software_occlusion = !RenderOptions::software_occlusion;
+			std::printf( "CPU occlusion culling: %s\n", RenderOptions::software_occlusion ? "on" : "off" );
+			return;
+		}
+		if( GLFW_KEY_F6 == aKey && GLFW_PRESS == aAction )
+		{
+			RenderOptions::occlusion_queries = !RenderOptions::occlusion_queries;
+			std::printf( "occlusion queries: %s\n", RenderOptions::occlusion_queries ? "on" : "off" );
+			return;
+		}
+		if( GLFW_KEY_F7 == aKey && GLFW_PRESS == aAction )
+		{
+			RenderOptions::clustered_lighting = !RenderOptions::clustered_lighting;
+			std::printf( "clustered lighting: %s\n", RenderOptions::clustered_lighting ? "on" : "off" );
+			return;
+		}
+		if( GLFW_KEY_F8 == aKey && GLFW_PRESS == aAction )
+		{
+			RenderOptions::deferred_shading = !RenderOptions::deferred_shading;
+			std::printf( "shading: %s\n", RenderOptions::deferred_shading ? "deferred" : "forward" );
+			return;
+		}
+		if( GLFW_KEY_F9 == aKey && GLFW_PRESS == aAction )
+		{
+			RenderOptions::depth_prepass = !RenderOptions::depth_prepass;
+			std::printf( "depth prepass: %s\n", RenderOptions::depth_prepass ? "on" : "off" );
+			return;
+		}
+		if( GLFW_KEY_F10 == aKey && GLFW_PRESS == aAction )
+		{
+			RenderOptions::shadows = !RenderOptions::shadows;
+			std::printf( "shadows: %s\n", RenderOptions::shadows ? "on" : "off" );
+			return;
+		}
+		if( GLFW_KEY_F11 == aKey && GLFW_PRESS == aAction )
+		{
+			RenderOptions::dynamic_resolution = !RenderOptions::dynamic_resolution;
+			std::printf( "dynamic resolution: %s\n", RenderOptions::dynamic_resolution ? "on" : "off" );
+			return;
+		}
+		if( GLFW_KEY_F12 == aKey && GLFW_PRESS == aAction )
+		{
+			RenderOptions::threaded_preparation = !RenderOptions::threaded_preparation;
+			std::printf( "frame preparation: %s\n", RenderOptions::threaded_preparation ? "threaded" : "serial" );
+			return;
+		}
+		if( GLFW_KEY_P == aKey && GLFW_PRESS == aAction )
+		{
+			auto const mode = FramePacingMode( (int(frame_pacing.Mode()) + 1) % kFramePacingModeCount );
+			frame_pacing.SetMode( mode, RenderOptions::fps_cap );
+			std::printf( "frame pacing: %s\n", FramePacing::ModeName( mode ) );
+			return;
+		}
+		if( GLFW_KEY_F4 == aKey && GLFW_PRESS == aAction )
+		{
+			SceneControl::pick( camera );
+			return;
+		}
 	}
 
-
-	void glfw_callback_mouse_(GLFWwindow* window, double xpos, double ypos)
+	// Samples the held keys and the mouse, once per frame, so that movement
+	// doesn't depend on key repeat events. Mouse look is applied at once
+	// rather than in simulation steps, as the mouse gives a position, not a
+	// rate.
+	void sample_input( GLFWwindow* aWindow )
 	{
-		if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_RELEASE)
+		input_time = glfwGetTime();
+
+		input.forward = GLFW_PRESS == glfwGetKey( aWindow, GLFW_KEY_W );
+		input.backward = GLFW_PRESS == glfwGetKey( aWindow, GLFW_KEY_S );
+		input.left = GLFW_PRESS == glfwGetKey( aWindow, GLFW_KEY_A );
+		input.right = GLFW_PRESS == glfwGetKey( aWindow, GLFW_KEY_D );
+		input.speedFactor = 1.f;
+		if( GLFW_PRESS == glfwGetKey( aWindow, GLFW_KEY_LEFT_SHIFT ) )
+			input.speedFactor *= kFastFactor;
+		if( GLFW_PRESS == glfwGetKey( aWindow, GLFW_KEY_LEFT_CONTROL ) )
+			input.speedFactor *= kSlowFactor;
+
+		double xpos, ypos;
+		glfwGetCursorPos( aWindow, &xpos, &ypos );
+		if (glfwGetMouseButton(aWindow, GLFW_MOUSE_BUTTON_LEFT) == GLFW_RELEASE)
 		{
 			lastX = xpos;
 			lastY = ypos;
@@ -105,7 +325,30 @@ namespace WindowControl
 		lastY = ypos;
 
 		camera.ProcessMouseMovement(xoffset, yoffset);
+	}
 
+	// Moves the camera by one simulation step of the sampled input.
+	void step_camera( float aStep )
+	{
+		camera_previous_position = camera.Position;
+
+		float const dt = aStep * input.speedFactor;
+		if( input.forward )
+			camera.ProcessKeyboard( FORWARD, dt );
+		if( input.backward )
+			camera.ProcessKeyboard( BACKWARD, dt );
+		if( input.left )
+			camera.ProcessKeyboard( LEFT, dt );
+		if( input.right )
+			camera.ProcessKeyboard( RIGHT, dt );
+	}
+
+	// The camera as drawn: between the last two steps
+	Camera interpolated_camera()
+	{
+		float const alpha = timestep.Alpha();
+		Vec3f const position = camera_previous_position + (camera.Position - camera_previous_position) * alpha;
+		return Camera( position, camera.WorldUp, camera.Yaw, camera.Pitch );
 	}
 
 
@@ -138,7 +381,73 @@ namespace SceneControl
 	std::shared_ptr<RenderObject> cube;
 	std::shared_ptr<RenderObject> cat;
 	std::shared_ptr<Shader> shader_phong;
-	std::vector<Model> scene;
+	std::shared_ptr<Shader> shader_phong_indirect;
+	std::shared_ptr<Shader> shader_phong_gbuffer;
+	std::shared_ptr<Shader> shader_phong_indirect_gbuffer;
+	std::shared_ptr<Shader> shader_deferred_lighting;
+	SceneStorage scene;
+	IndirectRenderer indirect_renderer;
+	GpuCulling gpu_culling;
+	RenderTarget scene_target;
+	SceneBvh scene_bvh;
+	std::vector<std::uint32_t> visible_models;
+	SoftwareOcclusion software_occlusion;
+	std::vector<Entity> occluders; // large models that hide others
+	OcclusionQueries occlusion_queries;
+	RenderQueue conditional_queue;
+	ClusteredLighting clustered_lighting;
+	std::vector<PointLight> point_lights;
+	std::vector<Vec4f> light_orbits; // centre of each light's circle, phase
+	DeferredShading deferred_shading;
+	GpuTimer scene_timer;
+	GpuProfiler gpu_profiler;
+	GlIntercept gl_intercept; // --gl-intercept
+	DepthPrepass depth_prepass;
+	FragmentCounter fragment_counter;
+	CascadedShadows shadows;
+	std::vector<Entity> dynamic_casters; // animated; the other models are cached in the shadow maps
+	std::vector<std::uint32_t> static_caster_slots, dynamic_caster_slots;
+	DynamicResolution dynamic_resolution;
+
+	// Size the scene is rendered at, and where it ends up: the window, or
+	// the dynamic resolution target
+	int render_width = 0, render_height = 0;
+	GLuint render_output = 0;
+	GLuint window_output = 0;	// the window's framebuffer, or the headless target
+
+	// Everything the GL thread needs to submit a frame, made by
+	// prepare_frame(). There are two, so that one can be prepared on the
+	// pipeline's worker while the other is submitted; the GL thread only
+	// reads the one it submits.
+	struct FrameData {
+		// What the frame is prepared for (see begin_frame())
+		Mat44f view = kIdentity44f;
+		Mat44f projection = kIdentity44f;
+		Vec3f cameraPosition{ 0.f, 0.f, 0.f };
+		float time = 0.f;				// simulated
+		double inputTime = 0.0;			// when the input it was made from was sampled
+
+		std::vector<PointLight> lights;	// at their place on the orbit
+		ShadowCasters casters;			// empty without shadows
+		bool queued = false;			// visible models are in queue, sorted
+		RenderQueue queue;
+		bool prepared = false;
+	};
+	FrameData frames[2];
+	int current_frame = 0;		// submitted next
+	int submitted_frame = 0;	// submitted last
+	float submit_ms = 0.f;		// GL thread CPU time of the last submission
+	FramePipeline frame_pipeline;
+
+	// Transform hierarchy of the hand-placed models; the stress test grid
+	// is static and stays out of it.
+	SceneGraph scene_graph;
+	std::vector<Entity> node_entities; // node -> entity driven by it
+	std::vector<SceneGraph::Node> cat_nodes;
+	constexpr float kCatSwing = 60.f; // degrees
+
+	constexpr float kNearPlane = 0.01f;
+	constexpr float kFarPlane = 500.f;
 
 	std::shared_ptr<PhongMaterial> material_base, material_s, material_d, material_e;
 	std::shared_ptr<Light> light_main;
@@ -193,6 +502,7 @@ namespace SceneControl
 	}
 
 	std::shared_ptr<RenderObject> set_obj_ro(const char* path) {
+		PROFILE_SCOPE("set_obj_ro");
 		rapidobj::Result result = rapidobj::ParseFile(path);
 
 		if (result.error) {
@@ -231,6 +541,7 @@ namespace SceneControl
 	}
 
 	unsigned int loadTexture(const char* path) {
+		PROFILE_SCOPE("loadTexture");
 		unsigned int textureID;
 		glGenTextures(1, &textureID);
 
@@ -279,12 +590,72 @@ namespace SceneControl
 		shader->setFloat("light.intensity", light->intensity);
 	}
 
+	// Makes node drive the entity's world transform.
+	void attach(Entity entity, SceneGraph::Node node) {
+		if (node_entities.size() <= node)
+			node_entities.resize(node + 1);
+		node_entities[node] = entity;
+	}
+
+	// Copies the world matrices of the nodes changed by the last update to
+	// their entities.
+	void apply_scene_graph() {
+		for (SceneGraph::Node node : scene_graph.Changed()) {
+			if (node >= node_entities.size() || !scene.Alive(node_entities[node]))
+				continue;
+
+			std::uint32_t const i = scene.Slot(node_entities[node]);
+			scene.SetTransform(i, scene_graph.World(node));
+			if (std::find(dynamic_casters.begin(), dynamic_casters.end(), node_entities[node]) == dynamic_casters.end())
+				shadows.InvalidateStatic();
+			if (gpu_culling.Size() == scene.Size())
+				gpu_culling.UpdateTransform(i, scene.Transforms()[i]);
+			if (scene_bvh.Size() == scene.Size())
+				scene_bvh.Update(i, scene.Bounds()[i]);
+		}
+	}
+
+	void build_bvh() {
+		scene_bvh.Build(scene.Bounds());
+
+		auto const& stats = scene_bvh.Stats();
+		std::printf("bvh: %u objects, %u nodes, %u leaves, depth %u, built in %.2f ms\n",
+			stats.objects, stats.nodes, stats.leaves, stats.depth, stats.buildMs
+		);
+	}
+
+	// Splits the shown models into static and dynamic shadow casters, and
+	// batches them.
+	void update_shadow_casters(ShadowCasters& casters) {
+		auto const& shown = scene.Visibility();
+		std::vector<char> dynamic(scene.Size(), 0);
+		dynamic_caster_slots.clear();
+		for (Entity entity : dynamic_casters) {
+			std::uint32_t const i = scene.Slot(entity);
+			dynamic[i] = 1;
+			if (shown[i])
+				dynamic_caster_slots.push_back(i);
+		}
+
+		static_caster_slots.clear();
+		for (std::size_t i = 0; i < scene.Size(); ++i) {
+			if (shown[i] && !dynamic[i])
+				static_caster_slots.push_back(static_cast<std::uint32_t>(i));
+		}
+		shadows.PrepareCasters(scene, static_caster_slots, dynamic_caster_slots, casters);
+	}
+
 	void init_scene() {
+		PROFILE_SCOPE("init_scene");
 		cube = set_cube_ro();
 		cat = set_obj_ro("assets/12221_Cat_v1_l3.obj");
 		texture_base = loadTexture("assets/wall.jpg");
 		texture_cat = loadTexture("assets/Cat_diffuse.jpg");
 		shader_phong = std::make_shared<Shader>("assets/vs_phong.glsl", "assets/fs_phong.glsl");
+		shader_phong_indirect = std::make_shared<Shader>("assets/vs_phong.glsl", "assets/fs_phong.glsl", nullptr, "#define INDIRECT_MATERIALS\n");
+		shader_phong_gbuffer = std::make_shared<Shader>("assets/vs_phong.glsl", "assets/fs_phong.glsl", nullptr, "#define GBUFFER\n");
+		shader_phong_indirect_gbuffer = std::make_shared<Shader>("assets/vs_phong.glsl", "assets/fs_phong.glsl", nullptr, "#define INDIRECT_MATERIALS\n#define GBUFFER\n");
+		shader_deferred_lighting = std::make_shared<Shader>("assets/vs_fullscreen.glsl", "assets/fs_phong.glsl", nullptr, "#define DEFERRED_LIGHTING\n");
 		shader_phong->use();
 		material_base = std::make_shared<PhongMaterial>( 1.0,1.0,1.0,1.0,1.0,1.0,1.0,1.0,1.0,32, 0, 0, 0 );
 		material_d = std::make_shared<PhongMaterial>( 0.2,0.2,0.2,0.8989,1.0,1.0,0.2,0.1,0.1,1, 0, 0, 0 );
@@ -293,82 +664,568 @@ namespace SceneControl
 		light_main = std::make_shared<Light>(0.0, 2.0, 2.0, 1.0, 1.0, 1.0, 1.0);
 
 		set_light(shader_phong.get(), light_main.get());
+		shader_phong_indirect->use();
+		set_light(shader_phong_indirect.get(), light_main.get());
+		shader_deferred_lighting->use();
+		set_light(shader_deferred_lighting.get(), light_main.get());
+
+		std::uint32_t const mesh_cube = scene.AddMesh(cube);
+		std::uint32_t const mesh_cat = scene.AddMesh(cat);
+		std::uint32_t const phong = scene.AddShader(shader_phong);
+		std::uint32_t const specular = scene.AddMaterial(material_s);
+		std::uint32_t const diffuse = scene.AddMaterial(material_d);
+		std::uint32_t const emissive = scene.AddMaterial(material_e);
 
-		scene.emplace_back(cube, shader_phong);
 		{
-			auto& model = scene[scene.size() - 1];
-			model.texture = texture_base;
-			model.material = material_s;
-			model.world_transform = make_scaling(15, 0.1, 15);
+			Entity const floor_entity = scene.Create(mesh_cube, phong, specular, texture_base, kIdentity44f);
+			Transform floor;
+			floor.scale = Vec3f{ 15.f, 0.1f, 15.f };
+			attach(floor_entity, scene_graph.Add(floor));
+			occluders.push_back(floor_entity);
 		}
-		scene.emplace_back(cube, shader_phong);
 		{
-			auto& model = scene[scene.size() - 1];
-			model.texture = texture_base;
-			model.material = material_e;
-			model.world_transform = make_translation(Vec3f{ 0.f, 3.f, 0.f }) *
-				make_scaling(0.3, 0.3, 0.3);
+			Entity const lamp_entity = scene.Create(mesh_cube, phong, emissive, texture_base, kIdentity44f);
+			Transform lamp;
+			lamp.translation = Vec3f{ 0.f, 3.f, 0.f };
+			lamp.scale = Vec3f{ 0.3f, 0.3f, 0.3f };
+			attach(lamp_entity, scene_graph.Add(lamp));
 		}
 
-		scene.emplace_back(cat, shader_phong);
-		{
-			auto& model = scene[scene.size() - 1];
-			model.texture = texture_cat;
-			model.material = material_d;
-			model.world_transform = make_translation(Vec3f{ 0.f, .3f, -2.f }) *
-				make_rotation_x(-90)*
-				make_scaling(0.05, 0.05, 0.05);
+		// The cats stand in a row, placed relative to the middle one.
+		Transform row;
+		row.translation = Vec3f{ 0.f, .3f, -2.f };
+		SceneGraph::Node const cat_row = scene_graph.Add(row);
+		for (float x : { 0.f, 4.f, -4.f }) {
+			Entity const cat_entity = scene.Create(mesh_cat, phong, diffuse, texture_cat, kIdentity44f);
+			Transform local;
+			local.translation = Vec3f{ x, 0.f, 0.f };
+			local.rotation = Vec3f{ -90.f, 0.f, 0.f };
+			local.scale = Vec3f{ 0.05f, 0.05f, 0.05f };
+			cat_nodes.push_back(scene_graph.Add(local, cat_row));
+			attach(cat_entity, cat_nodes.back());
+			dynamic_casters.push_back(cat_entity);
+			occluders.push_back(cat_entity);
 		}
-		scene.emplace_back(cat, shader_phong);
-		{
-			auto& model = scene[scene.size() - 1];
-			model.texture = texture_cat;
-			model.material = material_d;
-			model.world_transform = make_translation(Vec3f{ 4.f, .3f, -2.f }) *
-				make_rotation_x(-90)*
-				make_scaling(0.05, 0.05, 0.05);
+
+		// Grid of small (static) cubes for stress testing, spread over a
+		// square around the origin.
+		std::size_t const extra = RenderOptions::extra_objects;
+		std::size_t const side = std::size_t(std::ceil(std::sqrt(double(extra))));
+		for (std::size_t i = 0; i < extra; ++i) {
+			float const x = float(i % side) - 0.5f * side;
+			float const z = float(i / side) - 0.5f * side;
+
+			scene.Create(mesh_cube, phong, specular, texture_base,
+				make_translation(Vec3f{ 2.f * x, 0.5f, 2.f * z }) * make_scaling(0.5, 0.5, 0.5)
+			);
 		}
-		scene.emplace_back(cat, shader_phong);
-		{
-			auto& model = scene[scene.size() - 1];
-			model.texture = texture_cat;
-			model.material = material_d;
-			model.world_transform = make_translation(Vec3f{ -4.f, .3f, -2.f }) *
-				make_rotation_x(-90)*
-				make_scaling(0.05, 0.05, 0.05);
+
+		// Point lights for the clustered lighting benchmark, over the floor
+		// (or the stress test grid, if larger) and beyond if needed to keep
+		// them at about one per 2x2 square, so that the number of lights
+		// touching a pixel doesn't grow with the total.
+		std::size_t const lights = RenderOptions::point_lights;
+		float const extent = std::max(7.5f, float(side));
+		float const spread = std::max(extent, std::sqrt(float(lights)));
+		std::mt19937 random(3811);
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+		for (std::size_t i = 0; i < lights; ++i) {
+			Vec4f const orbit{ spread * (2.f * unit(random) - 1.f), 0.2f + 1.3f * unit(random), spread * (2.f * unit(random) - 1.f), 2.f * float(PI) * unit(random) };
+			light_orbits.push_back(orbit);
+
+			// Saturated colours of random hue
+			float const hue = 6.f * unit(random);
+			Vec3f const color{
+				std::clamp(std::abs(hue - 3.f) - 1.f, 0.f, 1.f),
+				std::clamp(2.f - std::abs(hue - 2.f), 0.f, 1.f),
+				std::clamp(2.f - std::abs(hue - 4.f), 0.f, 1.f)
+			};
+			PointLight light;
+			light.positionRadius = Vec4f{ orbit.x, orbit.y, orbit.z, 1.f + 1.5f * unit(random) };
+			light.colorIntensity = Vec4f{ color.x, color.y, color.z, 0.5f };
+			point_lights.push_back(light);
 		}
 
+		scene_graph.Update();
+		apply_scene_graph();
+		build_bvh();
 	}
 	
 
-	void update_scene(Camera& camera) {
-		matrix_view = camera.GetViewMatrix();
-		matrix_projection = make_perspective_projection(
+	// Whether prepare_frame() builds the frame's draw list: only for the
+	// queue path without occlusion queries. The other paths cull on the GPU
+	// or with results of the GL thread, so they cull while drawing.
+	bool prepares_draw_list() {
+		return RenderOptions::DrawPath::queue == RenderOptions::draw_path && !RenderOptions::occlusion_queries;
+	}
+
+	// Finds the shown models in the view, into visible_models.
+	void find_visible_models(const Mat44f& viewProjection) {
+		// Entities hidden with SceneStorage::SetVisible() are never drawn
+		auto const& shown = scene.Visibility();
+		visible_models.clear();
+		if (RenderOptions::cpu_culling) {
+			scene_bvh.Cull(make_frustum(viewProjection), visible_models);
+			visible_models.erase(std::remove_if(visible_models.begin(), visible_models.end(),
+				[&shown](std::uint32_t i) { return !shown[i]; }), visible_models.end());
+		}
+		else {
+			for (std::size_t i = 0; i < scene.Size(); ++i) {
+				if (shown[i])
+					visible_models.push_back(static_cast<std::uint32_t>(i));
+			}
+		}
+
+		if (RenderOptions::software_occlusion) {
+			software_occlusion.Begin(viewProjection);
+			for (Entity occluder : occluders) {
+				std::uint32_t const i = scene.Slot(occluder);
+				RenderObject const* ro = scene.Mesh(scene.Meshes()[i]);
+				software_occlusion.AddOccluder(scene.Transforms()[i],
+					&ro->vertices[0].Position.x, sizeof(Vertex),
+					ro->indices.data(), ro->indices.size()
+				);
+			}
+			software_occlusion.Rasterize();
+			software_occlusion.Cull(scene_bvh.ObjectBounds(), visible_models);
+		}
+	}
+
+	// Captures the camera and the (simulated) time that the frame is
+	// prepared for.
+	void begin_frame(FrameData& frame, Camera& camera) {
+		frame.view = camera.GetViewMatrix();
+		frame.projection = make_perspective_projection(
 			PI/2.0,
 			(float)WindowControl::_window_width_ / WindowControl::_window_height_,
-			0.01f,
-			500.f
+			kNearPlane,
+			kFarPlane
 		);
-		
-		
-		shader_phong->setMat4("view", matrix_view);
-		shader_phong->setMat4("projection", matrix_projection);
-		shader_phong->setVec3("viewPos", camera.Position);
-		
-		// time
-		// 
+		frame.cameraPosition = camera.Position;
+		frame.time = float(WindowControl::timestep.FrameTime());
+		frame.inputTime = WindowControl::input_time;
+	}
+
+	// The CPU side of a frame: animation, transform updates, shadow caster
+	// batches and, if prepares_draw_list(), culling and the sorted draw list.
+	// Makes no GL calls, so it may run on the pipeline's worker; the GL
+	// thread then leaves the scene alone until it has waited for it.
+	void prepare_frame(FrameData& frame) {
+		PROFILE_SCOPE("prepare_frame");
+		// The point lights circle around their place
+		frame.lights = point_lights;
+		for (std::size_t i = 0; i < frame.lights.size(); ++i) {
+			float const angle = frame.time + light_orbits[i].w;
+			frame.lights[i].positionRadius.x = light_orbits[i].x + 0.5f * std::cos(angle);
+			frame.lights[i].positionRadius.z = light_orbits[i].z + 0.5f * std::sin(angle);
+		}
+
+		// The cats swing about their vertical axis (z before the -90 degree
+		// turn about x), as a function of time so that nothing accumulates.
+		float const swing = kCatSwing * (1.f - std::cos(frame.time));
+		for (SceneGraph::Node node : cat_nodes) {
+			Transform local = scene_graph.Local(node);
+			local.rotation.z = swing;
+			scene_graph.SetLocal(node, local);
+		}
+		scene_graph.Update();
+		apply_scene_graph();
+		scene_bvh.Refit();
+
+		if (RenderOptions::shadows)
+			update_shadow_casters(frame.casters);
+		else
+			frame.casters = ShadowCasters{};
+
+		frame.queued = prepares_draw_list();
+		if (frame.queued) {
+			find_visible_models(frame.projection * frame.view);
+			frame.queue.Begin(frame.view, kFarPlane);
+			for (std::uint32_t i : visible_models)
+				frame.queue.Push(scene, i);
+			frame.queue.Sort();
+		}
+		frame.prepared = true;
+	}
+
+	// The GL side of the frame's setup: light assignment, shadow maps and
+	// the frame's uniforms.
+	void update_scene(FrameData const& frame) {
+		PROFILE_SCOPE("update_scene");
+		matrix_view = frame.view;
+		matrix_projection = frame.projection;
+
+		FrameUniforms uniforms;
+		uniforms.view = matrix_view;
+		uniforms.projection = matrix_projection;
+		uniforms.viewPos = Vec4f{ frame.cameraPosition.x, frame.cameraPosition.y, frame.cameraPosition.z, 1.f };
+		if (RenderOptions::clustered_lighting && !frame.lights.empty()) {
+			GpuProfileScope zone(gpu_profiler, "light assignment");
+			clustered_lighting.Assign(frame.lights, matrix_view, matrix_projection, kNearPlane, kFarPlane,
+				render_width, render_height
+			);
+			clustered_lighting.SetUniforms(uniforms);
+		}
+		if (RenderOptions::shadows && frame.casters.staticBatch) {
+			// Binds its own uniforms for the shadow passes, so goes before
+			// the frame's are bound
+			GpuProfileScope zone(gpu_profiler, "shadows");
+			shadows.Render(frame.casters, depth_prepass, light_main->position, matrix_view, matrix_projection, kNearPlane, kFarPlane,
+				render_width, render_height
+			);
+			shadows.SetUniforms(uniforms);
+		}
+		StreamBuffer& stream = stream_buffer();
+		StreamAllocation const allocation = stream.Upload(&uniforms, sizeof(uniforms), stream.UniformAlignment());
+		glBindBufferRange(GL_UNIFORM_BUFFER, 0, allocation.buffer, allocation.offset, allocation.size);
+	}
+
+	// Draws the scene's models with the current draw path, shaded, or into
+	// the bound G-buffer if deferred.
+	void draw_models(FrameData& frame, bool deferred) {
+		using RenderOptions::DrawPath;
+
+		Shader& indirect_shader = deferred ? *shader_phong_indirect_gbuffer : *shader_phong_indirect;
+		Shader* const queue_shader = deferred ? shader_phong_gbuffer.get() : nullptr; // else their own
+		DepthPrepass* const prepass = RenderOptions::depth_prepass ? &depth_prepass : nullptr;
+
+		if (frame.queued && prepares_draw_list()) {
+			frame.queue.Submit(queue_shader, prepass);
+			return;
+		}
+
+		if (DrawPath::gpuCulled == RenderOptions::draw_path || DrawPath::gpuOcclusionCulled == RenderOptions::draw_path) {
+			if (gpu_culling.Size() != scene.Size())
+				gpu_culling.Build(scene, indirect_renderer);
+
+			if (DrawPath::gpuCulled == RenderOptions::draw_path) {
+				gpu_culling.Submit(indirect_shader, indirect_renderer, matrix_projection * matrix_view, nullptr, prepass);
+				return;
+			}
+
+			// Occlusion culling reads back the scene's depth, so draw into
+			// a target with a depth texture; the G-buffer has one.
+			if (deferred) {
+				gpu_culling.Submit(indirect_shader, indirect_renderer, matrix_projection * matrix_view, &deferred_shading.GBuffer(), prepass);
+				return;
+			}
+			scene_target.Resize(render_width, render_height);
+			scene_target.Bind();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			gpu_culling.Submit(*shader_phong_indirect, indirect_renderer, matrix_projection * matrix_view, &scene_target, prepass);
+			scene_target.BlitTo(render_output);
+			return;
+		}
 
-		for (int i = 2; i < scene.size(); ++i) {
-			Mat44f rot = make_rotation_z(sin(WindowControl::lastFrameTime));
-			scene[i].world_transform = scene[i].world_transform * rot;
+		find_visible_models(matrix_projection * matrix_view);
 
+		if (DrawPath::indirect == RenderOptions::draw_path) {
+			indirect_renderer.Begin();
+			for (std::uint32_t i : visible_models) {
+				indirect_renderer.Push(scene, i);
+			}
+			indirect_renderer.Submit(indirect_shader, prepass);
+			return;
+		}
+
+		if (RenderOptions::occlusion_queries)
+			occlusion_queries.Begin(scene.Size());
+
+		frame.queue.Begin(matrix_view, kFarPlane);
+		for (std::uint32_t i : visible_models) {
+			if (!RenderOptions::occlusion_queries || occlusion_queries.Visible(i))
+				frame.queue.Push(scene, i);
+		}
+		frame.queue.Sort();
+		frame.queue.Submit(queue_shader, prepass);
+
+		if (RenderOptions::occlusion_queries) {
+			// Hidden models with many triangles are drawn under conditional
+			// rendering; the GPU skips them if their box is still hidden.
+			constexpr std::size_t kExpensiveIndices = 3000;
+			occlusion_queries.Query(matrix_projection * matrix_view, frame.cameraPosition,
+				scene_bvh.ObjectBounds(), visible_models,
+				[](std::uint32_t i) { return scene.Mesh(scene.Meshes()[i])->indices.size() >= kExpensiveIndices; },
+				[queue_shader, prepass](std::uint32_t i) {
+					conditional_queue.Begin(matrix_view, kFarPlane);
+					conditional_queue.Push(scene, i);
+					conditional_queue.Sort();
+					conditional_queue.Submit(queue_shader, prepass);
+				}
+			);
 		}
 	}
 
-	void draw_scene() {
-		for (auto &model : scene) {
-			model.Draw();
+	void draw_scene(FrameData& frame) {
+		PROFILE_SCOPE("draw_scene");
+		bool const deferred = RenderOptions::deferred_shading;
+
+		GpuProfileScope zone(gpu_profiler, "scene");
+		scene_timer.Begin();
+		fragment_counter.Begin();
+		if (deferred) {
+			gpu_profiler.Push("G-buffer");
+			deferred_shading.Begin(render_width, render_height);
 		}
+
+		draw_models(frame, deferred);
+
+		if (deferred) {
+			gpu_profiler.Pop();
+			GpuProfileScope lighting(gpu_profiler, "lighting");
+			deferred_shading.Resolve(*shader_deferred_lighting, render_output);
+		}
+		fragment_counter.End();
+		scene_timer.End();
+	}
+
+	void release_scene() {
+		// GL objects must be deleted while the context is still around, so
+		// don't leave this to the destructors of the globals.
+		frame_pipeline.Stop();
+		WindowControl::frame_pacing.Release();
+		WindowControl::headless.Release();
+		WindowControl::benchmark.Release();
+		for (auto& frame : frames)
+			frame.queue.Release();
+		conditional_queue.Release();
+		occlusion_queries.Release();
+		indirect_renderer.Release();
+		gpu_culling.Release();
+		clustered_lighting.Release();
+		deferred_shading.Release();
+		scene_timer.Release();
+		gpu_profiler.Release();
+		depth_prepass.Release();
+		fragment_counter.Release();
+		shadows.Release();
+		dynamic_resolution.Release();
+		scene_target.Release();
+		scene.Clear();
+		cube.reset();
+		cat.reset();
+		shader_phong.reset();
+		shader_phong_indirect.reset();
+		shader_phong_gbuffer.reset();
+		shader_phong_indirect_gbuffer.reset();
+		shader_deferred_lighting.reset();
+		geometry_arena().Release();
+		stream_buffer().Release();
+		release_instance_index_buffer();
+	}
+
+	// Prints the model under the centre of the screen.
+	void pick(Camera const& camera) {
+		BvhHit hit;
+		if (!scene_bvh.Raycast(camera.Position, camera.Front, kFarPlane, hit)) {
+			std::printf("pick: nothing\n");
+			return;
+		}
+
+		// Everything within a unit of the hit point
+		Vec3f const point = camera.Position + hit.distance * camera.Front;
+		AABB around;
+		around.Expand(point - Vec3f{ 1.f, 1.f, 1.f });
+		around.Expand(point + Vec3f{ 1.f, 1.f, 1.f });
+		std::vector<std::uint32_t> nearby;
+		scene_bvh.Overlap(around, nearby);
+
+		std::printf("pick: model %u at distance %.2f, %zu models within 1 unit\n",
+			hit.object, hit.distance, nearby.size()
+		);
+	}
+
+	// Compares scene layouts (--bench-storage), seen from the initial camera.
+	void bench_storage(float aspect) {
+		run_storage_benchmark(cube, shader_phong, material_s, texture_base, WindowControl::camera.GetViewMatrix(),
+			make_perspective_projection(PI / 2.0, aspect, kNearPlane, kFarPlane), kFarPlane
+		);
+	}
+
+	// Draw calls of the scene pass in the last frame submitted, on the
+	// current path
+	unsigned int scene_draw_calls() {
+		using RenderOptions::DrawPath;
+
+		switch (RenderOptions::draw_path) {
+		case DrawPath::gpuCulled: return 1;
+		case DrawPath::gpuOcclusionCulled: return 2;
+		case DrawPath::indirect: return 1;
+		default: break;
+		}
+		unsigned int draws = frames[submitted_frame].queue.Stats().draws;
+		if (RenderOptions::occlusion_queries)
+			draws += occlusion_queries.Stats().conditional;
+		return draws;
+	}
+
+	// "glUniform4fv 120, glBindTexture 40, ...", per frame over frames
+	void print_gl_entries(std::vector<GlInterceptEntry> const& entries, bool redundant, unsigned int frames) {
+		for (std::size_t i = 0; i < entries.size(); ++i) {
+			double const count = double(redundant ? entries[i].redundant : entries[i].calls) / double(std::max(frames, 1u));
+			std::printf("%s%s %.*f", 0 == i ? "" : ", ", entries[i].name, frames > 1 ? 2 : 0, count);
+		}
+		if (entries.empty())
+			std::printf("none");
+	}
+
+	void print_stats() {
+		using RenderOptions::DrawPath;
+
+		bool const gpu = DrawPath::gpuCulled == RenderOptions::draw_path || DrawPath::gpuOcclusionCulled == RenderOptions::draw_path;
+		{
+			auto const& stats = scene_graph.Stats();
+			std::printf("scene graph: %u nodes, %u updated in %.3f ms\n", stats.nodes, stats.updated, stats.updateMs);
+		}
+		{
+			auto const& stats = frame_pipeline.Stats();
+			std::printf("frame preparation: %s, %.3f ms CPU on the %s | GL thread: waited %.3f ms, submitted in %.3f ms CPU\n",
+				stats.threaded ? "threaded" : "serial", stats.prepareMs, stats.threaded ? "worker" : "GL thread",
+				stats.waitMs, submit_ms
+			);
+		}
+		{
+			auto const& pacing = WindowControl::frame_pacing;
+			auto const& stats = pacing.Stats();
+			auto const& simulation = WindowControl::timestep.Stats();
+			std::printf("frame pacing: %s%s, frame %.3f ms CPU | simulation: %.0f Hz, %u steps this frame, alpha %.2f, %u frames over budget | latency (input to GPU done): last %.2f ms, average %.2f ms, max %.2f ms, %u frames measured, %u missed\n",
+				FramePacing::ModeName(pacing.Mode()),
+				FramePacingMode::adaptive == pacing.Mode() && !stats.adaptiveSupported ? " (unsupported, vsync)" : "",
+				stats.frameMs,
+				1. / FixedTimestep::kStep, simulation.steps, simulation.alpha, simulation.dropped,
+				stats.latencyMs, stats.latencyAverageMs, stats.latencyMaxMs, stats.measured, stats.missed
+			);
+		}
+		{
+			auto const& profile = gpu_profiler.LastFrame();
+			auto const& stats = gpu_profiler.Stats();
+			std::printf("gpu profile: frame %u | %u frames collected, %u dropped | %u queries pooled\n",
+				profile.frame, stats.frames, stats.dropped, stats.queries
+			);
+			for (auto const& zone : profile.zones) {
+				std::printf("  %*s%-*s %8.3f ms GPU (self %.3f ms)\n",
+					2 * zone.depth, "", 24 - 2 * zone.depth, zone.name, zone.ms, zone.selfMs
+				);
+			}
+		}
+		if (gl_intercept.Installed()) {
+			auto const& stats = gl_intercept.Stats();
+			std::printf("gl calls: %u last frame, %u redundant (%.1f%%) | most called: ",
+				stats.calls, stats.redundant, 100. * stats.redundant / double(std::max(stats.calls, 1u))
+			);
+			print_gl_entries(gl_intercept.TopCalls(5, false), false, 1);
+			std::printf(" | most redundant: ");
+			print_gl_entries(gl_intercept.TopRedundant(5, false), true, 1);
+			std::printf("\n");
+		}
+		{
+			auto const& stats = stream_buffer().Stats();
+			std::printf("stream buffer: %s, %d x %zu KiB | %u allocations, %zu KiB this frame | waited on %u of %u frames (%.3f ms this frame) | grown %u times\n",
+				stats.persistent ? "persistent" : "glBufferSubData fallback",
+				StreamBuffer::kRegions, stats.regionBytes / 1024,
+				stats.allocations, stats.bytes / 1024,
+				stats.waits, stats.frames, stats.waitMs, stats.grows
+			);
+		}
+		if (RenderOptions::deferred_shading) {
+			auto const& stats = deferred_shading.Stats();
+			double const gbufferMiB = double(stats.width) * stats.height * stats.bytesPerPixel / (1024. * 1024.);
+			std::printf("shading: deferred, scene %.3f ms GPU (G-buffer pass %.3f ms, lighting pass %.3f ms) | G-buffer %dx%d, %u B/pixel, %.1f MiB written and read per frame\n",
+				scene_timer.Ms(), stats.geometryTimeMs, stats.lightingTimeMs,
+				stats.width, stats.height, stats.bytesPerPixel, gbufferMiB
+			);
+		}
+		else {
+			std::printf("shading: forward, scene %.3f ms GPU\n", scene_timer.Ms());
+		}
+		if (RenderOptions::dynamic_resolution) {
+			auto const& stats = dynamic_resolution.Stats();
+			auto const& settings = dynamic_resolution.Settings();
+			std::printf("dynamic resolution: scale %.2f (%dx%d) | GPU frame %.3f ms, target %.2f ms, scale %.2f to %.2f | %u changes\n",
+				stats.scale, stats.width, stats.height, stats.frameTimeMs,
+				settings.targetMs, settings.minScale, settings.maxScale, stats.changes
+			);
+		}
+		if (fragment_counter.Supported()) {
+			// Includes the deferred lighting pass, which shades each pixel once
+			double const pixels = double(render_width) * render_height;
+			std::printf("depth prepass: %s | %.2f fragment shader invocations per pixel\n",
+				RenderOptions::depth_prepass ? "on" : "off", double(fragment_counter.Invocations()) / pixels
+			);
+		}
+		else {
+			std::printf("depth prepass: %s | fragment shader invocations: n/a\n", RenderOptions::depth_prepass ? "on" : "off");
+		}
+		if (RenderOptions::shadows) {
+			auto const& stats = shadows.Stats();
+			std::printf("shadows: %u cascades of %ux%u, splits at %.1f/%.1f/%.1f/%.1f | %u static casters cached (%u cascades re-rendered this frame, %u since startup), %u dynamic | shadow passes %.3f ms GPU\n",
+				stats.cascades, stats.resolution, stats.resolution,
+				stats.splits[0], stats.splits[1], stats.splits[2], stats.splits[3],
+				stats.staticCasters, stats.staticCascadesRendered, stats.staticRenders, stats.dynamicCasters, stats.passTimeMs
+			);
+		}
+		if (RenderOptions::clustered_lighting && !point_lights.empty()) {
+			auto const& stats = clustered_lighting.Stats();
+			std::printf("clustered lighting: %u lights, %ux%ux%u clusters | %.1f lights per cluster on average, at most %u, %u clusters overflowed | assign pass %.3f ms\n",
+				stats.lights, ClusteredLighting::kTilesX, ClusteredLighting::kTilesY, ClusteredLighting::kSlices,
+				float(stats.lightRefs) / float(stats.clusters), stats.maxClusterLights, stats.overflowed, stats.assignTimeMs
+			);
+		}
+		if (RenderOptions::cpu_culling && !gpu) {
+			auto const& stats = scene_bvh.Stats();
+			std::printf("bvh: %u visible, %u culled, %u nodes visited, cull %.3f ms | %u leaves refitted in %.3f ms\n",
+				stats.visible, stats.culled, stats.nodesVisited, stats.cullMs,
+				stats.refittedLeaves, stats.refitMs
+			);
+		}
+		if (RenderOptions::software_occlusion && !gpu) {
+			auto const& stats = software_occlusion.Stats();
+			std::printf("software occlusion: %u occluders, %u triangles, %dx%d on %u threads, raster %.3f ms | %u tested, %u occluded, test %.3f ms\n",
+				stats.occluders, stats.triangles, software_occlusion.Width(), software_occlusion.Height(), stats.threads,
+				stats.rasterMs, stats.tested, stats.occluded, stats.testMs
+			);
+		}
+
+		if (RenderOptions::occlusion_queries && DrawPath::queue == RenderOptions::draw_path) {
+			auto const& stats = occlusion_queries.Stats();
+			std::printf("occlusion queries: %u issued, %u read, %u pending, %u occluded, %u conditional draws | %u queries allocated\n",
+				stats.issued, stats.read, stats.pending, stats.occluded, stats.conditional, stats.pool
+			);
+		}
+
+		if (DrawPath::gpuCulled == RenderOptions::draw_path) {
+			auto const& stats = gpu_culling.Stats();
+			std::printf("gpu culling: %u objects, %u commands | %u visible | %u objects uploaded | cull pass %.3f ms\n",
+				stats.objects, stats.commands, stats.visible, stats.uploadedObjects, stats.cullTimeMs
+			);
+			return;
+		}
+		if (DrawPath::gpuOcclusionCulled == RenderOptions::draw_path) {
+			auto const& stats = gpu_culling.Stats();
+			std::printf("gpu occlusion culling: %u objects, %u commands | %u visible (%u in second phase), %u occluded | %u objects uploaded | cull passes %.3f ms, hi-z %.3f ms\n",
+				stats.objects, stats.commands, stats.visible, stats.lateVisible, stats.occluded,
+				stats.uploadedObjects, stats.cullTimeMs, stats.hizTimeMs
+			);
+			return;
+		}
+
+		if (DrawPath::indirect == RenderOptions::draw_path) {
+			auto const& stats = indirect_renderer.Stats();
+			std::printf("indirect: 1 multi-draw, %u commands, %u instances | %u materials | %u texture layers\n",
+				stats.commands, stats.instances, stats.materials, stats.textureLayers
+			);
+			return;
+		}
+
+		auto const& stats = frames[submitted_frame].queue.Stats();
+		std::printf("queue: %u draws, %u instances | program %u (saved %u) | texture %u (saved %u) | vao %u (saved %u) | material %u (saved %u) | %u binds saved\n",
+			stats.draws, stats.instances,
+			stats.programBinds, stats.programSaved,
+			stats.textureBinds, stats.textureSaved,
+			stats.vaoBinds, stats.vaoSaved,
+			stats.materialUploads, stats.materialSaved,
+			stats.BindsSaved()
+		);
 	}
 
 }
@@ -377,9 +1234,156 @@ namespace SceneControl
 using namespace WindowControl;
 using namespace SceneControl;
 
-int main() try
+int main( int argc, char* argv[] ) try
 {
-	// Initialize GLFW
+	// Command line options
+	bool benchStorage = false;
+	bool benchJobs = false;
+	HeadlessSettings headlessSettings;
+	BenchmarkSettings benchmarkSettings;
+	char const* compareBase = nullptr;
+	char const* compareNew = nullptr;
+	float tolerancePercent = 5.f;
+	bool pacingGiven = false;
+	std::string recordPath;
+	std::string gpuProfileCsv;
+	bool gpuDebugGroups = false;
+	std::string cpuTrace;
+	bool glIntercept = false;
+	GLDebugOutput glDebugOutput = GLDebugOutput::asynchronous;
+	char const* glPerfLog = nullptr;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( 0 == std::strcmp( argv[i], "--objects" ) && i + 1 < argc )
+			RenderOptions::extra_objects = std::strtoul( argv[++i], nullptr, 10 );
+		else if( 0 == std::strcmp( argv[i], "--lights" ) && i + 1 < argc )
+			RenderOptions::point_lights = std::strtoul( argv[++i], nullptr, 10 );
+		else if( 0 == std::strcmp( argv[i], "--bench-storage" ) )
+			benchStorage = true;
+		else if( 0 == std::strcmp( argv[i], "--bench-jobs" ) )
+			benchJobs = true;
+		else if( 0 == std::strcmp( argv[i], "--dynamic-resolution" ) )
+			RenderOptions::dynamic_resolution = true;
+		else if( 0 == std::strcmp( argv[i], "--target-ms" ) && i + 1 < argc )
+			RenderOptions::dynamic_resolution_settings.targetMs = std::strtof( argv[++i], nullptr );
+		else if( 0 == std::strcmp( argv[i], "--min-scale" ) && i + 1 < argc )
+			RenderOptions::dynamic_resolution_settings.minScale = std::strtof( argv[++i], nullptr );
+		else if( 0 == std::strcmp( argv[i], "--max-scale" ) && i + 1 < argc )
+			RenderOptions::dynamic_resolution_settings.maxScale = std::strtof( argv[++i], nullptr );
+		else if( 0 == std::strcmp( argv[i], "--pacing" ) && i + 1 < argc )
+		{
+			char const* const name = argv[++i];
+			if( 0 == std::strcmp( name, "vsync" ) )
+				RenderOptions::frame_pacing = FramePacingMode::vsync;
+			else if( 0 == std::strcmp( name, "adaptive" ) )
+				RenderOptions::frame_pacing = FramePacingMode::adaptive;
+			else if( 0 == std::strcmp( name, "capped" ) )
+				RenderOptions::frame_pacing = FramePacingMode::capped;
+			else if( 0 == std::strcmp( name, "uncapped" ) )
+				RenderOptions::frame_pacing = FramePacingMode::uncapped;
+			else
+				throw Error( "Unknown frame pacing '%s' (expected vsync, adaptive, capped or uncapped)", name );
+			pacingGiven = true;
+		}
+		else if( 0 == std::strcmp( argv[i], "--fps-cap" ) && i + 1 < argc )
+			RenderOptions::fps_cap = std::strtof( argv[++i], nullptr );
+		else if( 0 == std::strcmp( argv[i], "--headless" ) )
+			headlessSettings.enabled = true;
+		else if( 0 == std::strcmp( argv[i], "--context" ) && i + 1 < argc )
+		{
+			char const* const name = argv[++i];
+			if( 0 == std::strcmp( name, "osmesa" ) )
+				headlessSettings.context = HeadlessContext::osmesa;
+			else if( 0 == std::strcmp( name, "egl" ) )
+				headlessSettings.context = HeadlessContext::egl;
+			else
+				throw Error( "Unknown headless context '%s' (expected osmesa or egl)", name );
+		}
+		else if( 0 == std::strcmp( argv[i], "--size" ) && i + 1 < argc )
+		{
+			if( 2 != std::sscanf( argv[++i], "%dx%d", &headlessSettings.width, &headlessSettings.height ) )
+				throw Error( "Expected --size WxH, got '%s'", argv[i] );
+		}
+		else if( 0 == std::strcmp( argv[i], "--frames" ) && i + 1 < argc )
+			headlessSettings.frames = benchmarkSettings.frames = std::strtoul( argv[++i], nullptr, 10 );
+		else if( 0 == std::strcmp( argv[i], "--output" ) && i + 1 < argc )
+			headlessSettings.output = argv[++i];
+		else if( 0 == std::strcmp( argv[i], "--output-every" ) && i + 1 < argc )
+			headlessSettings.outputEvery = std::strtoul( argv[++i], nullptr, 10 );
+		else if( 0 == std::strcmp( argv[i], "--benchmark" ) )
+			benchmarkSettings.enabled = true;
+		else if( 0 == std::strcmp( argv[i], "--camera-path" ) && i + 1 < argc )
+			benchmarkSettings.cameraPath = argv[++i];
+		else if( 0 == std::strcmp( argv[i], "--warmup" ) && i + 1 < argc )
+			benchmarkSettings.warmupFrames = std::strtoul( argv[++i], nullptr, 10 );
+		else if( 0 == std::strcmp( argv[i], "--bench-output" ) && i + 1 < argc )
+			benchmarkSettings.output = argv[++i];
+		else if( 0 == std::strcmp( argv[i], "--record-path" ) && i + 1 < argc )
+			recordPath = argv[++i];
+		else if( 0 == std::strcmp( argv[i], "--bench-compare" ) && i + 2 < argc )
+		{
+			compareBase = argv[++i];
+			compareNew = argv[++i];
+		}
+		else if( 0 == std::strcmp( argv[i], "--tolerance" ) && i + 1 < argc )
+			tolerancePercent = std::strtof( argv[++i], nullptr );
+		else if( 0 == std::strcmp( argv[i], "--gpu-profile-csv" ) && i + 1 < argc )
+			gpuProfileCsv = argv[++i];
+		else if( 0 == std::strcmp( argv[i], "--gpu-debug-groups" ) )
+			gpuDebugGroups = true;
+		else if( 0 == std::strcmp( argv[i], "--cpu-trace" ) && i + 1 < argc )
+			cpuTrace = argv[++i];
+		else if( 0 == std::strcmp( argv[i], "--gl-intercept" ) )
+			glIntercept = true;
+		else if( 0 == std::strcmp( argv[i], "--gl-debug-sync" ) )
+			glDebugOutput = GLDebugOutput::synchronous;
+		else if( 0 == std::strcmp( argv[i], "--gl-perf-log" ) && i + 1 < argc )
+			glPerfLog = argv[++i];
+		else if( 0 == std::strcmp( argv[i], "--threaded" ) )
+			RenderOptions::threaded_preparation = true;
+		else
+			throw Error( "Unknown option '%s' (usage: %s [--objects N] [--lights N] [--bench-storage] [--bench-jobs] [--dynamic-resolution] [--target-ms MS] [--min-scale S] [--max-scale S] [--threaded] [--pacing vsync|adaptive|capped|uncapped] [--fps-cap N] [--headless] [--context osmesa|egl] [--size WxH] [--frames N] [--output PREFIX] [--output-every N] [--benchmark] [--camera-path FILE] [--warmup N] [--bench-output FILE] [--record-path FILE] [--bench-compare BASE NEW] [--tolerance PCT] [--gpu-profile-csv FILE] [--gpu-debug-groups] [--cpu-trace FILE] [--gl-intercept] [--gl-debug-sync] [--gl-perf-log FILE])", argv[i], argv[0] );
+	}
+	dynamic_resolution.Configure( RenderOptions::dynamic_resolution_settings );
+
+	// Benchmarks run unthrottled, unless asked otherwise, and headless ones
+	// for exactly the warm-up and the measured frames
+	if( benchmarkSettings.enabled )
+	{
+		for( int i = 1; i < argc; ++i )
+			benchmarkSettings.label += std::string( 1 == i ? "" : " " ) + argv[i];
+		if( !pacingGiven )
+			RenderOptions::frame_pacing = FramePacingMode::uncapped;
+		headlessSettings.frames = benchmarkSettings.warmupFrames + benchmarkSettings.frames;
+	}
+	headless.Configure( headlessSettings );
+	benchmark.Configure( benchmarkSettings );
+
+	// GPU profile zones go to the CSV file and the benchmark, if any
+	gpu_profiler.SetDebugGroups( gpuDebugGroups );
+	if( !gpuProfileCsv.empty() )
+		gpu_profiler.OpenCsv( gpuProfileCsv.c_str() );
+	if( benchmark.Enabled() )
+		gpu_profiler.SetListener( []( GpuProfileFrame const& aFrame ) { benchmark.AddGpuZones( aFrame ); } );
+
+	// CPU profile zones, from the start, written out as a Chrome trace
+	if( !cpuTrace.empty() )
+	{
+		profile_thread_name( "main" );
+		profile_enable( true );
+	}
+
+	if( compareBase )
+		return compare_benchmarks( compareBase, compareNew, tolerancePercent ) > 0 ? 1 : 0;
+
+	if( benchJobs )
+	{
+		run_job_benchmark();
+		return 0;
+	}
+
+	// Initialize GLFW (on its null platform, if headless)
+	headless.InitHints();
 	if( GLFW_TRUE != glfwInit() )
 	{
 		char const* msg = nullptr;
@@ -412,9 +1416,12 @@ int main() try
 	glfwWindowHint( GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE );
 #	endif // ~ !NDEBUG
 
+	// Headless: no window, an OSMesa or EGL context on the null platform
+	headless.WindowHints();
+
 	GLFWwindow* window = glfwCreateWindow(
-		1280,
-		720,
+		headless.Enabled() ? headless.Settings().width : 1280,
+		headless.Enabled() ? headless.Settings().height : 720,
 		kWindowTitle,
 		nullptr, nullptr
 	);
@@ -432,32 +1439,44 @@ int main() try
 	glfwMakeContextCurrent(window);
 	glfwSetKeyCallback( window, &glfw_callback_key_ );
     glfwSetFramebufferSizeCallback(window, glfw_framebuffer_size_);
-    glfwSetCursorPosCallback(window, glfw_callback_mouse_);
 
 
 	// Set up drawing stuff
 	glfwMakeContextCurrent( window );
-	glfwSwapInterval( 1 ); // V-Sync is on.
+	frame_pacing.SetMode( RenderOptions::frame_pacing, RenderOptions::fps_cap ); // V-Sync is on by default.
 
 	// Initialize GLAD
 	// This will load the OpenGL API. We mustn't make any OpenGL calls before this!
 	if( !gladLoadGLLoader( (GLADloadproc)&glfwGetProcAddress ) )
 		throw Error( "gladLoaDGLLoader() failed - cannot load GL API!" );
 
+	// Count GL calls, and redundant state changes; left out, costs nothing
+	if( glIntercept )
+		gl_intercept.Install();
+
 	std::printf( "RENDERER %s\n", glGetString( GL_RENDERER ) );
 	std::printf( "VENDOR %s\n", glGetString( GL_VENDOR ) );
 	std::printf( "VERSION %s\n", glGetString( GL_VERSION ) );
 	std::printf( "SHADING_LANGUAGE_VERSION %s\n", glGetString( GL_SHADING_LANGUAGE_VERSION ) );
+	if( headless.Enabled() )
+	{
+		auto const& settings = headless.Settings();
+		std::printf( "HEADLESS %s context, %u frames at %dx%d\n",
+			Headless::ContextName( settings.context ), settings.frames, settings.width, settings.height );
+	}
 
-	// Ddebug output
-#	if !defined(NDEBUG)
-	setup_gl_debug_output();
-#	endif // ~ !NDEBUG
+	// Debug output, in debug builds only. Asynchronous by default, so that
+	// debug builds can still be profiled; --gl-debug-sync reports messages
+	// within the offending GL call instead, for the debugger.
+	setup_gl_debug_output( glDebugOutput, glPerfLog );
 
 	// Global GL state
 	OGL_CHECKPOINT_ALWAYS();
 
 	// TODO: global GL setup goes here
+	// Nothing draws in wireframe, so the polygon mode is set once, here
+	// rather than on every bind
+	glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
 
 	OGL_CHECKPOINT_ALWAYS();
 
@@ -479,15 +1498,56 @@ int main() try
 
 	OGL_CHECKPOINT_ALWAYS();
 
+	if( benchStorage )
+	{
+		bench_storage( float(iwidth) / float(iheight) );
+		release_scene();
+		return 0;
+	}
+
 	// Main loop
 	while( !glfwWindowShouldClose( window ) )
 	{
+		PROFILE_SCOPE( "frame" );
+
+		// The frame prepared on the worker, if any. Until the next one is
+		// kicked, the scene may be changed here (e.g. by the key handlers).
+		{
+			PROFILE_SCOPE( "wait for preparation" );
+			frame_pipeline.Wait();
+		}
+		frame_pacing.BeginFrame();
 
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrameTime;
         lastFrameTime = currentFrame;
-		// Let GLFW process events
+
+		// Benchmarks advance by a fixed step per frame, whatever the frame
+		// rate, so that every run draws the same frames
+		if( benchmark.Enabled() )
+		{
+			benchmark.BeginFrame();
+			deltaTime = float(Benchmark::kFrameStep);
+		}
+		gpu_profiler.BeginFrame();
+
+		// Print per-frame statistics about once per second (toggle with F1)
+		if( showStats && currentFrame - lastStatsTime >= 1.f )
+		{
+			lastStatsTime = currentFrame;
+			print_stats();
+		}
+
+		// Let GLFW process events, and sample the input once for the frame
 		glfwPollEvents();
+		sample_input( window );
+
+		// Advance the simulation in fixed steps, and draw between the last two
+		for( int steps = timestep.Advance( deltaTime ); steps > 0; --steps )
+			step_camera( float(FixedTimestep::kStep) );
+		Camera view = benchmark.Enabled() ? benchmark.FrameCamera() : interpolated_camera();
+		if( !recordPath.empty() )
+			recorded_path.Record( currentFrame, view );
 		
 		// Check if window was resized.
 		float fbwidth, fbheight;
@@ -517,24 +1577,152 @@ int main() try
 		// Update state
 
 		//TODO: update state
-		update_scene(camera);
+		stream_buffer().BeginFrame();
+		bool const dynamicResolution = RenderOptions::dynamic_resolution;
+		render_width = _window_width_;
+		render_height = _window_height_;
+		if( headless.Enabled() )
+		{
+			headless.BeginFrame();
+			window_output = headless.Framebuffer();
+		}
+		render_output = window_output;
+		if( dynamicResolution )
+		{
+			dynamic_resolution.BeginFrame( _window_width_, _window_height_ );
+			render_width = dynamic_resolution.Width();
+			render_height = dynamic_resolution.Height();
+
+			auto const& stats = dynamic_resolution.Stats();
+			if( stats.changed )
+			{
+				std::printf( "dynamic resolution: scale %.2f (%dx%d), GPU frame %.3f ms, target %.2f ms\n",
+					stats.scale, stats.width, stats.height, stats.frameTimeMs, dynamic_resolution.Settings().targetMs );
+			}
+		}
+
+		// Prepare the frame here, unless the worker did. When threaded, the
+		// worker then prepares the next one while this one is submitted.
+		bool const threaded = RenderOptions::threaded_preparation && prepares_draw_list();
+		FrameData& frame = frames[current_frame];
+		if( !threaded || !frame.prepared )
+		{
+			begin_frame( frame, view );
+			frame_pipeline.Run( [&frame] { prepare_frame( frame ); } );
+		}
+		if( threaded )
+		{
+			FrameData& next = frames[1 - current_frame];
+			begin_frame( next, view );
+			frame_pipeline.Kick( [&next] { prepare_frame( next ); } );
+		}
+
+		double const submitStart = glfwGetTime();
+		{
+			GpuProfileScope zone( gpu_profiler, "update" );
+			update_scene(frame);
+		}
 	
 		// Draw scene
+		if( dynamicResolution )
+		{
+			dynamic_resolution.Bind();
+			render_output = dynamic_resolution.Framebuffer();
+		}
+		else
+			glBindFramebuffer( GL_FRAMEBUFFER, render_output );
 		(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 		glEnable(GL_DEPTH_TEST);
 		OGL_CHECKPOINT_DEBUG();
-		draw_scene();
+		draw_scene(frame);
+		if( dynamicResolution )
+		{
+			GpuProfileScope zone( gpu_profiler, "upscale" );
+			dynamic_resolution.EndFrame( window_output );
+		}
 
 		//TODO: draw frame
+		stream_buffer().EndFrame();
+		submit_ms = float( 1000. * (glfwGetTime() - submitStart) );
+
+		frame.prepared = false;
+		submitted_frame = current_frame;
+		if( threaded )
+			current_frame = 1 - current_frame;
+
+		gpu_profiler.EndFrame();
+		if( benchmark.Enabled() )
+		{
+			benchmark.EndFrame( scene_draw_calls() );
+			if( benchmark.Done() )
+				glfwSetWindowShouldClose( window, GLFW_TRUE );
+		}
 
 		OGL_CHECKPOINT_DEBUG();
 
+		if( headless.Enabled() )
+		{
+			headless.EndFrame();
+			if( headless.Done() )
+				glfwSetWindowShouldClose( window, GLFW_TRUE );
+		}
+
 		// Display results
-		glfwSwapBuffers( window );
+		{
+			PROFILE_SCOPE( "swap" );
+			glfwSwapBuffers( window );
+			frame_pacing.EndFrame( frame.inputTime );
+		}
+		gl_intercept.EndFrame();
+		poll_gl_debug_output();
+
+		if( benchmark.Enabled() && benchmark.Done() )
+		{
+			gpu_profiler.Flush();
+			benchmark.Finish( reinterpret_cast<char const*>(glGetString( GL_RENDERER )) );
+			std::printf( "benchmark: %zu frames measured, written to '%s'\n",
+				benchmark.Samples().size(), benchmark.Settings().output.c_str() );
+		}
+	}
+
+	if( !recordPath.empty() )
+	{
+		recorded_path.Save( recordPath.c_str() );
+		std::printf( "camera path: %zu keys written to '%s'\n", recorded_path.KeyCount(), recordPath.c_str() );
+	}
+
+	if( headless.Enabled() )
+	{
+		auto const& stats = headless.Stats();
+		std::printf( "headless: %u frames in %.1f ms, %.3f ms per frame | %u written in %.1f ms\n",
+			stats.frames, stats.elapsedMs, stats.elapsedMs / float(stats.frames), stats.written, stats.writeMs );
+	}
+
+	print_gl_debug_output_summary();
+
+	if( gl_intercept.Installed() )
+	{
+		auto const& stats = gl_intercept.Stats();
+		std::printf( "gl calls: %.1f per frame over %u frames, %.1f redundant (%.1f%%)\n",
+			double(stats.totalCalls) / double(std::max( stats.frames, 1u )), stats.frames,
+			double(stats.totalRedundant) / double(std::max( stats.frames, 1u )),
+			100. * double(stats.totalRedundant) / double(std::max( stats.totalCalls, 1ull )) );
+		std::printf( "  most called, per frame: " );
+		print_gl_entries( gl_intercept.TopCalls( 10, true ), false, stats.frames );
+		std::printf( "\n  most redundant, per frame: " );
+		print_gl_entries( gl_intercept.TopRedundant( 10, true ), true, stats.frames );
+		std::printf( "\n" );
+	}
+
+	if( !cpuTrace.empty() )
+	{
+		std::size_t const zones = profile_write_chrome_trace( cpuTrace.c_str() );
+		std::printf( "CPU trace: %zu zones written to '%s'\n", zones, cpuTrace.c_str() );
 	}
 
 	// Cleanup.
 	//TODO: additional cleanup
+	release_scene();
 	
 	return 0;
 }
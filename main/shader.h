@@ -18,8 +18,10 @@ public:
     unsigned int ID;
     Shader() = default;
     // constructor generates the shader on the fly
+    // defines (e.g. "#define FOO\n") are inserted after each #version line,
+    // so that several program variants can be built from the same sources
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const char* defines = nullptr)
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -56,6 +58,12 @@ public:
                 gShaderFile.close();
                 geometryCode = gShaderStream.str();
             }
+            if (defines != nullptr)
+            {
+                insertDefines(vertexCode, defines);
+                insertDefines(fragmentCode, defines);
+                insertDefines(geometryCode, defines);
+            }
         }
         catch (std::ifstream::failure& e)
         {
@@ -76,7 +84,7 @@ public:
         glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
+        unsigned int geometry = 0;
         if (geometryPath != nullptr)
         {
             const char* gShaderCode = geometryCode.c_str();
@@ -166,6 +174,19 @@ public:
     }
 
 private:
+    // utility function for adding defines after the #version line
+    // ------------------------------------------------------------------------
+    static void insertDefines(std::string& code, const char* defines)
+    {
+        auto const version = code.find("#version");
+        if (version == std::string::npos)
+        {
+            code.insert(0, defines);
+            return;
+        }
+        auto const eol = code.find('\n', version);
+        code.insert(eol == std::string::npos ? code.size() : eol + 1, defines);
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
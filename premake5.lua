@@ -91,6 +91,15 @@ project "main"
 
 	files( sources )
 
+	-- Only SoftwareOcclusionAvx2.cpp is built with AVX2; SoftwareOcclusion
+	-- checks that the CPU supports it before calling that code
+	filter { "files:main/SoftwareOcclusionAvx2.cpp", "toolset:msc-*" }
+		vectorextensions "AVX2"
+	filter { "files:main/SoftwareOcclusionAvx2.cpp", "toolset:gcc or toolset:clang" }
+		buildoptions "-mavx2"
+
+	filter "*"
+
 project "main-shaders"
 	local shaders = { 
 		"assets/*.vert",
@@ -119,6 +128,43 @@ project "support"
 
 	files( sources )
 
+project "test-jobs"
+	local sources = { 
+		"tests/jobs/**.cpp",
+		"tests/jobs/**.hpp"
+	}
+
+	kind "ConsoleApp"
+	location "tests/jobs"
+
+	files( sources )
+
+	links "support"
+
+project "test-occlusion"
+	local sources = { 
+		"tests/occlusion/**.cpp",
+		"tests/occlusion/**.hpp",
+		"main/SoftwareOcclusion.cpp",
+		"main/SoftwareOcclusionAvx2.cpp"
+	}
+
+	kind "ConsoleApp"
+	location "tests/occlusion"
+
+	files( sources )
+
+	links "vmlib"
+	links "support"
+
+	-- As in main
+	filter { "files:main/SoftwareOcclusionAvx2.cpp", "toolset:msc-*" }
+		vectorextensions "AVX2"
+	filter { "files:main/SoftwareOcclusionAvx2.cpp", "toolset:gcc or toolset:clang" }
+		buildoptions "-mavx2"
+
+	filter "*"
+
 project "vmlib"
 	local sources = { 
 		"vmlib/**.cpp",
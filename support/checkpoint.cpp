@@ -3,6 +3,7 @@
 #include <glad.h>
 
 #include "error.hpp"
+#include "debug_output.hpp"
 
 namespace
 {
@@ -35,4 +36,12 @@ namespace detail
 			throw Error( "(%s:%d) glGetError() returned %s (%d)", aSourceFile, aSourceLine, error_string_(res), res );
 		}
 	}
+
+	void check_gl_error_debug( char const* aSourceFile, int aSourceLine )
+	{
+		if( gl_debug_output_asynchronous() )
+			check_gl_debug_output( aSourceFile, aSourceLine );
+		else
+			check_gl_error( aSourceFile, aSourceLine );
+	}
 }
@@ -9,12 +9,19 @@
 #if defined(NDEBUG)
 #	define OGL_CHECKPOINT_DEBUG()   do {} while(0)
 #else
-#	define OGL_CHECKPOINT_DEBUG()   OGL_CHECKPOINT_ALWAYS()
+#	define OGL_CHECKPOINT_DEBUG() do {                             \
+		::detail::check_gl_error_debug( __FILE__, __LINE__ );       \
+	} while(0)                                                      \
+	/*ENDM*/
 #endif
 
 namespace detail
 {
 	void check_gl_error( char const*, int );
+
+	// glGetError(), unless the debug output is asynchronous: then the
+	// errors it reported, which doesn't stall (see debug_output.hpp)
+	void check_gl_error_debug( char const*, int );
 }
 
 #endif // CHECKPOINT_HPP_3DFDA796_469C_4D37_B904_1C8D8FAE207B
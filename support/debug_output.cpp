@@ -1,7 +1,14 @@
 #include "debug_output.hpp"
 
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
 #include <cstdio>
 #include <cassert>
+#include <cstring>
 
 #include <glad.h>
 #include <GLFW/glfw3.h>
@@ -11,13 +18,137 @@
 
 namespace
 {
-	// Debug callback
+	// Messages longer than this are cut short
+	constexpr std::size_t kMessageLength = 256;
+	// Power of two
+	constexpr std::size_t kQueueCapacity = 256;
+
+	struct DebugMessage
+	{
+		GLenum source, type, severity;
+		GLuint id;
+		char text[kMessageLength];
+	};
+
+	// Bounded multi-producer, single-consumer queue (Vyukov's bounded MPMC
+	// queue, with a single consumer). Each cell has a sequence number that
+	// says whose turn it is: the producer of ticket n waits for n, the
+	// consumer for n+1. When full, messages are dropped rather than waited
+	// for, since the callback mustn't block the driver.
+	class DebugMessageQueue
+	{
+		public:
+			DebugMessageQueue()
+				: mCells( new Cell_[kQueueCapacity] )
+				, mEnqueue( 0 )
+				, mDequeue( 0 )
+			{
+				for( std::size_t i = 0; i < kQueueCapacity; ++i )
+					mCells[i].sequence.store( i, std::memory_order_relaxed );
+			}
+
+		public:
+			// Any thread
+			bool push( GLenum aSource, GLenum aType, GLuint aId, GLenum aSeverity, GLsizei aLength, GLchar const* aText ) noexcept
+			{
+				std::size_t ticket = mEnqueue.load( std::memory_order_relaxed );
+				Cell_* cell;
+				for( ;; )
+				{
+					cell = &mCells[ticket & (kQueueCapacity - 1)];
+					std::size_t const sequence = cell->sequence.load( std::memory_order_acquire );
+					auto const diff = static_cast<std::ptrdiff_t>(sequence - ticket);
+					if( 0 == diff )
+					{
+						if( mEnqueue.compare_exchange_weak( ticket, ticket + 1, std::memory_order_relaxed ) )
+							break;
+					}
+					else if( diff < 0 )
+						return false; // full
+					else
+						ticket = mEnqueue.load( std::memory_order_relaxed );
+				}
+
+				DebugMessage& message = cell->message;
+				message.source = aSource;
+				message.type = aType;
+				message.id = aId;
+				message.severity = aSeverity;
+				std::size_t const length = aLength < 0 ? std::strlen( aText ) : std::size_t(aLength);
+				std::size_t const copied = std::min( length, kMessageLength - 1 );
+				std::memcpy( message.text, aText, copied );
+				message.text[copied] = '\0';
+
+				cell->sequence.store( ticket + 1, std::memory_order_release );
+				return true;
+			}
+
+			// The consumer's thread only
+			bool pop( DebugMessage& aMessage ) noexcept
+			{
+				Cell_& cell = mCells[mDequeue & (kQueueCapacity - 1)];
+				if( cell.sequence.load( std::memory_order_acquire ) != mDequeue + 1 )
+					return false;
+
+				aMessage = cell.message;
+				cell.sequence.store( mDequeue + kQueueCapacity, std::memory_order_release );
+				++mDequeue;
+				return true;
+			}
+
+		private:
+			struct Cell_
+			{
+				std::atomic<std::size_t> sequence;
+				DebugMessage message;
+			};
+
+			std::unique_ptr<Cell_[]> mCells;
+			std::atomic<std::size_t> mEnqueue;
+			std::size_t mDequeue;
+	};
+
+	// Messages with the same source, type and id
+	struct DebugMessageCount
+	{
+		GLenum source, type, severity;
+		GLuint id;
+		unsigned long long count;
+		bool muted;
+		std::string text; // the first one
+	};
+
+	struct AsyncOutput
+	{
+		DebugMessageQueue queue;
+		std::atomic<unsigned long long> dropped{ 0 };
+
+		// Only touched by the GL thread
+		std::vector<DebugMessageCount> counts;
+		std::FILE* perfLog = nullptr; // stderr, if not opened
+		unsigned long long perfMessages = 0;
+	};
+
+	// Debug output is only set up in debug builds; release builds compile
+	// none of the below, and the functions using it do nothing
 #	if !defined(NDEBUG)
+	// Set up once, and never torn down: the driver may still call back while
+	// the program exits (the perf log is closed at exit)
+	AsyncOutput* gAsyncOutput = nullptr;
+
+	char const* type_str_( GLenum ) noexcept;
+	char const* severity_str_( GLenum ) noexcept;
+
+	// Debug callback
 	void GLAPIENTRY callback_gldebug_( GLenum, GLenum, GLuint, GLenum, GLsizei, GLchar const*, void const* );
+	void GLAPIENTRY callback_gldebug_async_( GLenum, GLenum, GLuint, GLenum, GLsizei, GLchar const*, void const* );
+
+	// Drains the queue; returns the first error, if any (empty otherwise)
+	std::string drain_async_output_();
 #	endif // ~ !NDEBUG
 }
 
-void setup_gl_debug_output()
+void setup_gl_debug_output( GLDebugOutput aMode, char const* aPerfLogPath )
 {
 #	if !defined(NDEBUG)
 	OGL_CHECKPOINT_ALWAYS();
@@ -26,18 +157,115 @@ void setup_gl_debug_output()
 	// Apple. The extension (ARB_debug_output), which predates standardization
 	// doesn't seem to exist on Apple either.
 #	if !defined(__APPLE__)
-	glDebugMessageCallback( &callback_gldebug_, nullptr );
-	glEnable( GL_DEBUG_OUTPUT );
+	if( GLDebugOutput::asynchronous == aMode )
+	{
+		if( !gAsyncOutput )
+			gAsyncOutput = new AsyncOutput();
+
+		if( aPerfLogPath )
+		{
+			if( !gAsyncOutput->perfLog || stderr == gAsyncOutput->perfLog )
+				gAsyncOutput->perfLog = std::fopen( aPerfLogPath, "w" );
+			if( !gAsyncOutput->perfLog )
+				throw Error( "setup_gl_debug_output(): unable to create '%s'", aPerfLogPath );
+		}
+		else if( !gAsyncOutput->perfLog )
+			gAsyncOutput->perfLog = stderr;
 
-	// Make sure the callback is called synchronously and from the same thread.
-	// This makes the debugger more useful.
-	glEnable( GL_DEBUG_OUTPUT_SYNCHRONOUS );
+		// Leave out what would only be dropped later: the debug groups of
+		// the GPU profiler, markers, and the "other" chatter
+		glDebugMessageControl( GL_DONT_CARE, GL_DEBUG_TYPE_OTHER, GL_DONT_CARE, 0, nullptr, GL_FALSE );
+		glDebugMessageControl( GL_DONT_CARE, GL_DEBUG_TYPE_MARKER, GL_DONT_CARE, 0, nullptr, GL_FALSE );
+		glDebugMessageControl( GL_DONT_CARE, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE );
+		glDebugMessageControl( GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE );
+
+		glDebugMessageCallback( &callback_gldebug_async_, gAsyncOutput );
+		glEnable( GL_DEBUG_OUTPUT );
+		glDisable( GL_DEBUG_OUTPUT_SYNCHRONOUS );
+	}
+	else
+	{
+		glDebugMessageCallback( &callback_gldebug_, nullptr );
+		glEnable( GL_DEBUG_OUTPUT );
+
+		// Make sure the callback is called synchronously and from the same thread.
+		// This makes the debugger more useful.
+		glEnable( GL_DEBUG_OUTPUT_SYNCHRONOUS );
+	}
+#	else
+	(void)aMode;
+	(void)aPerfLogPath;
 #	endif // ~ __APPLE__
 
 	OGL_CHECKPOINT_ALWAYS();
+#	else
+	(void)aMode;
+	(void)aPerfLogPath;
+#	endif // ~ !NDEBUG
+}
+
+void poll_gl_debug_output()
+{
+#	if !defined(NDEBUG)
+	if( !gAsyncOutput )
+		return;
+
+	std::string const error = drain_async_output_();
+	if( !error.empty() )
+		throw Error( "OpenGL debug output reported an error: %s", error.c_str() );
+#	endif // ~ !NDEBUG
+}
+
+void print_gl_debug_output_summary()
+{
+#	if !defined(NDEBUG)
+	if( !gAsyncOutput )
+		return;
+
+	drain_async_output_();
+
+	auto counts = gAsyncOutput->counts;
+	std::stable_sort( counts.begin(), counts.end(), [] (DebugMessageCount const& aX, DebugMessageCount const& aY) {
+		return aX.count > aY.count;
+	} );
+
+	std::printf( "gl debug output: %zu ids, %llu performance messages, %llu dropped (queue full)\n",
+		counts.size(), gAsyncOutput->perfMessages, gAsyncOutput->dropped.load( std::memory_order_relaxed ) );
+	for( auto const& count : counts )
+	{
+		std::printf( "  %8llu x %s [%s] id %u%s: %s\n", count.count, severity_str_(count.severity),
+			type_str_(count.type), count.id, count.muted ? " (muted)" : "", count.text.c_str() );
+	}
 #	endif // ~ !NDEBUG
 }
 
+namespace detail
+{
+	bool gl_debug_output_asynchronous() noexcept
+	{
+#		if !defined(NDEBUG)
+		return nullptr != gAsyncOutput;
+#		else
+		return false;
+#		endif // ~ !NDEBUG
+	}
+
+	void check_gl_debug_output( char const* aSourceFile, int aSourceLine )
+	{
+#		if !defined(NDEBUG)
+		if( !gAsyncOutput )
+			return;
+
+		std::string const error = drain_async_output_();
+		if( !error.empty() )
+			throw Error( "(%s:%d) OpenGL debug output reported an error, at or before this point: %s", aSourceFile, aSourceLine, error.c_str() );
+#		else
+		(void)aSourceFile;
+		(void)aSourceLine;
+#		endif // ~ !NDEBUG
+	}
+}
+
 namespace
 {
 #	if !defined(NDEBUG)
@@ -71,6 +299,51 @@ namespace
 		return "<unknown severity>";
 	}
 
+	std::string drain_async_output_()
+	{
+		std::string error;
+
+		DebugMessage message;
+		while( gAsyncOutput->queue.pop( message ) )
+		{
+			auto& counts = gAsyncOutput->counts;
+			auto it = std::find_if( counts.begin(), counts.end(), [&message] (DebugMessageCount const& aCount) {
+				return aCount.id == message.id && aCount.type == message.type && aCount.source == message.source;
+			} );
+			if( counts.end() == it )
+			{
+				counts.emplace_back( DebugMessageCount{ message.source, message.type, message.severity, message.id, 0, false, message.text } );
+				it = counts.end() - 1;
+			}
+			++it->count;
+
+			if( GL_DEBUG_TYPE_ERROR == message.type && error.empty() )
+				error = message.text;
+
+			// Messages queued before their id was muted are only counted
+			if( it->muted )
+				continue;
+
+			if( GL_DEBUG_TYPE_PERFORMANCE == message.type )
+			{
+				++gAsyncOutput->perfMessages;
+				std::fprintf( gAsyncOutput->perfLog, "OpenGL Perf: %s [id %u]: %s\n", severity_str_(message.severity), message.id, message.text );
+			}
+			else
+				std::fprintf( stderr, "OpenGL Debug: %s [%s]: %s\n", severity_str_(message.severity), type_str_(message.type), message.text );
+
+			if( it->count >= kDebugOutputMuteAfter && GL_DEBUG_TYPE_ERROR != message.type )
+			{
+				glDebugMessageControl( message.source, message.type, GL_DONT_CARE, 1, &message.id, GL_FALSE );
+				it->muted = true;
+				std::fprintf( GL_DEBUG_TYPE_PERFORMANCE == message.type ? gAsyncOutput->perfLog : stderr,
+					"OpenGL Debug: id %u muted after %u messages\n", message.id, kDebugOutputMuteAfter );
+			}
+		}
+
+		return error;
+	}
+
 	void GLAPIENTRY callback_gldebug_( GLenum, GLenum aType, GLuint, GLenum aSeverity, GLsizei, GLchar const* aMessage, void const* /*aUser*/ )
 	{
 		// "Other" can be a bit spammy at times. However, it can include fairly
@@ -86,6 +359,14 @@ namespace
 		if( GL_DEBUG_SEVERITY_HIGH == aSeverity )
 			assert( false );
 	}
+
+	void GLAPIENTRY callback_gldebug_async_( GLenum aSource, GLenum aType, GLuint aId, GLenum aSeverity, GLsizei aLength, GLchar const* aMessage, void const* aUser )
+	{
+		// Any thread, at any time: no locks, no allocations, no GL
+		auto* output = static_cast<AsyncOutput*>(const_cast<void*>(aUser));
+		if( !output->queue.push( aSource, aType, aId, aSeverity, aLength, aMessage ) )
+			output->dropped.fetch_add( 1, std::memory_order_relaxed );
+	}
 #	endif // ~ !NDEBUG
 }
 
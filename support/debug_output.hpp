@@ -1,6 +1,48 @@
 #ifndef DEBUG_OUTPUT_HPP_91C7C3DF_B7F1_4025_B682_2456DFD7C05D
 #define DEBUG_OUTPUT_HPP_91C7C3DF_B7F1_4025_B682_2456DFD7C05D
 
-void setup_gl_debug_output();
+// OpenGL debug output (KHR_debug), in debug builds.
+//
+// Asynchronous (the default), the driver calls back whenever and from
+// whichever thread it likes; the callback only pushes the message into a
+// lock-free queue, and OGL_CHECKPOINT_DEBUG() drains the queue rather than
+// calling glGetError(): errors then throw at the first checkpoint after the
+// driver reported them, which may be a little after the call that caused
+// them. Messages are aggregated by id; an id is muted
+// (glDebugMessageControl()) after kDebugOutputMuteAfter messages.
+// GL_DEBUG_TYPE_PERFORMANCE messages go to a separate log, aPerfLogPath
+// (stderr if null). Markers, debug groups and "other" messages are filtered
+// out by the driver. This keeps frame times meaningful in debug builds.
+//
+// Synchronous, the callback runs within the GL call that caused the
+// message, on the calling thread, which is handy in a debugger;
+// OGL_CHECKPOINT_DEBUG() checks glGetError(). Both stall the driver, so
+// frame times are meaningless.
+//
+// Call poll_gl_debug_output() once per frame, so that messages show up even
+// without checkpoints.
+
+enum class GLDebugOutput
+{
+	synchronous,
+	asynchronous
+};
+
+constexpr unsigned int kDebugOutputMuteAfter = 16;
+
+void setup_gl_debug_output( GLDebugOutput aMode = GLDebugOutput::asynchronous, char const* aPerfLogPath = nullptr );
+
+// Asynchronous mode: drains the queue (on the GL thread), and throws if an
+// error came up. Does nothing otherwise.
+void poll_gl_debug_output();
+
+// Asynchronous mode: the messages received, per id, most frequent first.
+void print_gl_debug_output_summary();
+
+namespace detail
+{
+	bool gl_debug_output_asynchronous() noexcept;
+	void check_gl_debug_output( char const*, int );
+}
 
 #endif // DEBUG_OUTPUT_HPP_91C7C3DF_B7F1_4025_B682_2456DFD7C05D
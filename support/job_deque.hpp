@@ -0,0 +1,75 @@
+#ifndef JOB_DEQUE_HPP_5C0E2B8A_3D1F_4E57_9A66_0B7C41D2E8F3
+#define JOB_DEQUE_HPP_5C0E2B8A_3D1F_4E57_9A66_0B7C41D2E8F3
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <cstdint>
+
+// The job system's deque (see jobs.hpp). Internal; declared here so that it
+// can be tested on its own.
+
+namespace detail
+{
+	struct Job;
+
+	// Chase-Lev work-stealing deque (Chase & Lev, "Dynamic Circular
+	// Work-Stealing Deque", 2005), with the memory orderings of Lê et al.
+	// ("Correct and Efficient Work-Stealing for Weak Memory Models", 2013).
+	//
+	// Only the owner calls push() and take(), at the bottom; any thread may
+	// call steal(), at the top. The ring grows when full; the old rings are
+	// kept until the deque is destroyed, as thieves may still be reading
+	// them.
+	class JobDeque
+	{
+		public:
+			explicit JobDeque( std::int64_t aCapacity = 256 );
+
+			JobDeque( JobDeque const& ) = delete;
+			JobDeque& operator= (JobDeque const&) = delete;
+
+		public:
+			void push( Job* );
+			Job* take();
+			// Null if empty, or if another thread took the job first
+			Job* steal();
+
+			bool empty() const noexcept;
+
+		private:
+			struct Ring_
+			{
+				explicit Ring_( std::int64_t aCapacity )
+					: capacity( aCapacity )
+					, items( new std::atomic<Job*>[std::size_t(aCapacity)] )
+				{}
+
+				Job* load( std::int64_t aIndex ) const noexcept
+				{
+					return items[std::size_t(aIndex & (capacity - 1))].load( std::memory_order_relaxed );
+				}
+				void store( std::int64_t aIndex, Job* aJob ) noexcept
+				{
+					items[std::size_t(aIndex & (capacity - 1))].store( aJob, std::memory_order_relaxed );
+				}
+
+				std::int64_t capacity; // power of two
+				std::unique_ptr<std::atomic<Job*>[]> items;
+			};
+
+			Ring_* grow_( Ring_*, std::int64_t aBottom, std::int64_t aTop );
+
+		private:
+			// Apart, so that thieves (top) and the owner (bottom) don't
+			// share a cache line
+			alignas(64) std::atomic<std::int64_t> mTop;
+			alignas(64) std::atomic<std::int64_t> mBottom;
+			std::atomic<Ring_*> mRing;
+
+			std::vector<std::unique_ptr<Ring_>> mRings; // owner only
+	};
+}
+
+#endif // JOB_DEQUE_HPP_5C0E2B8A_3D1F_4E57_9A66_0B7C41D2E8F3
@@ -0,0 +1,418 @@
+#include "jobs.hpp"
+#include "job_deque.hpp"
+
+#include <string>
+#include <utility>
+
+#include <cassert>
+
+#include "profile.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#	include <emmintrin.h>
+#endif
+
+namespace detail
+{
+	struct Job
+	{
+		std::function<void()> task;
+		JobCounter* counter;
+	};
+}
+
+struct JobSystem::Worker_
+{
+	detail::JobDeque deque;
+	std::thread thread;
+};
+
+namespace
+{
+	// Busy waits before a worker goes to sleep
+	constexpr unsigned int kIdleSpins = 64;
+
+	// The system and worker the calling thread belongs to, if any
+	thread_local JobSystem const* tSystem = nullptr;
+	thread_local unsigned int tWorker = 0;
+
+	void pause_() noexcept
+	{
+#		if defined(__SSE2__) || defined(_M_X64)
+		_mm_pause();
+#		else
+		std::this_thread::yield();
+#		endif
+	}
+}
+
+
+// JobCounter
+JobCounter::JobCounter() noexcept
+	: mPending( 0 )
+{}
+
+bool JobCounter::done() const noexcept
+{
+	return 0 == mPending.load( std::memory_order_acquire );
+}
+
+
+// JobSystem
+JobSystem::JobSystem( unsigned int aThreads )
+	: mQueued( 0 )
+	, mSleeping( 0 )
+	, mStopping( false )
+	, mJobs( 0 )
+	, mSteals( 0 )
+{
+	unsigned int threads = 0 != aThreads ? aThreads : std::thread::hardware_concurrency();
+	if( 0 == threads )
+		threads = 1;
+
+	// All deques exist before any worker starts, as they steal from each
+	// other
+	for( unsigned int i = 1; i < threads; ++i )
+		mWorkers.emplace_back( std::make_unique<Worker_>() );
+	for( std::size_t i = 0; i < mWorkers.size(); ++i )
+		mWorkers[i]->thread = std::thread( &JobSystem::worker_main_, this, static_cast<unsigned int>(i) );
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock( mSleepMutex );
+		mStopping = true;
+	}
+	mWake.notify_all();
+
+	for( auto& worker : mWorkers )
+		worker->thread.join();
+
+	// Jobs nobody waited for
+	for( auto& worker : mWorkers )
+	{
+		while( auto* job = worker->deque.take() )
+			delete job;
+	}
+	for( auto* job : mShared )
+		delete job;
+}
+
+unsigned int JobSystem::threadCount() const noexcept
+{
+	return static_cast<unsigned int>(mWorkers.size()) + 1;
+}
+
+void JobSystem::run( JobCounter* aCounter, std::function<void()> aJob )
+{
+	if( aCounter )
+		aCounter->mPending.fetch_add( 1, std::memory_order_acq_rel );
+
+	submit_( new detail::Job{ std::move(aJob), aCounter } );
+}
+
+void JobSystem::runAfter( JobCounter& aDependency, JobCounter* aCounter, std::function<void()> aJob )
+{
+	if( aCounter )
+		aCounter->mPending.fetch_add( 1, std::memory_order_acq_rel );
+
+	auto* job = new detail::Job{ std::move(aJob), aCounter };
+	{
+		// The last job of aDependency takes its dependents while holding
+		// the lock (see execute_())
+		std::lock_guard<std::mutex> lock( aDependency.mMutex );
+		if( 0 != aDependency.mPending.load( std::memory_order_acquire ) )
+		{
+			aDependency.mDependents.push_back( job );
+			return;
+		}
+	}
+
+	submit_( job );
+}
+
+void JobSystem::wait( JobCounter& aCounter )
+{
+	unsigned int idle = 0;
+	while( 0 != aCounter.mPending.load( std::memory_order_acquire ) )
+	{
+		bool stolen = false;
+		if( auto* job = find_job_( stolen ) )
+		{
+			PROFILE_SCOPE( "job" );
+			execute_( job, stolen );
+			idle = 0;
+		}
+		else if( ++idle < kIdleSpins )
+			pause_();
+		else
+			std::this_thread::yield();
+	}
+
+	// The last job released the lock after its decrement, so aCounter is
+	// no longer touched once this has it.
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lock( aCounter.mMutex );
+		std::swap( error, aCounter.mError );
+	}
+	if( error )
+		std::rethrow_exception( error );
+}
+
+JobSystemStats JobSystem::stats() const noexcept
+{
+	JobSystemStats stats;
+	stats.jobs = mJobs.load( std::memory_order_relaxed );
+	stats.steals = mSteals.load( std::memory_order_relaxed );
+	return stats;
+}
+
+void JobSystem::submit_( detail::Job* aJob )
+{
+	if( this == tSystem )
+		mWorkers[tWorker]->deque.push( aJob );
+	else
+	{
+		std::lock_guard<std::mutex> lock( mSharedMutex );
+		mShared.push_back( aJob );
+	}
+
+	// Sleeping workers check mQueued after announcing themselves in
+	// mSleeping, so one of the two sides sees the other.
+	mQueued.fetch_add( 1, std::memory_order_seq_cst );
+	if( 0 != mSleeping.load( std::memory_order_seq_cst ) )
+	{
+		std::lock_guard<std::mutex> lock( mSleepMutex );
+		mWake.notify_one();
+	}
+}
+
+void JobSystem::execute_( detail::Job* aJob, bool aStolen )
+{
+	std::exception_ptr error;
+	try
+	{
+		aJob->task();
+	}
+	catch( ... )
+	{
+		error = std::current_exception();
+	}
+
+	JobCounter* const counter = aJob->counter;
+	delete aJob;
+
+	mJobs.fetch_add( 1, std::memory_order_relaxed );
+	if( aStolen )
+		mSteals.fetch_add( 1, std::memory_order_relaxed );
+
+	if( !counter )
+		return;
+
+	// Not the last job: nothing else to do. The counter may be gone as soon
+	// as the decrement is visible, so it isn't touched afterwards.
+	if( !error )
+	{
+		std::uint32_t pending = counter->mPending.load( std::memory_order_relaxed );
+		while( pending > 1 )
+		{
+			if( counter->mPending.compare_exchange_weak( pending, pending - 1, std::memory_order_acq_rel, std::memory_order_relaxed ) )
+				return;
+		}
+	}
+
+	// Possibly the last: decrement holding the lock, which wait() takes
+	// before it returns, and queue the dependents if it was.
+	std::vector<detail::Job*> ready;
+	{
+		std::lock_guard<std::mutex> lock( counter->mMutex );
+		if( error && !counter->mError )
+			counter->mError = error;
+		if( 1 == counter->mPending.fetch_sub( 1, std::memory_order_acq_rel ) )
+			ready.swap( counter->mDependents );
+	}
+
+	for( auto* job : ready )
+		submit_( job );
+}
+
+detail::Job* JobSystem::find_job_( bool& aStolen )
+{
+	aStolen = false;
+
+	bool const worker = this == tSystem;
+	if( worker )
+	{
+		if( auto* job = mWorkers[tWorker]->deque.take() )
+		{
+			mQueued.fetch_sub( 1, std::memory_order_relaxed );
+			return job;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mSharedMutex );
+		if( !mShared.empty() )
+		{
+			auto* job = mShared.front();
+			mShared.pop_front();
+			mQueued.fetch_sub( 1, std::memory_order_relaxed );
+			return job;
+		}
+	}
+
+	// Round-robin over the others, starting after the own deque
+	std::size_t const count = mWorkers.size();
+	std::size_t const first = worker ? tWorker + 1 : 0;
+	for( std::size_t i = 0; i < count; ++i )
+	{
+		std::size_t const victim = (first + i) % count;
+		if( worker && victim == tWorker )
+			continue;
+
+		if( auto* job = mWorkers[victim]->deque.steal() )
+		{
+			mQueued.fetch_sub( 1, std::memory_order_relaxed );
+			aStolen = true;
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+bool JobSystem::should_split_() const noexcept
+{
+	// Nobody to share with
+	if( mWorkers.empty() )
+		return false;
+
+	if( this == tSystem )
+		return mWorkers[tWorker]->deque.empty();
+
+	return mQueued.load( std::memory_order_relaxed ) <= 0;
+}
+
+void JobSystem::worker_main_( unsigned int aIndex )
+{
+	tSystem = this;
+	tWorker = aIndex;
+	profile_thread_name( ("job worker " + std::to_string( aIndex )).c_str() );
+
+	unsigned int idle = 0;
+	for( ;; )
+	{
+		bool stolen = false;
+		if( auto* job = find_job_( stolen ) )
+		{
+			PROFILE_SCOPE( "job" );
+			execute_( job, stolen );
+			idle = 0;
+			continue;
+		}
+
+		if( ++idle < kIdleSpins )
+		{
+			pause_();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock( mSleepMutex );
+		mSleeping.fetch_add( 1, std::memory_order_seq_cst );
+		mWake.wait( lock, [this] {
+			return mStopping || mQueued.load( std::memory_order_seq_cst ) > 0;
+		} );
+		mSleeping.fetch_sub( 1, std::memory_order_seq_cst );
+
+		if( mStopping )
+			return;
+		idle = 0;
+	}
+}
+
+
+// detail::JobDeque
+namespace detail
+{
+	JobDeque::JobDeque( std::int64_t aCapacity )
+		: mTop( 0 )
+		, mBottom( 0 )
+	{
+		assert( aCapacity > 0 && 0 == (aCapacity & (aCapacity - 1)) );
+		mRings.emplace_back( std::make_unique<Ring_>( aCapacity ) );
+		mRing.store( mRings.back().get(), std::memory_order_relaxed );
+	}
+
+	void JobDeque::push( Job* aJob )
+	{
+		std::int64_t const bottom = mBottom.load( std::memory_order_relaxed );
+		std::int64_t const top = mTop.load( std::memory_order_acquire );
+		Ring_* ring = mRing.load( std::memory_order_relaxed );
+		if( bottom - top > ring->capacity - 1 )
+			ring = grow_( ring, bottom, top );
+
+		ring->store( bottom, aJob );
+		mBottom.store( bottom + 1, std::memory_order_release );
+	}
+
+	Job* JobDeque::take()
+	{
+		std::int64_t const bottom = mBottom.load( std::memory_order_relaxed ) - 1;
+		Ring_* const ring = mRing.load( std::memory_order_relaxed );
+		mBottom.store( bottom, std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		std::int64_t top = mTop.load( std::memory_order_relaxed );
+
+		if( top > bottom )
+		{
+			// Empty
+			mBottom.store( bottom + 1, std::memory_order_relaxed );
+			return nullptr;
+		}
+
+		Job* job = ring->load( bottom );
+		if( top == bottom )
+		{
+			// The last one; thieves may be after it too
+			if( !mTop.compare_exchange_strong( top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+				job = nullptr;
+			mBottom.store( bottom + 1, std::memory_order_relaxed );
+		}
+		return job;
+	}
+
+	Job* JobDeque::steal()
+	{
+		std::int64_t top = mTop.load( std::memory_order_acquire );
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		std::int64_t const bottom = mBottom.load( std::memory_order_acquire );
+		if( top >= bottom )
+			return nullptr;
+
+		Ring_* const ring = mRing.load( std::memory_order_acquire );
+		Job* const job = ring->load( top );
+		if( !mTop.compare_exchange_strong( top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+			return nullptr;
+		return job;
+	}
+
+	bool JobDeque::empty() const noexcept
+	{
+		std::int64_t const bottom = mBottom.load( std::memory_order_relaxed );
+		std::int64_t const top = mTop.load( std::memory_order_relaxed );
+		return bottom <= top;
+	}
+
+	JobDeque::Ring_* JobDeque::grow_( Ring_* aRing, std::int64_t aBottom, std::int64_t aTop )
+	{
+		auto ring = std::make_unique<Ring_>( 2 * aRing->capacity );
+		for( std::int64_t i = aTop; i < aBottom; ++i )
+			ring->store( i, aRing->load( i ) );
+
+		mRings.emplace_back( std::move(ring) );
+		mRing.store( mRings.back().get(), std::memory_order_release );
+		return mRings.back().get();
+	}
+}
@@ -0,0 +1,209 @@
+#ifndef JOBS_HPP_EA975223_0A94_4088_846A_35106037B6F7
+#define JOBS_HPP_EA975223_0A94_4088_846A_35106037B6F7
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+// Work-stealing job system.
+//
+// Each worker thread owns a Chase-Lev deque of jobs: it pushes and pops jobs
+// at the bottom of its own deque (LIFO, so that it keeps working on what it
+// just split off, which is still in its caches), and when that is empty, it
+// steals from the top of the others' (FIFO, so that thieves take the oldest,
+// and usually largest, pieces of work). Threads that aren't workers submit
+// jobs to a shared queue instead.
+//
+// Jobs report to an optional JobCounter, which counts the jobs that haven't
+// finished yet. A job may depend on a counter (runAfter()): it is only
+// queued once the counter reaches zero. Waiting on a counter (wait()) runs
+// other jobs meanwhile rather than blocking, so it is fine to wait from
+// within a job, and the thread that waits counts as one of the threads of
+// the system. Exceptions thrown by jobs are passed on to whoever waits on
+// their counter (the first one, if there are several).
+//
+// Example:
+//
+//	JobSystem jobs;	// a thread per core, including the calling one
+//
+//	JobCounter loaded;
+//	for( auto const& path : paths )
+//		jobs.run( &loaded, [&]{ load( path ); } );
+//
+//	JobCounter done;
+//	jobs.runAfter( loaded, &done, [&]{ link(); } );
+//	jobs.wait( done );
+//
+//	jobs.parallelFor( 0, items.size(), [&]( std::size_t aBegin, std::size_t aEnd ) {
+//		for( std::size_t i = aBegin; i < aEnd; ++i )
+//			update( items[i] );
+//	} );
+
+namespace detail
+{
+	struct Job;
+}
+
+class JobSystem;
+
+class JobCounter final
+{
+	public:
+		JobCounter() noexcept;
+
+		JobCounter( JobCounter const& ) = delete;
+		JobCounter& operator= (JobCounter const&) = delete;
+
+	public:
+		// No jobs pending. Use JobSystem::wait() to wait for that.
+		bool done() const noexcept;
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<std::uint32_t> mPending;
+
+		std::mutex mMutex; // guards the below, and the last decrement
+		std::vector<detail::Job*> mDependents;
+		std::exception_ptr mError;
+};
+
+struct JobSystemStats
+{
+	std::uint64_t jobs = 0;     // run since startup
+	std::uint64_t steals = 0;   // of these, taken from another thread
+};
+
+class JobSystem final
+{
+	public:
+		// The system uses aThreads threads: aThreads - 1 workers, plus the
+		// thread calling wait() or parallelFor(). With 0, one per hardware
+		// thread.
+		explicit JobSystem( unsigned int aThreads = 0 );
+		~JobSystem();
+
+		JobSystem( JobSystem const& ) = delete;
+		JobSystem& operator= (JobSystem const&) = delete;
+
+	public:
+		unsigned int threadCount() const noexcept;
+
+		// Queues aJob. If aCounter isn't null, it counts aJob as pending
+		// until it has finished.
+		void run( JobCounter* aCounter, std::function<void()> aJob );
+		// As run(), but aJob is only queued once aDependency is done.
+		void runAfter( JobCounter& aDependency, JobCounter* aCounter, std::function<void()> aJob );
+
+		// Runs jobs until aCounter is done; rethrows the first exception
+		// thrown by its jobs. Afterwards, aCounter may be reused.
+		void wait( JobCounter& aCounter );
+
+		// Calls aBody( begin, end ) for subranges that cover [aBegin, aEnd),
+		// in parallel, and waits for them.
+		//
+		// The grain size adapts to the load: the range is cut into pieces of
+		// at least aMinGrain items (more for large ranges, see
+		// kPiecesPerThread), and a job running a range only splits off half
+		// of what is left when its thread has no queued work of its own, i.e.
+		// when other threads have stolen it or are idle. Busy systems thus
+		// run large ranges with few jobs, idle ones spread them out.
+		template< typename tBody >
+		void parallelFor( std::size_t aBegin, std::size_t aEnd, tBody const& aBody, std::size_t aMinGrain = 1 );
+
+		JobSystemStats stats() const noexcept;
+
+	public:
+		static constexpr std::size_t kPiecesPerThread = 8;
+
+	private:
+		struct Worker_;
+
+		template< typename tBody >
+		void run_range_( JobCounter&, std::size_t, std::size_t, std::size_t, tBody const& );
+
+		void submit_( detail::Job* );
+		void execute_( detail::Job*, bool aStolen );
+		detail::Job* find_job_( bool& aStolen );
+		bool should_split_() const noexcept;
+		void worker_main_( unsigned int );
+
+	private:
+		std::vector<std::unique_ptr<Worker_>> mWorkers;
+
+		std::mutex mSharedMutex; // jobs from non-workers
+		std::deque<detail::Job*> mShared;
+
+		std::atomic<std::int64_t> mQueued;
+		std::atomic<unsigned int> mSleeping;
+		std::mutex mSleepMutex;
+		std::condition_variable mWake;
+		bool mStopping; // guarded by mSleepMutex
+
+		std::atomic<std::uint64_t> mJobs;
+		std::atomic<std::uint64_t> mSteals;
+};
+
+
+template< typename tBody > inline
+void JobSystem::parallelFor( std::size_t aBegin, std::size_t aEnd, tBody const& aBody, std::size_t aMinGrain )
+{
+	if( aEnd <= aBegin )
+		return;
+
+	std::size_t const pieces = kPiecesPerThread * threadCount();
+	std::size_t grain = (aEnd - aBegin + pieces - 1) / pieces;
+	if( grain < aMinGrain )
+		grain = aMinGrain;
+	if( grain < 1 )
+		grain = 1;
+
+	JobCounter counter;
+	try
+	{
+		run_range_( counter, aBegin, aEnd, grain, aBody );
+	}
+	catch( ... )
+	{
+		// Jobs split off still refer to counter and aBody
+		try { wait( counter ); } catch( ... ) {}
+		throw;
+	}
+	wait( counter );
+}
+
+template< typename tBody > inline
+void JobSystem::run_range_( JobCounter& aCounter, std::size_t aBegin, std::size_t aEnd, std::size_t aGrain, tBody const& aBody )
+{
+	while( aEnd - aBegin > aGrain )
+	{
+		if( should_split_() )
+		{
+			// Whole grains on the left, at least one
+			std::size_t const grains = (aEnd - aBegin) / aGrain / 2;
+			std::size_t const mid = aBegin + (grains > 1 ? grains : 1) * aGrain;
+			run( &aCounter, [this, &aCounter, &aBody, mid, aEnd, aGrain] {
+				run_range_( aCounter, mid, aEnd, aGrain, aBody );
+			} );
+			aEnd = mid;
+		}
+		else
+		{
+			aBody( aBegin, aBegin + aGrain );
+			aBegin += aGrain;
+		}
+	}
+
+	aBody( aBegin, aEnd );
+}
+
+#endif // JOBS_HPP_EA975223_0A94_4088_846A_35106037B6F7
@@ -0,0 +1,243 @@
+#include "profile.hpp"
+
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+
+#include "error.hpp"
+
+namespace detail
+{
+	std::atomic<bool> gProfileEnabled{ false };
+
+	// One per thread that recorded a zone. Only the owner writes; the
+	// writer of the trace reads concurrently, seqlock style: it copies the
+	// events, then checks how far the owner has got meanwhile, and drops
+	// those that may have been overwritten. The events' fields are atomics
+	// (relaxed; plain stores on x86) so that the copy isn't a data race.
+	class ProfileBuffer
+	{
+		public:
+			explicit ProfileBuffer( unsigned int aThread )
+				: mEvents( new Event[kProfileEvents] )
+				, mHead( 0 )
+				, mThread( aThread )
+			{}
+
+		public:
+			void record( char const* aName, std::uint64_t aBegin, std::uint64_t aEnd ) noexcept
+			{
+				std::uint64_t const head = mHead.load( std::memory_order_relaxed );
+				Event& event = mEvents[head & (kProfileEvents - 1)];
+				event.name.store( aName, std::memory_order_relaxed );
+				event.begin.store( aBegin, std::memory_order_relaxed );
+				event.end.store( aEnd, std::memory_order_relaxed );
+				mHead.store( head + 1, std::memory_order_release );
+			}
+
+			struct Copy
+			{
+				char const* name;
+				std::uint64_t begin, end;
+			};
+			std::vector<Copy> copy() const
+			{
+				std::uint64_t const head = mHead.load( std::memory_order_acquire );
+				std::uint64_t const first = head > kProfileEvents ? head - kProfileEvents : 0;
+
+				std::vector<Copy> events;
+				events.reserve( std::size_t(head - first) );
+				for( std::uint64_t i = first; i < head; ++i )
+				{
+					Event const& event = mEvents[i & (kProfileEvents - 1)];
+					events.push_back( Copy{
+						event.name.load( std::memory_order_relaxed ),
+						event.begin.load( std::memory_order_relaxed ),
+						event.end.load( std::memory_order_relaxed )
+					} );
+				}
+
+				// Slots the owner reached meanwhile may hold newer events
+				std::atomic_thread_fence( std::memory_order_acquire );
+				std::uint64_t const after = mHead.load( std::memory_order_relaxed );
+				std::uint64_t const valid = after > kProfileEvents ? after - kProfileEvents : 0;
+				if( valid > first )
+					events.erase( events.begin(), events.begin() + std::ptrdiff_t(std::min( valid - first, head - first )) );
+				return events;
+			}
+
+			unsigned int thread() const noexcept { return mThread; }
+
+			std::string name; // guarded by the registry's mutex
+
+		private:
+			static_assert( 0 == (kProfileEvents & (kProfileEvents - 1)), "kProfileEvents must be a power of two" );
+
+			struct Event
+			{
+				std::atomic<char const*> name{ nullptr };
+				std::atomic<std::uint64_t> begin{ 0 }, end{ 0 };
+			};
+			std::unique_ptr<Event[]> mEvents;
+			std::atomic<std::uint64_t> mHead; // events recorded, ever
+			unsigned int mThread;
+	};
+}
+
+namespace
+{
+	// Buffers outlive their threads, so that their zones are still written
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<detail::ProfileBuffer>> buffers;
+
+		// Time stamp counter and clock when profiling was first enabled,
+		// the origin of the trace
+		std::uint64_t originTicks = 0;
+		std::chrono::steady_clock::time_point originTime;
+	};
+
+	Registry& registry_()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	// The buffer is only allocated by the thread's first zone, so that
+	// naming threads costs nothing while profiling is disabled
+	thread_local detail::ProfileBuffer* tBuffer = nullptr;
+	thread_local std::string tName;
+
+	detail::ProfileBuffer& thread_buffer_()
+	{
+		if( !tBuffer )
+		{
+			Registry& registry = registry_();
+			std::lock_guard<std::mutex> lock( registry.mutex );
+			registry.buffers.emplace_back( std::make_unique<detail::ProfileBuffer>( unsigned(registry.buffers.size()) ) );
+			tBuffer = registry.buffers.back().get();
+			tBuffer->name = tName;
+		}
+		return *tBuffer;
+	}
+
+	void write_string_( std::FILE* aFile, char const* aText )
+	{
+		std::fputc( '"', aFile );
+		for( ; *aText; ++aText )
+		{
+			if( '"' == *aText || '\\' == *aText )
+				std::fputc( '\\', aFile );
+			if( static_cast<unsigned char>(*aText) >= 0x20 )
+				std::fputc( *aText, aFile );
+		}
+		std::fputc( '"', aFile );
+	}
+}
+
+namespace detail
+{
+	void profile_record( char const* aName, std::uint64_t aBegin, std::uint64_t aEnd ) noexcept
+	{
+		// The first zone of a thread allocates its buffer; out of memory,
+		// the zone is lost
+		try
+		{
+			thread_buffer_().record( aName, aBegin, aEnd );
+		}
+		catch( ... )
+		{
+		}
+	}
+}
+
+void profile_enable( bool aEnabled ) noexcept
+{
+	if( aEnabled )
+	{
+		Registry& registry = registry_();
+		std::lock_guard<std::mutex> lock( registry.mutex );
+		if( 0 == registry.originTicks )
+		{
+			registry.originTime = std::chrono::steady_clock::now();
+			registry.originTicks = detail::profile_ticks();
+		}
+	}
+
+	detail::gProfileEnabled.store( aEnabled, std::memory_order_relaxed );
+}
+
+bool profile_enabled() noexcept
+{
+	return detail::gProfileEnabled.load( std::memory_order_relaxed );
+}
+
+void profile_thread_name( char const* aName )
+{
+	tName = aName;
+	if( tBuffer )
+	{
+		Registry& registry = registry_();
+		std::lock_guard<std::mutex> lock( registry.mutex );
+		tBuffer->name = tName;
+	}
+}
+
+std::size_t profile_write_chrome_trace( char const* aPath )
+{
+	Registry& registry = registry_();
+	std::lock_guard<std::mutex> lock( registry.mutex );
+
+	if( 0 == registry.originTicks )
+		throw Error( "profile_write_chrome_trace(): profiling was never enabled" );
+
+	// Ticks per microsecond, measured over the whole profile
+	double const elapsedUs = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - registry.originTime ).count();
+	std::uint64_t const elapsedTicks = detail::profile_ticks() - registry.originTicks;
+	double const ticksPerUs = elapsedUs > 0.0 && elapsedTicks > 0 ? double(elapsedTicks) / elapsedUs : 1000.0;
+
+	std::FILE* file = std::fopen( aPath, "w" );
+	if( !file )
+		throw Error( "profile_write_chrome_trace(): unable to create '%s'", aPath );
+
+	std::fprintf( file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+	bool first = true;
+	std::size_t written = 0;
+	for( auto const& buffer : registry.buffers )
+	{
+		if( !buffer->name.empty() )
+		{
+			std::fprintf( file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", buffer->thread() );
+			write_string_( file, buffer->name.c_str() );
+			std::fprintf( file, "}}" );
+			first = false;
+		}
+
+		for( auto const& event : buffer->copy() )
+		{
+			// Zones from before the origin (enabled, disabled, re-enabled)
+			// are clamped to it
+			double const begin = event.begin > registry.originTicks ? double(event.begin - registry.originTicks) / ticksPerUs : 0.0;
+			double const end = event.end > registry.originTicks ? double(event.end - registry.originTicks) / ticksPerUs : 0.0;
+
+			std::fprintf( file, "%s{\"name\":", first ? "" : ",\n" );
+			write_string_( file, event.name );
+			std::fprintf( file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", buffer->thread(), begin, end - begin );
+			first = false;
+			++written;
+		}
+	}
+	std::fprintf( file, "\n]}\n" );
+
+	bool const failed = 0 != std::ferror( file );
+	std::fclose( file );
+	if( failed )
+		throw Error( "profile_write_chrome_trace(): unable to write '%s'", aPath );
+
+	return written;
+}
@@ -0,0 +1,386 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <typeinfo>
+#include <stdexcept>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#include "../../support/jobs.hpp"
+#include "../../support/job_deque.hpp"
+
+// Stress tests for the job system (support/jobs.hpp). Each test repeats a
+// fixed number of rounds and checks exact outcomes; a watchdog aborts the
+// run if anything deadlocks. Exits with 0 if all tests passed.
+
+namespace
+{
+	// Rounds of the deque tests
+	constexpr unsigned int kLastElementRounds = 20000;
+	constexpr unsigned int kStressItems = 200000;
+	constexpr unsigned int kThieves = 3;
+
+	// Repetitions of the JobSystem tests, for each thread count
+	constexpr unsigned int kRepeats = 200;
+	constexpr unsigned int kThreadCounts[] = { 1, 2, 4, 8 };
+
+	constexpr auto kWatchdogTimeout = std::chrono::minutes( 5 );
+
+	// Checked from several threads
+	std::atomic<unsigned int> gFailures{ 0 };
+
+#	define CHECK( aCondition ) do {                                            \
+		if( !(aCondition) ) {                                                  \
+			std::fprintf( stderr, "%s:%d: CHECK( %s ) failed\n", __FILE__, __LINE__, #aCondition ); \
+			++gFailures;                                                       \
+		}                                                                      \
+	} while(0)                                                                 \
+	/*ENDM*/
+
+	// The deque only stores the pointers; these are never dereferenced
+	detail::Job* fake_job_( std::uintptr_t aIndex ) noexcept
+	{
+		return reinterpret_cast<detail::Job*>( (aIndex + 1) * 16 );
+	}
+	std::uintptr_t fake_index_( detail::Job* aJob ) noexcept
+	{
+		return reinterpret_cast<std::uintptr_t>(aJob) / 16 - 1;
+	}
+
+	// The owner takes the single item in the deque while thieves try to
+	// steal it: exactly one of them must get it, every round.
+	void test_deque_last_element_()
+	{
+		detail::JobDeque deque( 2 );
+
+		std::atomic<unsigned int> round{ 0 };
+		std::atomic<unsigned int> arrived{ 0 };
+		std::atomic<unsigned int> stolen{ 0 };
+
+		std::vector<std::thread> thieves;
+		for( unsigned int t = 0; t < kThieves; ++t )
+		{
+			thieves.emplace_back( [&] {
+				for( unsigned int seen = 0; seen < kLastElementRounds; )
+				{
+					unsigned int const current = round.load( std::memory_order_acquire );
+					if( current == seen )
+					{
+						std::this_thread::yield();
+						continue;
+					}
+
+					seen = current;
+					if( detail::Job* job = deque.steal() )
+					{
+						CHECK( fake_index_( job ) == seen );
+						stolen.fetch_add( 1, std::memory_order_relaxed );
+					}
+					arrived.fetch_add( 1, std::memory_order_acq_rel );
+				}
+			} );
+		}
+
+		unsigned int taken = 0;
+		for( unsigned int r = 1; r <= kLastElementRounds; ++r )
+		{
+			unsigned int const stolenBefore = stolen.load( std::memory_order_relaxed );
+
+			deque.push( fake_job_( r ) );
+			round.store( r, std::memory_order_release );
+
+			// Give the thieves a head start, of varying length, so that
+			// either side wins some rounds even on a single core
+			for( unsigned int i = 0; i < r % 4; ++i )
+				std::this_thread::yield();
+
+			detail::Job* const job = deque.take();
+			if( job )
+			{
+				CHECK( fake_index_( job ) == r );
+				++taken;
+			}
+
+			while( arrived.load( std::memory_order_acquire ) < r * kThieves )
+				std::this_thread::yield();
+
+			CHECK( (job ? 1u : 0u) + stolen.load( std::memory_order_relaxed ) - stolenBefore == 1 );
+			CHECK( deque.empty() );
+		}
+
+		for( auto& thief : thieves )
+			thief.join();
+
+		CHECK( taken + stolen.load() == kLastElementRounds );
+		std::printf( "deque last element: %u rounds, %u taken by the owner, %u stolen\n",
+			kLastElementRounds, taken, stolen.load() );
+	}
+
+	// The owner pushes (growing the ring from 2) and takes, thieves steal:
+	// every item comes out exactly once.
+	void test_deque_stress_()
+	{
+		detail::JobDeque deque( 2 );
+		std::vector<std::atomic<unsigned int>> seen( kStressItems );
+		for( auto& count : seen )
+			count.store( 0, std::memory_order_relaxed );
+
+		std::atomic<bool> pushing{ true };
+		std::atomic<unsigned int> stolen{ 0 };
+
+		std::vector<std::thread> thieves;
+		for( unsigned int t = 0; t < kThieves; ++t )
+		{
+			thieves.emplace_back( [&] {
+				for( ;; )
+				{
+					bool const more = pushing.load( std::memory_order_acquire );
+					if( detail::Job* job = deque.steal() )
+					{
+						seen[fake_index_( job )].fetch_add( 1, std::memory_order_relaxed );
+						stolen.fetch_add( 1, std::memory_order_relaxed );
+					}
+					else if( !more && deque.empty() )
+						return;
+					else
+						std::this_thread::yield();
+				}
+			} );
+		}
+
+		// Bursts of pushes, every third item taken back at once
+		unsigned int taken = 0;
+		for( unsigned int i = 0; i < kStressItems; ++i )
+		{
+			deque.push( fake_job_( i ) );
+			if( 2 == i % 3 )
+			{
+				if( detail::Job* job = deque.take() )
+				{
+					seen[fake_index_( job )].fetch_add( 1, std::memory_order_relaxed );
+					++taken;
+				}
+			}
+		}
+		while( detail::Job* job = deque.take() )
+		{
+			seen[fake_index_( job )].fetch_add( 1, std::memory_order_relaxed );
+			++taken;
+		}
+		pushing.store( false, std::memory_order_release );
+
+		for( auto& thief : thieves )
+			thief.join();
+
+		unsigned int wrong = 0;
+		for( auto const& count : seen )
+			wrong += 1 == count.load() ? 0 : 1;
+		CHECK( 0 == wrong );
+		CHECK( taken + stolen.load() == kStressItems );
+		std::printf( "deque stress: %u items, %u taken, %u stolen, %u seen other than once\n",
+			kStressItems, taken, stolen.load(), wrong );
+	}
+
+	// Jobs run after their dependency is done, including when it already is,
+	// and chains of dependencies run in order.
+	void test_run_after_( JobSystem& aJobs )
+	{
+		constexpr unsigned int kFirst = 16;
+
+		for( unsigned int r = 0; r < kRepeats; ++r )
+		{
+			std::atomic<unsigned int> first{ 0 };
+			std::atomic<unsigned int> second{ 0 };
+			std::atomic<bool> early{ false };
+			std::atomic<bool> third{ false };
+
+			// Jobs counted by firstDone, which are queued before their
+			// dependents, but may well not have run when these are queued
+			JobCounter firstDone, secondDone, thirdDone;
+
+			for( unsigned int i = 0; i < kFirst; ++i )
+				aJobs.run( &firstDone, [&] { first.fetch_add( 1 ); } );
+			aJobs.runAfter( firstDone, &secondDone, [&] {
+				if( kFirst != first.load() )
+					early = true;
+				second.fetch_add( 1 );
+			} );
+			aJobs.runAfter( secondDone, &thirdDone, [&] {
+				if( 1 != second.load() )
+					early = true;
+				third = true;
+			} );
+
+			aJobs.wait( thirdDone );
+			CHECK( !early.load() );
+			CHECK( third.load() );
+			CHECK( firstDone.done() && secondDone.done() );
+
+			// On a counter that is done already: runs right away
+			bool ran = false;
+			JobCounter lateDone;
+			aJobs.runAfter( firstDone, &lateDone, [&] { ran = true; } );
+			aJobs.wait( lateDone );
+			CHECK( ran );
+		}
+	}
+
+	// A job's exception comes out of wait(), after the other jobs of the
+	// counter have finished; the counter may be reused afterwards.
+	void test_exceptions_( JobSystem& aJobs )
+	{
+		constexpr unsigned int kJobs = 32;
+
+		for( unsigned int r = 0; r < kRepeats; ++r )
+		{
+			std::atomic<unsigned int> finished{ 0 };
+			JobCounter counter;
+			for( unsigned int i = 0; i < kJobs; ++i )
+			{
+				aJobs.run( &counter, [&, i] {
+					if( i == r % kJobs )
+						throw std::runtime_error( "job failed" );
+					finished.fetch_add( 1 );
+				} );
+			}
+
+			bool caught = false;
+			try
+			{
+				aJobs.wait( counter );
+			}
+			catch( std::runtime_error const& eErr )
+			{
+				caught = std::string( "job failed" ) == eErr.what();
+			}
+			CHECK( caught );
+			CHECK( kJobs - 1 == finished.load() );
+			CHECK( counter.done() );
+
+			// Reused, without the error
+			bool ran = false;
+			aJobs.run( &counter, [&] { ran = true; } );
+			aJobs.wait( counter );
+			CHECK( ran );
+
+			// Out of parallelFor(), too
+			caught = false;
+			try
+			{
+				aJobs.parallelFor( 0, 1000, [r]( std::size_t aBegin, std::size_t aEnd ) {
+					if( aBegin <= r && r < aEnd )
+						throw std::runtime_error( "range failed" );
+				} );
+			}
+			catch( std::runtime_error const& )
+			{
+				caught = true;
+			}
+			CHECK( caught );
+		}
+	}
+
+	// Jobs that wait for jobs of their own, nested deeper than there are
+	// threads: waiting runs other jobs rather than blocking, so this must
+	// neither deadlock nor lose jobs.
+	void test_nested_wait_( JobSystem& aJobs )
+	{
+		constexpr unsigned int kWidth = 4;
+		constexpr unsigned int kDepth = 5;
+
+		struct Tree
+		{
+			JobSystem& jobs;
+			std::atomic<unsigned int> leaves{ 0 };
+
+			void run( unsigned int aDepth )
+			{
+				if( 0 == aDepth )
+				{
+					leaves.fetch_add( 1, std::memory_order_relaxed );
+					return;
+				}
+
+				JobCounter children;
+				for( unsigned int i = 0; i < kWidth; ++i )
+					jobs.run( &children, [this, aDepth] { run( aDepth - 1 ); } );
+				jobs.wait( children );
+			}
+		};
+
+		unsigned int expected = 1;
+		for( unsigned int i = 0; i < kDepth; ++i )
+			expected *= kWidth;
+
+		for( unsigned int r = 0; r < kRepeats / 20; ++r )
+		{
+			Tree tree{ aJobs };
+			JobCounter root;
+			aJobs.run( &root, [&tree] { tree.run( kDepth ); } );
+			aJobs.wait( root );
+			CHECK( expected == tree.leaves.load() );
+
+			// parallelFor() from within a job
+			std::atomic<std::size_t> sum{ 0 };
+			JobCounter outer;
+			for( unsigned int i = 0; i < 8; ++i )
+			{
+				aJobs.run( &outer, [&] {
+					aJobs.parallelFor( 0, 1000, [&]( std::size_t aBegin, std::size_t aEnd ) {
+						std::size_t partial = 0;
+						for( std::size_t j = aBegin; j < aEnd; ++j )
+							partial += j;
+						sum.fetch_add( partial, std::memory_order_relaxed );
+					} );
+				} );
+			}
+			aJobs.wait( outer );
+			CHECK( 8 * (999 * 1000 / 2) == sum.load() );
+		}
+	}
+}
+
+int main() try
+{
+	// Deadlocks would otherwise hang the run
+	std::thread( [] {
+		std::this_thread::sleep_for( kWatchdogTimeout );
+		std::fprintf( stderr, "Timed out: deadlock?\n" );
+		std::_Exit( 2 );
+	} ).detach();
+
+	test_deque_last_element_();
+	test_deque_stress_();
+
+	for( unsigned int threads : kThreadCounts )
+	{
+		JobSystem jobs( threads );
+		test_run_after_( jobs );
+		test_exceptions_( jobs );
+		test_nested_wait_( jobs );
+
+		auto const stats = jobs.stats();
+		std::printf( "job system, %u threads: %llu jobs, %llu stolen\n",
+			threads, static_cast<unsigned long long>(stats.jobs), static_cast<unsigned long long>(stats.steals) );
+	}
+
+	if( unsigned int const failures = gFailures.load() )
+	{
+		std::fprintf( stderr, "%u checks failed\n", failures );
+		return 1;
+	}
+
+	std::printf( "All tests passed.\n" );
+	return 0;
+}
+catch( std::exception const& eErr )
+{
+	std::fprintf( stderr, "Top-level Exception (%s):\n", typeid(eErr).name() );
+	std::fprintf( stderr, "%s\n", eErr.what() );
+	std::fprintf( stderr, "Bye.\n" );
+	return 1;
+}
@@ -0,0 +1,200 @@
+#include <vector>
+#include <typeinfo>
+#include <exception>
+
+#include <cstdio>
+
+#include "../../main/SoftwareOcclusion.h"
+
+// Tests for the software occlusion culling (main/SoftwareOcclusion.h),
+// which uses no GPU: a wall is rasterized, and boxes behind it must come
+// back occluded, boxes in front of it or around it visible. Runs on several
+// thread counts, with and without AVX2 (if the CPU has it); the depth
+// buffer must not depend on the number of threads. Exits with 0 if all
+// tests passed.
+
+namespace
+{
+	constexpr int kWidth = 320;
+	constexpr int kHeight = 180;
+
+	// The wall: a grid of quads facing the camera, enough triangles for
+	// several binning batches
+	constexpr int kWallCells = 64;
+	constexpr float kWallHalfSize = 5.f;
+	constexpr float kWallZ = -10.f;
+
+	constexpr unsigned int kThreadCounts[] = { 1, 2, 4, 8 };
+
+	unsigned int gFailures = 0;
+
+#	define CHECK( aCondition ) do {                                            \
+		if( !(aCondition) ) {                                                  \
+			std::fprintf( stderr, "%s:%d: CHECK( %s ) failed\n", __FILE__, __LINE__, #aCondition ); \
+			++gFailures;                                                       \
+		}                                                                      \
+	} while(0)                                                                 \
+	/*ENDM*/
+
+	struct Wall
+	{
+		std::vector<float> positions;
+		std::vector<unsigned int> indices;
+	};
+
+	Wall make_wall_()
+	{
+		Wall wall;
+		for( int y = 0; y <= kWallCells; ++y )
+		{
+			for( int x = 0; x <= kWallCells; ++x )
+			{
+				wall.positions.push_back( -kWallHalfSize + 2.f * kWallHalfSize * x / kWallCells );
+				wall.positions.push_back( -kWallHalfSize + 2.f * kWallHalfSize * y / kWallCells );
+				wall.positions.push_back( 0.f );
+			}
+		}
+
+		// Counter-clockwise, seen from +z
+		for( int y = 0; y < kWallCells; ++y )
+		{
+			for( int x = 0; x < kWallCells; ++x )
+			{
+				unsigned int const i = unsigned(y * (kWallCells + 1) + x);
+				unsigned int const up = i + kWallCells + 1;
+				wall.indices.insert( wall.indices.end(), { i, i + 1, up + 1, i, up + 1, up } );
+			}
+		}
+		return wall;
+	}
+
+	AABB box_( float aX0, float aY0, float aZ0, float aX1, float aY1, float aZ1 )
+	{
+		AABB box;
+		box.Expand( Vec3f{ aX0, aY0, aZ0 } );
+		box.Expand( Vec3f{ aX1, aY1, aZ1 } );
+		return box;
+	}
+
+	// Camera at the origin, looking down -z
+	void rasterize_wall_( SoftwareOcclusion& aOcclusion, Wall const& aWall, Mat44f const& aWorld )
+	{
+		Mat44f const projection = make_perspective_projection( 1.5707964f, float(kWidth) / kHeight, 0.1f, 100.f );
+
+		aOcclusion.Begin( projection );
+		aOcclusion.AddOccluder( aWorld, aWall.positions.data(), 3 * sizeof(float),
+			aWall.indices.data(), aWall.indices.size() );
+		aOcclusion.Rasterize();
+	}
+
+	std::vector<float> depths_( SoftwareOcclusion const& aOcclusion )
+	{
+		std::vector<float> depths;
+		for( int y = 0; y < kHeight; ++y )
+		{
+			for( int x = 0; x < kWidth; ++x )
+				depths.push_back( aOcclusion.Depth( x, y ) );
+		}
+		return depths;
+	}
+
+	// Returns the depth buffer, to compare between thread counts
+	std::vector<float> test_wall_( unsigned int aThreads, bool aAvx2, Wall const& aWall )
+	{
+		SoftwareOcclusion occlusion( kWidth, kHeight, aThreads );
+		occlusion.UseAvx2( aAvx2 );
+		CHECK( aAvx2 == occlusion.Avx2() );
+
+		rasterize_wall_( occlusion, aWall, make_translation( Vec3f{ 0.f, 0.f, kWallZ } ) );
+
+		auto const& stats = occlusion.Stats();
+		CHECK( 1 == stats.occluders );
+		CHECK( 2 * kWallCells * kWallCells == int(stats.triangles) );
+		CHECK( aThreads == stats.threads );
+
+		// The wall covers the centre of the screen, and not the corners
+		CHECK( occlusion.Depth( kWidth / 2, kHeight / 2 ) < 1.f );
+		CHECK( 1.f == occlusion.Depth( 0, 0 ) );
+		CHECK( 1.f == occlusion.Depth( kWidth - 1, kHeight - 1 ) );
+
+		// Behind the wall
+		CHECK( !occlusion.Visible( box_( -1.f, -1.f, -20.f, 1.f, 1.f, -18.f ) ) );
+		CHECK( !occlusion.Visible( box_( -4.f, -4.f, -12.f, 4.f, 4.f, -11.f ) ) );
+		CHECK( !occlusion.Visible( box_( 7.f, 7.f, -30.f, 9.f, 9.f, -29.f ) ) );
+
+		// In front of it, crossing it, beside it, straddling its edge
+		CHECK( occlusion.Visible( box_( -1.f, -1.f, -6.f, 1.f, 1.f, -5.f ) ) );
+		CHECK( occlusion.Visible( box_( -1.f, -1.f, -11.f, 1.f, 1.f, -9.f ) ) );
+		CHECK( occlusion.Visible( box_( 12.f, -1.f, -20.f, 14.f, 1.f, -18.f ) ) );
+		CHECK( occlusion.Visible( box_( 8.f, -1.f, -20.f, 12.f, 1.f, -18.f ) ) );
+
+		// Seen from behind, the wall is back-facing and hides nothing
+		SoftwareOcclusion behind( kWidth, kHeight, aThreads );
+		behind.UseAvx2( aAvx2 );
+		rasterize_wall_( behind, aWall, make_translation( Vec3f{ 0.f, 0.f, kWallZ } ) * make_rotation_y( 180.f ) );
+		CHECK( 0 == behind.Stats().triangles );
+		CHECK( behind.Visible( box_( -1.f, -1.f, -20.f, 1.f, 1.f, -18.f ) ) );
+
+		// Cull() keeps the visible objects, in order
+		std::vector<AABB> const boxes = {
+			box_( -1.f, -1.f, -20.f, 1.f, 1.f, -18.f ),
+			box_( -1.f, -1.f, -6.f, 1.f, 1.f, -5.f ),
+			box_( -4.f, -4.f, -12.f, 4.f, 4.f, -11.f ),
+			box_( 12.f, -1.f, -20.f, 14.f, 1.f, -18.f )
+		};
+		std::vector<std::uint32_t> objects;
+		for( unsigned int r = 0; r < 1000; ++r )
+			objects.push_back( r % 4 );
+		occlusion.Cull( boxes, objects );
+
+		CHECK( 500 == objects.size() );
+		for( std::size_t i = 0; i < objects.size(); ++i )
+			CHECK( (0 == i % 2 ? 1u : 3u) == objects[i] );
+		CHECK( 1000 == occlusion.Stats().tested );
+		CHECK( 500 == occlusion.Stats().occluded );
+
+		return depths_( occlusion );
+	}
+}
+
+int main() try
+{
+	Wall const wall = make_wall_();
+
+	bool const avx2 = SoftwareOcclusion( kWidth, kHeight, 1 ).Avx2();
+	if( !avx2 )
+		std::printf( "AVX2 not supported, testing the scalar code only\n" );
+
+	for( bool path : { false, true } )
+	{
+		if( path && !avx2 )
+			continue;
+
+		std::vector<float> reference;
+		for( unsigned int threads : kThreadCounts )
+		{
+			std::vector<float> const depths = test_wall_( threads, path, wall );
+			if( reference.empty() )
+				reference = depths;
+			CHECK( reference == depths );
+		}
+		std::printf( "%s: %u thread counts tested\n", path ? "AVX2" : "scalar",
+			unsigned(sizeof(kThreadCounts) / sizeof(kThreadCounts[0])) );
+	}
+
+	if( gFailures )
+	{
+		std::fprintf( stderr, "%u checks failed\n", gFailures );
+		return 1;
+	}
+
+	std::printf( "All tests passed.\n" );
+	return 0;
+}
+catch( std::exception const& eErr )
+{
+	std::fprintf( stderr, "Top-level Exception (%s):\n", typeid(eErr).name() );
+	std::fprintf( stderr, "%s\n", eErr.what() );
+	std::fprintf( stderr, "Bye.\n" );
+	return 1;
+}